@@ -0,0 +1,53 @@
+#ifndef __CHECKSUM_H
+#define __CHECKSUM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Image checksum, selected per image by the trailer (ImageHeader_t.ucChkAlg)
+ *
+ * CHK_ALG_CRC16 : Modbus CRC16 (crc16.c), erased trailer byte, images before CRC32
+ * CHK_ALG_CRC32 : the STM32 CRC unit, poly 0x04C11DB7, init 0xFFFFFFFF, no reflection,
+ *                 no final xor, data taken as little endian words, a 1..3 byte tail is
+ *                 zero padded to a word. Updates (and the first part of a combine)
+ *                 must come in multiples of 4 bytes, except for the last one.
+ *
+ * CRC32 runs on an engine, the software model below is bit exact with the unit and is
+ * used until a hardware engine is installed (never on a host build).
+ **/
+
+#define CHK_ALG_CRC16       0xFF
+#define CHK_ALG_CRC32       0x01
+
+#define CHK_CRC16_INIT      0x0000FFFF
+#define CHK_CRC32_INIT      0xFFFFFFFF
+
+typedef struct {
+    // continue ulCrc over pvData
+    uint32_t (*pxUpdate)(uint32_t ulCrc, const void *pvData, uint32_t ulSize);
+} ChkSumEngine_t;
+
+bool xChkSumAlgValid(uint8_t ucAlg);
+uint32_t ulChkSumInit(uint8_t ucAlg);
+uint32_t ulChkSumUpdate(uint8_t ucAlg, uint32_t ulCrc, const void *pvData, uint32_t ulSize);
+uint32_t ulChkSumFinal(uint8_t ucAlg, uint32_t ulCrc);
+uint32_t ulChkSumCalc(uint8_t ucAlg, const void *pvData, uint32_t ulSize);
+// ulChkSumCalc(a + b) from the checksums of a and b, ulSize2 = length of b
+uint32_t ulChkSumCombine(uint8_t ucAlg, uint32_t ulCrc1, uint32_t ulCrc2, uint32_t ulSize2);
+
+// NULL restores the software model
+void vChkSumSetCrc32Engine(const ChkSumEngine_t *pxEngine);
+uint32_t ulChkSumCrc32Soft(uint32_t ulCrc, const void *pvData, uint32_t ulSize);
+
+// Engines, return NULL if the hardware can not be brought up
+const ChkSumEngine_t *pxChkSumHwInit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CHECKSUM_H */
@@ -0,0 +1,31 @@
+#ifndef __CLOCK_H
+#define __CLOCK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Performance clocking
+ *   xClockFast();      PLL from HSI, 96 MHz core, 48 MHz USB, flash wait states + ART
+ *   xClockUsb();       same clocks, PLL from the HSE, accurate enough for USB
+ *   vClockReset();     HSI 16 MHz, prescalers, PLL and wait states at their reset value
+ *
+ * SystemClock_Config() leaves the bootloader on the 16 MHz HSI, hashing and DFU run on
+ * the fast clock, the application always starts from reset clocking.
+ **/
+#define CLOCK_FAST_HZ       96000000
+
+// false if the PLL does not lock, the core stays on HSI
+bool xClockFast(void);
+// false without a crystal, the core stays on the fast clock from the HSI
+bool xClockUsb(void);
+void vClockReset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CLOCK_H */
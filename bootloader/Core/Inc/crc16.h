@@ -0,0 +1,28 @@
+#ifndef __CRC16_H
+#define __CRC16_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* CRC16 (modbus), poly 0xA001 reflected, init 0xFFFF, no final xor
+ *
+ *   crc = CRC16_Init();
+ *   crc = CRC16_Update(crc, block, len); ...      any split of the data
+ *   crc = CRC16_Final(crc);                        == CRC16(data, total)
+ **/
+#define CRC16_INIT  0xFFFF
+
+unsigned int CRC16(unsigned char * pucFrame, unsigned int usLen);
+unsigned int CRC16_Init(void);
+// Continue a CRC16 over the next block, CRC16(a + b) == CRC16_Update(CRC16(a), b)
+unsigned int CRC16_Update(unsigned int usCRC, unsigned char * pucFrame, unsigned int usLen);
+unsigned int CRC16_Final(unsigned int usCRC);
+// CRC16(a + b) from CRC16(a), CRC16(b) and the length of b, no data needed
+unsigned int CRC16_Combine(unsigned int usCRC1, unsigned int usCRC2, unsigned int ulLen2);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CRC16_H */
@@ -0,0 +1,58 @@
+#ifndef __DELTA_H
+#define __DELTA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Streaming delta patch, old image -> new image
+ * ---------------------------------------------------------------------------------------
+ * | [source size 4] [source chksum 4] | [op 1] [arg varint] [data] | ... |
+ * ---------------------------------------------------------------------------------------
+ * COPY   n        : n bytes from the source
+ * DIFF   n [n]    : n bytes, source byte + data byte (bsdiff style, code that moved)
+ * INSERT n [n]    : n literal bytes
+ * SEEK   d        : move the source position by d (zigzag signed)
+ *
+ * The new image is produced front to back, the source is only read, so it can be
+ * the running slot and the output can go straight into the other one.
+ **/
+
+#define DELTA_OP_COPY       0x01
+#define DELTA_OP_DIFF       0x02
+#define DELTA_OP_INSERT     0x03
+#define DELTA_OP_SEEK       0x04
+
+#define DELTA_HDR_SIZE      8
+
+typedef struct {
+    // emit the next output byte
+    bool (*pxPut)(uint8_t ucByte, void *pvCtx);
+    // byte at ulOffset of the source image, ulOffset < ulSrcSize
+    uint8_t (*pxSrc)(uint32_t ulOffset, void *pvCtx);
+    void *pvCtx;
+    uint32_t ulSrcSize;
+    uint32_t ulSrcChkSum;               // as in the source trailer
+    // decoder state
+    uint8_t ucState;
+    uint8_t ucOp;
+    uint8_t ucShift;
+    uint8_t ucHdr[DELTA_HDR_SIZE];
+    uint32_t ulArg;
+    uint32_t ulSrcPos;
+} Delta_t;
+
+// The patch is rejected unless its header names this source
+void vDeltaInit(Delta_t *pxDelta, uint32_t ulSrcSize, uint32_t ulSrcChkSum,
+                bool (*pxPut)(uint8_t, void *), uint8_t (*pxSrc)(uint32_t, void *), void *pvCtx);
+bool xDeltaFeed(Delta_t *pxDelta, const uint8_t *pucIn, uint32_t ulLen);
+bool xDeltaIsDone(const Delta_t *pxDelta);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DELTA_H */
@@ -0,0 +1,54 @@
+#ifndef __FLASH_IF_H
+#define __FLASH_IF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Streaming flash programming
+ *   xFlashIfBegin();                       unlock once
+ *   xFlashIfWrite(addr, src, size); ...    any alignment, any number of runs
+ *   xFlashIfVerify(addr, src, size, &bad); read back, optional
+ *   xFlashIfEnd();                         check errors of the whole batch, lock
+ *   xFlashIfErase(sector);                 one sector, unlocks and locks by itself
+ **/
+#define FLASH_IF_VERIFY_RETRY   1       // programming passes again over a bad range
+
+/* Parallelism, the widest the supply allows (RM0402, table 7), for program and erase
+ *   VDD 1.8 ~ 2.1 V x8, 2.1 ~ 2.7 V x16, 2.7 ~ 3.6 V x32, x64 with 8 ~ 9 V on VPP
+ * VDD_VALUE (mV) is the one of stm32f4xx_hal_conf.h, include it first. A board that
+ * supplies VPP while it programs defines FLASH_IF_VPP 1.
+ **/
+#ifndef FLASH_IF_VPP
+#define FLASH_IF_VPP            0
+#endif
+#ifdef VDD_VALUE
+#if FLASH_IF_VPP && VDD_VALUE >= 2700
+#define FLASH_IF_WIDTH          8
+#elif VDD_VALUE >= 2700
+#define FLASH_IF_WIDTH          4
+#elif VDD_VALUE >= 2100
+#define FLASH_IF_WIDTH          2
+#else
+#define FLASH_IF_WIDTH          1
+#endif
+#endif
+
+bool xFlashIfBegin(void);
+bool xFlashIfWrite(uint32_t ulAddr, const void *pvSrc, uint32_t ulSize);
+bool xFlashIfEnd(void);
+bool xFlashIfErase(uint32_t ulSector);
+// First offset where flash differs from pvSrc, ulSize if equal
+uint32_t ulFlashIfCompare(uint32_t ulAddr, const void *pvSrc, uint32_t ulSize);
+// Compare, program again from the first bad word on, *pulBad = first bad address if it stays bad,
+// pulBad may be NULL
+bool xFlashIfVerify(uint32_t ulAddr, const void *pvSrc, uint32_t ulSize, uint32_t *pulBad);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FLASH_IF_H */
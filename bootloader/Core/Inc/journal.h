@@ -0,0 +1,51 @@
+#ifndef __JOURNAL_H
+#define __JOURNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "slot.h"
+
+/* DFU progress journal, flash sector 1 (kept out of the bootloader image)
+ * ---------------------------------------------------------------------------------------
+ * | JournalSession_t | JournalEntry_t | JournalEntry_t | ... | erased                 |
+ * ---------------------------------------------------------------------------------------
+ * The session names the download (target slot, image size / chksum), an entry is
+ * appended each time a buffer of the image is programmed. Everything is append only,
+ * the sector is erased when a new download starts, so a power cut leaves at worst a
+ * torn last entry, which fails its check word and is skipped.
+ **/
+
+#define JOURNAL_BASE            0x08004000
+#define JOURNAL_SIZE            0x00004000
+#define JOURNAL_MAGIC           0x314E524A  // "JRN1"
+#define JOURNAL_CLOSED          0x00000000  // magic after the image is committed
+
+typedef struct {
+    uint32_t ulSlotBase;
+    uint32_t ulSize;                        // image
+    uint32_t ulChkSum;                      // image
+    uint32_t ulChkAlg;                      // checksum.h
+    uint32_t ulMagic;                       // programmed last
+} JournalSession_t;
+
+typedef struct {
+    uint32_t ulDone;                        // image bytes programmed from slot base
+    uint32_t ulChkSum;                      // running checksum of those bytes
+    uint32_t ulCheck;                       // ~(ulDone ^ ulChkSum)
+} JournalEntry_t;
+
+bool xJournalIsBlank(void);
+// Open session matching pxSession ? return the last good entry, untouched if none
+bool xJournalFind(const JournalSession_t *pxSession, uint32_t *pulDone, uint32_t *pulChkSum);
+// Sector must be erased
+bool xJournalStart(const JournalSession_t *pxSession, SlotProgram_t pxProgram);
+bool xJournalRecord(uint32_t ulDone, uint32_t ulChkSum, SlotProgram_t pxProgram);
+bool xJournalClose(SlotProgram_t pxProgram);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __JOURNAL_H */
@@ -0,0 +1,40 @@
+#ifndef __LZ4_STREAM_H
+#define __LZ4_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Streaming LZ4 block decoder
+ *
+ * Input may be split anywhere, output goes out one byte at a time through pxPut.
+ * Back references are resolved through pxGet, so the history can live in flash that
+ * was already programmed and the decoder itself needs no window buffer.
+ **/
+
+typedef struct {
+    // emit the next output byte
+    bool (*pxPut)(uint8_t ucByte, void *pvCtx);
+    // output byte ulDist bytes back from the next one, 1 = last byte emitted
+    uint8_t (*pxGet)(uint32_t ulDist, void *pvCtx);
+    void *pvCtx;
+    // decoder state
+    uint8_t ucState;
+    uint8_t ucToken;
+    uint32_t ulLen;
+    uint32_t ulOffset;
+    uint32_t ulOutput;
+} Lz4Stream_t;
+
+void vLz4StreamInit(Lz4Stream_t *pxStream, bool (*pxPut)(uint8_t, void *), uint8_t (*pxGet)(uint32_t, void *), void *pvCtx);
+bool xLz4StreamFeed(Lz4Stream_t *pxStream, const uint8_t *pucIn, uint32_t ulLen);
+bool xLz4StreamIsDone(const Lz4Stream_t *pxStream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LZ4_STREAM_H */
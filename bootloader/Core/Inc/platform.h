@@ -0,0 +1,46 @@
+#ifndef __PLATFORM_H
+#define __PLATFORM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Platform, what the bootloader core needs from the chip besides flash_if.h
+ *   pxPlatBcb();                   boot control block, survives a reset
+ *   vPlatFlashFlush();             drop what the flash caches hold
+ *   vPlatReset();
+ *   vPlatJump(vector table);       tear down the boot path, branch into the image
+ *
+ * Flash is read in place, so a backend maps it at its real address.
+ *   platform_stm32.c   STM32F412, HAL
+ *   platform_posix.c   Linux, flash is an image file mapped at 0x08000000, the DFU flow
+ *                      runs at host speed against tools/dfu_sim.py (build: see the file)
+ * The backend is picked at link time, the POSIX one also stands in for the other
+ * hardware modules the core calls (clock.h, spl.h UART, CRC unit, trace.h).
+ **/
+
+// Boot Ctrl Block (BCB), NOINIT SRAM at 0x2001FFF8 on the target, set by the application
+#define BCB_BASE            0x2001FFF8
+#define BCB_SIZE            0x00000008
+#define BCB_DFU_MAGIC       0x12345678
+
+typedef struct {
+    uint32_t ulMagic;       // BCB_DFU_MAGIC requests DFU mode
+    uint16_t usLen;         // image staged in the update slot
+    uint16_t usChkSum;      // its CRC16
+} Bcb_t;
+
+volatile Bcb_t *pxPlatBcb(void);
+void vPlatFlashFlush(void);
+void vPlatReset(void) __attribute__((noreturn));
+// Clocking must be back at reset state (vClockReset)
+void vPlatJump(uint32_t ulVectorTabAddr) __attribute__((noreturn));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PLATFORM_H */
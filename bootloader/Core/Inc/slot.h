@@ -0,0 +1,123 @@
+#ifndef __SLOT_H
+#define __SLOT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A/B image slots
+ * ---------------------------------------------------------------------------------------
+ * | image (vector table first)                 | ... | trailer 0 | trailer 1 | ... | 7 |
+ * ---------------------------------------------------------------------------------------
+ * ^ slot base, SCB->VTOR                        slot end - IMG_TRAILER_AREA ^
+ *
+ * The trailer is written by the bootloader once the image is complete and verified,
+ * ulMagic is programmed last, so a slot interrupted by a power cut never looks valid.
+ * Boot attempts and confirmation are single bytes going 0xFF -> 0x00, no erase needed.
+ *
+ * The trailer in use is the first one whose ulMagic is not IMG_MAGIC_RETIRED. An update
+ * retires it (ulMagic -> 0) before it erases the image, and commits into the next one,
+ * so the last sector of the slot is only erased when the image spans it or all
+ * IMG_TRAILER_COUNT trailers are retired. A slot whose first trailer is blank never had
+ * one (image of the copy-to-app bootloader or a programmer), a later blank one is an
+ * update in progress and does not boot.
+ *
+ * An image may carry its own header (AppHeader_t) at IMG_HDR_OFFSET, right after the
+ * vector table, stamped by tools/imgpack.py. It is checked in O(1) on every boot, it
+ * names the slot the image is linked for, and its checksum (header bytes skipped) lets
+ * an image without a trailer be verified. Once an image passed a full check, the tag
+ * of its header (ulHdrChkSum) goes into ImageHeader_t.ulVerified and later boots do a
+ * partial check as long as the header still matches. Images without a header are
+ * hashed on every boot as before.
+ *
+ * Partial check (lSlotCheckPlan): the image behind the header is split in up to
+ * IMG_HDR_BLOCKS blocks with their checksums in the header. A boot checks the vector
+ * table, that the vector table and the block checksums combine into ulChkSum, and one
+ * block, the next one on every boot. After the last block the next boot is a full
+ * check again. Checks are counted in ucCheckLog, a bit per check going 1 -> 0 (the F4
+ * flash takes more 0 bits on a programmed byte), when the log is used up every boot is
+ * a full check until the next update retires the trailer.
+ **/
+
+#define IMG_MAGIC               0x31474D49  // "IMG1"
+#define IMG_MAGIC_RETIRED       0x00000000
+#define IMG_TRAILER_SIZE        0x00000100
+#define IMG_TRAILER_COUNT       8
+#define IMG_TRAILER_AREA        (IMG_TRAILER_SIZE * IMG_TRAILER_COUNT)
+#define IMG_MIN_SIZE            448         // at least the vector table
+#define IMG_BOOT_ATTEMPTS       3
+
+#define IMG_SIGNATURE_OFFSET    0x00000020
+#define IMG_SIGNATURE_VALUE     0xF1517A66
+
+#define IMG_HDR_OFFSET          0x00000200  // behind the 113 vectors of the F412
+#define IMG_HDR_MAGIC           0x48474D49  // "IMGH"
+#define IMG_HDR_VERSION         1
+
+#define IMG_HDR_BLOCKS          16
+
+#define IMG_HDR_FLAG_NO_CACHE   0x01        // full check on every boot
+
+#define IMG_CHECK_LOG_SIZE      224         // bytes, to the end of the trailer
+
+typedef struct {
+    uint32_t ulMagic;
+    uint32_t ulVersion;
+    uint32_t ulLength;
+    uint32_t ulChkSum;                      // of ulLength bytes from slot base, see ucChkAlg
+    uint8_t ucAttempt[IMG_BOOT_ATTEMPTS];   // 0xFF unused, 0x00 consumed by a boot
+    uint8_t ucConfirmed;                    // 0xFF pending, 0x00 confirmed by the application
+    uint8_t ucChkAlg;                       // checksum.h, 0xFF CRC16
+    uint32_t ulVerified;                    // AppHeader_t.ulHdrChkSum of the verified image
+    uint8_t ucCheckLog[IMG_CHECK_LOG_SIZE]; // a 0 bit per boot check since it was verified
+} ImageHeader_t;
+
+// In the image, little endian, newer header versions only append fields
+typedef struct {
+    uint32_t ulMagic;
+    uint16_t usHdrVersion;
+    uint16_t usHdrSize;                     // bytes, skipped by ulChkSum
+    uint32_t ulLength;                      // image bytes from slot base, header included
+    uint32_t ulLoadAddr;                    // slot base the image is linked for
+    uint32_t ulChkSum;                      // of ulLength bytes without the header, see ucChkAlg
+    uint32_t ulVersion;
+    uint32_t ulBuildId;
+    uint8_t ucChkAlg;
+    uint8_t ucFlags;
+    uint16_t usBlockCount;                  // 1 .. IMG_HDR_BLOCKS
+    uint32_t ulBlockSize;                   // multiple of 4, the last block may be shorter
+    uint32_t ulBlockChkSum[IMG_HDR_BLOCKS]; // blocks from the end of the header on
+    uint32_t ulHdrChkSum;                   // ucChkAlg over the bytes above
+} AppHeader_t;
+
+typedef struct {
+    uint32_t ulBase;                        // vector table of the image
+    uint32_t ulSize;                        // whole slot, trailer included
+} Slot_t;
+
+typedef bool (*SlotProgram_t)(uint32_t ulAddr, const void *pvSrc, uint32_t ulSize);
+
+// Trailer in use, the last one if all are retired
+const ImageHeader_t *pxSlotHeader(const Slot_t *pxSlot);
+uint32_t ulSlotCapacity(const Slot_t *pxSlot);
+// Image header of the slot, NULL if there is none or it is damaged
+const AppHeader_t *pxSlotAppHeader(const Slot_t *pxSlot);
+bool xSlotAppImageValid(const Slot_t *pxSlot, const AppHeader_t *pxApp);
+// Block to check on check ulCount of a verified image, -1 for a full check
+int lSlotCheckPlan(uint32_t ulCount, uint32_t ulBlocks);
+// pxProgram caches a passed full check and counts checks, NULL to leave flash alone
+bool xSlotIsBootable(const Slot_t *pxSlot, uint32_t *pulVersion, SlotProgram_t pxProgram);
+int lSlotSelect(const Slot_t *pxSlots, int lCount, SlotProgram_t pxProgram);
+// Retire the trailer in use, false if no blank one is left and the trailer sector needs an erase
+bool xSlotRetire(const Slot_t *pxSlot, SlotProgram_t pxProgram);
+bool xSlotCommit(const Slot_t *pxSlot, uint32_t ulVersion, uint32_t ulLength, uint32_t ulChkSum, uint8_t ucChkAlg, SlotProgram_t pxProgram);
+bool xSlotBootAttempt(const Slot_t *pxSlot, SlotProgram_t pxProgram);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SLOT_H */
@@ -0,0 +1,75 @@
+#ifndef __SPL_H
+#define __SPL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Serial Protocol Layer (SPL)
+ * ---------------------------------------------------------------------------------------
+ * | [preamble] | [payload size] | [payload]                       | [check sum]         |
+ * |   2 bytes  |    2 bytes     | [cmd 2] [seq 2] [data n]        |   2 bytes           |
+ * ---------------------------------------------------------------------------------------
+ * all fields are little endian, check sum is CRC16 over [payload size] + [payload]
+ **/
+
+#define SPL_PREAMBLE        0xA55A
+#define SPL_HDR_SIZE        4       // cmd + seq
+#define SPL_DATA_MAX_SIZE   1024    // max data bytes of one frame (= max segment size)
+#define SPL_WINDOW_MAX      8       // max outstanding segments
+
+// Window control, sent by the receiver of a segment stream
+#define SPL_CMD_ACK         0x00A0  // seq = next expected segment, data = [window 1]
+#define SPL_CMD_NAK         0x00A1  // seq = segment to retransmit
+
+#define SPL_TIMEOUT         1000    // ms, a single frame
+#define SPL_RETRY_MAX       5
+
+typedef struct {
+    // write all bytes, return false on link error, the buffer is free on return
+    bool (*pxWrite)(const uint8_t *pucBuf, uint32_t ulLen);
+    // non-blocking, copy up to ulLen received bytes, return count
+    uint32_t (*pxRead)(uint8_t *pucBuf, uint32_t ulLen);
+    // free running millisecond tick
+    uint32_t (*pxGetTick)(void);
+    // wait until written bytes are out, NULL if pxWrite() returns only then
+    bool (*pxFlush)(void);
+} SplPort_t;
+
+typedef struct {
+    uint16_t usCmd;
+    uint16_t usSeq;
+    uint16_t usLen;         // length of pucData
+    uint8_t *pucData;       // valid until next xSplRecv()
+} SplFrame_t;
+
+// Called for every segment in sequence order, return false to abort the transfer
+typedef bool (*SplSegmentCb_t)(uint16_t usSeq, const uint8_t *pucData, uint16_t usLen, void *pvCtx);
+
+void vSplInit(const SplPort_t *pxPort);
+// Called while xSplRecv() waits for bytes, must return quickly
+void vSplSetIdleHook(void (*pxIdle)(void));
+bool xSplSend(uint16_t usCmd, uint16_t usSeq, const void *pvData, uint16_t usLen);
+// Before the link goes away (reset), what xSplSend() wrote reaches the host
+bool xSplFlush(void);
+bool xSplRecv(SplFrame_t *pxFrame, uint32_t ulTimeout);
+bool xSplRequest(uint16_t usCmd, const void *pvReq, uint16_t usReqLen, SplFrame_t *pxRsp);
+// Receive segments [usFirst, usSegCount), the first ACK tells the sender where to start
+bool xSplWindowRecv(uint16_t usCmd, uint16_t usFirst, uint16_t usSegCount, uint8_t ucWindow, SplSegmentCb_t pxOnSegment, void *pvCtx);
+
+// Transports, return NULL if the link can not be brought up
+const SplPort_t *pxSplUartInit(void);
+// USB CDC, NULL unless a host enumerates the device and opens the port. The same device
+// has a DfuSe interface on [ulDfuBase, ulDfuBase + ulDfuSize) for dfu-util
+const SplPort_t *pxSplUsbInit(uint32_t ulDfuBase, uint32_t ulDfuSize);
+// dfu-util wrote an image there and left, the last pxSplUsbInit() returned NULL for it
+bool xSplUsbDfuStaged(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SPL_H */
@@ -0,0 +1,69 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Boot trace, DWT cycle stamps in NOINIT SRAM right below the BCB
+ * ---------------------------------------------------------------------------------------
+ * | [magic 4] [boot 4] [head 4] [reserved 4] | [cycles 4] [phase 1] [MHz 1] [arg 2] x 60 |
+ * ---------------------------------------------------------------------------------------
+ * ^ TRACE_BASE                                                                  BCB ^
+ *
+ * A mark stamps the end of a phase, the cycle counter starts at 0 in main() on every
+ * boot. Entries are a ring over boots, head counts all marks ever written, entry
+ * head % TRACE_ENTRIES is the next one. MHz is the core clock at the mark, the cycles
+ * since the mark before ran at the clock of that one. The application reads the block
+ * after boot (its own RAM must leave it out), tools/bootrace.py decodes a dump.
+ **/
+
+#define TRACE_BASE          0x2001FE00
+#define TRACE_SIZE          0x000001F8
+#define TRACE_MAGIC         0x43525442  // "BTRC"
+#define TRACE_ENTRIES       60
+
+typedef enum {
+    TRACE_RESET = 1,        // main(), arg = boot number
+    TRACE_HAL_INIT,
+    TRACE_CLOCK_CONFIG,     // SystemClock_Config()
+    TRACE_GPIO_INIT,
+    TRACE_CLOCK_FAST,       // arg = 1 PLL locked
+    TRACE_CHKSUM_INIT,
+    TRACE_SLOT_SELECT,      // arg = boot slot, 0xFFFF none
+    TRACE_DFU_START,        // arg = 1 host attached
+    TRACE_DFU_ERASE,
+    TRACE_DFU_DOWNLOAD,     // arg = 1 ok
+    TRACE_DFU_COMMIT,
+    TRACE_DFU_DONE,         // arg = 1 ok
+    TRACE_BOOT_ATTEMPT,
+    TRACE_CLOCK_RESET,
+    TRACE_JUMP,
+} TracePhase_t;
+
+typedef struct {
+    uint32_t ulCycles;
+    uint8_t ucPhase;
+    uint8_t ucMHz;
+    uint16_t usArg;
+} TraceEntry_t;
+
+typedef struct {
+    uint32_t ulMagic;
+    uint32_t ulBoot;
+    uint32_t ulHead;
+    uint32_t ulReserved;
+    TraceEntry_t xEntry[TRACE_ENTRIES];
+} Trace_t;
+
+// Start the cycle counter and the trace of this boot, first thing in main()
+void vTraceInit(void);
+void vTraceMark(TracePhase_t xPhase, uint16_t usArg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TRACE_H */
@@ -0,0 +1,23 @@
+#ifndef __USBD_COMPOSITE_H
+#define __USBD_COMPOSITE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "usbd_def.h"
+
+/* One configuration, the CDC-ACM function (interfaces 0 and 1 behind an IAD) for SPL
+ * and the DfuSe interface (USBD_DFU_INTERFACE) for dfu-util. The class drivers run
+ * unchanged, USBD_Composite hands every callback to the one that owns it.
+ **/
+
+#define USBD_COMPOSITE_CONFIG_DESC_SIZ  93
+
+extern USBD_ClassTypeDef USBD_Composite;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_COMPOSITE_H */
@@ -0,0 +1,77 @@
+#ifndef __USBD_CONF_H
+#define __USBD_CONF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+/* STM32_USB_Device_Library configuration, CDC and DFU functions of one composite device
+ * (usbd_composite.c) on the OTG FS core
+ *
+ * usbd_conf.c is the low level side on the HAL PCD driver, usbd_conf_posix.c the host
+ * stand-in built with -DUSBD_POSIX: it plays the USB host and carries the bulk data on
+ * stdin / stdout, so spl_usb.c and the stack run unchanged against tools/dfu_sim.py.
+ **/
+
+#ifndef USBD_POSIX
+#include "stm32f4xx_hal.h"
+#else
+// What the stack and spl_usb.c take from the HAL
+#define __IO                volatile
+#define __STATIC_INLINE     static inline
+#define UNUSED(X)           (void)(X)
+#define UID_BASE            0x1FFF7A10UL
+#define OTG_FS_IRQn         67
+
+typedef struct {
+    uint32_t maxpacket;
+} PCD_EPTypeDef;
+
+typedef struct {
+    PCD_EPTypeDef IN_ep[16];
+    PCD_EPTypeDef OUT_ep[16];
+} PCD_HandleTypeDef;
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t ulDelay);
+#define HAL_NVIC_EnableIRQ(IRQn)    ((void)(IRQn))
+#define HAL_NVIC_DisableIRQ(IRQn)   ((void)(IRQn))
+#endif
+
+#define USBD_MAX_NUM_INTERFACES         3U      // CDC control, CDC data, DFU
+#define USBD_MAX_NUM_CONFIGURATION      1U
+#define USBD_MAX_STR_DESC_SIZ           128U    // the DfuSe layout string of slot A is 86 bytes
+#define USBD_SUPPORT_USER_STRING_DESC   1U      // DFU alternate setting string
+#define USBD_SELF_POWERED               1U
+#define USBD_DEBUG_LEVEL                0U
+#define USBD_LPM_ENABLED                0U
+
+#define DEVICE_FS                       0
+
+// OTG FS only, the CDC buffers hold 64 byte packets
+#define USBD_CDC_HS_ENABLED             0U
+
+// DFU behind the CDC interfaces, a 2KB block is 32 EP0 packets
+#define USBD_DFU_INTERFACE              2U
+#define USBD_DFU_XFER_SIZE              2048U
+#define USBD_DFU_BLOCK_COUNT            2U
+
+// No heap, class data lives in the arenas the application registers (USBD_xxx_RegisterArena())
+#define USBD_malloc(size)   NULL
+#define USBD_free(p)        ((void)(p))
+#define USBD_memset         memset
+#define USBD_memcpy         memcpy
+#define USBD_Delay          HAL_Delay
+
+#define USBD_UsrLog(...)    do {} while (0)
+#define USBD_ErrLog(...)    do {} while (0)
+#define USBD_DbgLog(...)    do {} while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_CONF_H */
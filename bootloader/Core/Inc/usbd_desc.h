@@ -0,0 +1,20 @@
+#ifndef __USBD_DESC_H
+#define __USBD_DESC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "usbd_def.h"
+
+/* Device and string descriptors of the CDC function, the serial number string is the
+ * 96-bit unique ID, so a host tool can tell two boards in DFU apart.
+ **/
+
+extern USBD_DescriptorsTypeDef FS_Desc;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_DESC_H */
@@ -0,0 +1,22 @@
+#ifndef __USBD_DFU_IF_H
+#define __USBD_DFU_IF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "usbd_dfu.h"
+
+/* DFU media on the internal flash, one memory [ulBase, ulBase + ulSize) of whole
+ * sectors, the update slot. dfu-util erases and programs it through flash_if.c and
+ * reads it back, the slot trailer stays for the bootloader to write.
+ **/
+
+// NULL unless the memory starts and ends on a sector boundary
+USBD_DFU_MediaTypeDef *pxDfuIfInit(uint32_t ulBase, uint32_t ulSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_DFU_IF_H */
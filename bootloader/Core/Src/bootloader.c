@@ -1,40 +1,39 @@
-#include "main.h"
-#include "stm32f412rx.h"
-#include "cmsis_armcc.h"
+#include "checksum.h"
+#include "clock.h"
+#include "flash_if.h"
+#include "journal.h"
+#include "delta.h"
+#include "lz4_stream.h"
+#include "platform.h"
+#include "slot.h"
+#include "spl.h"
+#include "trace.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
 /* Flash & Sram layout
  * ---------------------------------------------------------------------------------------
- * | Bootloader    |  64KB | 0x08000000 ~ 0x0800FFFF   | use Flash sector 0, 1, 2, 3    |
- * | DFU		   | 192KB | 0x08010000 ~ 0x0803FFFF   | use Flash sector 4, 5          |
- * | Applicartion  | 256KB | 0x08040000 ~ 0x0807FFFF   | use Flash sector 6, 7			| 
- * | BCB Magic     |   8 B | 0x2001FFF8 ~ 0x2001FFFF   | use on-chip SRAM				|
+ * | Bootloader    |  16KB | 0x08000000 ~ 0x08003FFF   | use Flash sector 0             |
+ * | DFU journal   |  16KB | 0x08004000 ~ 0x08007FFF   | use Flash sector 1, journal.h  |
+ * | Bootloader    |  32KB | 0x08008000 ~ 0x0800FFFF   | use Flash sector 2, 3          |
+ * | Slot A (DFU)  | 192KB | 0x08010000 ~ 0x0803FFFF   | use Flash sector 4, 5          |
+ * | Slot B (APP)  | 256KB | 0x08040000 ~ 0x0807FFFF   | use Flash sector 6, 7			| 
+ * | Boot trace    | 504 B | 0x2001FE00 ~ 0x2001FFF7   | use on-chip SRAM, see trace.h  |
+ * | BCB Magic     |   8 B | 0x2001FFF8 ~ 0x2001FFFF   | use on-chip SRAM, platform.h   |
  * ---------------------------------------------------------------------------------------
+ * Both slots hold a bootable image with a trailer (see slot.h), the newest valid one
+ * is booted in place, an update goes to the other slot.
+ * The bootloader is linked around the journal (IROM1/IROM2 in Keil, bootloader.sct
+ * in VisualGDB), the link fails when it no longer fits in 48KB.
  **/
 
-#define MY_SIGNATURE        0xF1517A66
-#define APP_SIGNATURE_BASE  (APP_BASE + 0x20)
-#define APP_SIGNATURE_SIZE  0x00000004
-#define APP_SIGNATURE_VALUE MY_SIGNATURE
-
 // DFU & APP 
 #define DFU_BASE		    0x08010000
 #define DFU_MAX_SIZE	    0x00030000
 
 #define APP_BASE		    0x08040000
-#define APP_MAX_SIZE	    0x00030000
-
-// Boot Ctrl Block (BCB)
-#define BCB_MAGIC_BASE	0x2001FFF8
-#define BCB_MAGIC_SIZE	0x00000004
-#define BCB_LEN_BASE	0x2001FFFC
-#define BCB_LEN_SIZE	0x00000002
-#define BCB_CRC16_BASE	0x2001FFFE
-#define BCB_CRC16_SIZE	0x00000002
-
-#define DFU_MAGIC_VALUE 0x12345678
+#define APP_MAX_SIZE	    0x00040000
 
 // Utility
 #define COUNTOF(x)  (sizeof(x)/sizeof(x[0]))
@@ -47,175 +46,596 @@
 #define DFU_SEG_DATA_REQ    0x0003
 #define DFU_SEG_CHKSUM_REQ  0x0004
 #define DFU_WAIT_REQ        0x0005
+#define DFU_VERSION_REQ     0x0006
 #define DFU_ABORD_REQ       0x00EE
 #define DFU_CPLT_REQ        0x00FF
 
+// Image format on the wire, DFU_SIZE_REQ
+#define DFU_FORMAT_RAW      0x00
+#define DFU_FORMAT_LZ4      0x01    // one LZ4 block, decompressed straight into the slot
+#define DFU_FORMAT_DELTA    0x02    // patch against the booted slot, see delta.h
+
+// Segment transfer, proposed to the host by DFU_START_REQ
+#define DFU_SEG_SIZE        SPL_DATA_MAX_SIZE
+#define DFU_WINDOW          4
+
+static const Slot_t xSlots[] = {
+    { DFU_BASE, DFU_MAX_SIZE },     // A
+    { APP_BASE, APP_MAX_SIZE },     // B
+};
+
+typedef struct {
+    uint32_t ulSector;
+    uint32_t ulBase;
+    uint32_t ulSize;
+} FlashSector_t;
+
+#define JOURNAL_SECTOR      1
+
+static const FlashSector_t xSlotSectors[] = {
+    { 4, 0x08010000, 0x00010000 },
+    { 5, 0x08020000, 0x00020000 },
+    { 6, 0x08040000, 0x00020000 },
+    { 7, 0x08060000, 0x00020000 },
+};
+
+typedef struct {
+    uint32_t ulSize;        // image
+    uint32_t ulChkSum;      // image
+    uint32_t ulStreamSize;  // bytes on the wire
+    uint8_t ucFormat;
+    uint8_t ucChkAlg;
+} DfuImage_t;
+
+static uint16_t usDfuSegSize;
+static uint8_t ucDfuWindow;
 
-static uint32_t prvDfuSizeReq(void) {    
-    uint16_t dfu_size = *(uint16_t *)BCB_LEN_BASE;
+static uint32_t prvBcbSize(void) {    
+    uint16_t dfu_size = pxPlatBcb()->usLen;
     return dfu_size;
 }
 
-static uint32_t prvDfuChkSumReq(void) {
-    uint16_t dfu_chksum = *(uint16_t *)BCB_CRC16_BASE;
+static uint32_t prvBcbChkSum(void) {
+    uint16_t dfu_chksum = pxPlatBcb()->usChkSum;
     return dfu_chksum;
 }
 
-static uint32_t prvDfuChkSumCal(void *pvDst, uint32_t ulSize) {
-    extern unsigned int CRC16(unsigned char * pucFrame, unsigned int usLen);
-    uint16_t chk_sum = CRC16(pvDst, ulSize);
-    return chk_sum;
-}
-
-static bool prvFlashProgram(void *pvDst, void *pvSrc, uint32_t ulSize) {
-    uint32_t *pulDest = pvDst;
-    uint32_t *pulSrc = pvSrc;
-    uint32_t cnt = ulSize / sizeof(*pulSrc);
-
-    /* Program word (32-bit) at a specified address */
-    for (int i = 0; i < cnt; i++) {
-        HAL_FLASH_Unlock();
-        CLEAR_BIT(FLASH->CR, FLASH_CR_PSIZE);
-        FLASH->CR |= FLASH_PSIZE_WORD;
-        FLASH->CR |= FLASH_CR_PG;
-        *pulDest = *pulSrc;
-        /* Wait for last operation to be completed */
-        HAL_StatusTypeDef status = FLASH_WaitForLastOperation(5000);
-        /* If the program operation is completed, disable the PG Bit */
-        FLASH->CR &= (~FLASH_CR_PG);
-        HAL_FLASH_Lock();
-        pulDest++;
-        pulSrc++;
-        if (status != HAL_OK) {
+static bool prvDfuStartReq(const Slot_t *pxSlot) {
+    // USB when a host has the port open, the UART otherwise. An image dfu-util put in
+    // the slot is installed like one the application staged
+    const SplPort_t *pxPort = pxSplUsbInit(pxSlot->ulBase, pxSlot->ulSize);
+    if (pxPort == NULL && xSplUsbDfuStaged()) {
+        return false;
+    }
+    if (pxPort == NULL) {
+        pxPort = pxSplUartInit();
+    }
+    if (pxPort == NULL) {
+        return false;
+    }
+    vSplInit(pxPort);
+
+    // propose [seg size 2] [window 1] [slot base 4], host answers with the seg size
+    // and window it accepts, and must send an image linked for the slot base
+    uint8_t req[7] = {
+        (uint8_t)DFU_SEG_SIZE, (uint8_t)(DFU_SEG_SIZE >> 8), DFU_WINDOW,
+        (uint8_t)pxSlot->ulBase, (uint8_t)(pxSlot->ulBase >> 8),
+        (uint8_t)(pxSlot->ulBase >> 16), (uint8_t)(pxSlot->ulBase >> 24),
+    };
+    SplFrame_t rsp;
+    if (xSplRequest(DFU_START_REQ, req, sizeof(req), &rsp) == false || rsp.usLen < 3) {
+        return false;
+    }
+    usDfuSegSize = rsp.pucData[0] | (rsp.pucData[1] << 8);
+    ucDfuWindow = rsp.pucData[2];
+    if (usDfuSegSize == 0 || usDfuSegSize > DFU_SEG_SIZE || (usDfuSegSize % sizeof(uint32_t)) != 0) {
+        return false;
+    }
+    if (ucDfuWindow < 2 || ucDfuWindow > DFU_WINDOW) {
+        return false;
+    }
+    return true;
+}
+
+static uint32_t prvGet32(const uint8_t *pucBuf) {
+    return pucBuf[0] | (pucBuf[1] << 8) | (pucBuf[2] << 16) | ((uint32_t)pucBuf[3] << 24);
+}
+
+static void prvPut32(uint8_t *pucBuf, uint32_t ulVal) {
+    pucBuf[0] = (uint8_t)ulVal;
+    pucBuf[1] = (uint8_t)(ulVal >> 8);
+    pucBuf[2] = (uint8_t)(ulVal >> 16);
+    pucBuf[3] = (uint8_t)(ulVal >> 24);
+}
+
+// [image size 4] or [image size 4] [stream size 4] [format 1]
+static bool prvDfuSizeReq(DfuImage_t *pxImage) {
+    SplFrame_t rsp;
+    if (xSplRequest(DFU_SIZE_REQ, NULL, 0, &rsp) == false || rsp.usLen < 4) {
+        return false;
+    }
+    pxImage->ulSize = prvGet32(&rsp.pucData[0]);
+    pxImage->ulStreamSize = pxImage->ulSize;
+    pxImage->ucFormat = DFU_FORMAT_RAW;
+    if (rsp.usLen >= 9) {
+        pxImage->ulStreamSize = prvGet32(&rsp.pucData[4]);
+        pxImage->ucFormat = rsp.pucData[8];
+    }
+    return true;
+}
+
+// [CRC16 2] or [chksum 4] [algorithm 1]
+static bool prvDfuChkSumReq(DfuImage_t *pxImage) {
+    SplFrame_t rsp;
+    if (xSplRequest(DFU_CHKSUM_REQ, NULL, 0, &rsp) == false || rsp.usLen < 2) {
+        return false;
+    }
+    pxImage->ulChkSum = rsp.pucData[0] | (rsp.pucData[1] << 8);
+    pxImage->ucChkAlg = CHK_ALG_CRC16;
+    if (rsp.usLen >= 5) {
+        pxImage->ulChkSum = prvGet32(&rsp.pucData[0]);
+        pxImage->ucChkAlg = rsp.pucData[4];
+    }
+    return xChkSumAlgValid(pxImage->ucChkAlg);
+}
+
+static bool prvDfuVersionReq(uint32_t *pulVersion) {
+    SplFrame_t rsp;
+    if (xSplRequest(DFU_VERSION_REQ, NULL, 0, &rsp) == false || rsp.usLen < 4) {
+        return false;
+    }
+    *pulVersion = prvGet32(rsp.pucData);
+    return true;
+}
+
+/* Receive-while-programming pipeline
+ * image bytes are collected in two RAM buffers: buffer K is programmed a burst at a
+ * time from the SPL idle hook while buffer K + 1 fills with the next segment.
+ * Each buffer gets its own checksum when it is full, combined into the image checksum
+ * right away, and is compared word by word with the flash once it is programmed, a bad
+ * range is programmed once more, so the slot is verified while the download runs.
+ * A compressed stream is decoded straight into the buffers, back references are read
+ * from the buffers or from the part of the slot already programmed.
+ * A delta patch reads the booted slot as its source and writes the other one.
+ * Raw images log every programmed buffer to the journal, so a download cut by a
+ * power loss resumes from the last logged buffer instead of from the start.
+ **/
+#define DFU_PIPE_DEPTH      2
+#define DFU_PIPE_BURST      16      // words programmed per idle call
+
+typedef struct {
+    uint32_t ulBuf[DFU_PIPE_DEPTH][DFU_SEG_SIZE / sizeof(uint32_t)];
+    uint32_t ulAddr[DFU_PIPE_DEPTH];
+    uint16_t usLen[DFU_PIPE_DEPTH];
+    uint16_t usDone[DFU_PIPE_DEPTH];
+    uint32_t ulImgCrc[DFU_PIPE_DEPTH];  // image checksum up to the end of the buffer
+    uint8_t ucHead;         // buffer being filled
+    uint8_t ucTail;         // buffer being programmed
+    uint8_t ucCount;        // full buffers waiting for flash
+    bool xFilling;          // ucHead holds data
+    bool xError;
+    bool xJournal;          // log progress
+    uint32_t ulBase;        // target slot
+    uint32_t ulSize;        // whole image
+    uint32_t ulWritten;     // image bytes accepted
+    uint32_t ulStreamSize;  // bytes on the wire
+    uint8_t ucFormat;
+    uint8_t ucChkAlg;
+    uint32_t ulChkSum;      // running checksum of the image
+    uint32_t ulSrcBase;     // delta source, the booted slot
+    uint32_t ulBadAddr;     // first byte that would not program, 0 if none
+    Lz4Stream_t xLz4;
+    Delta_t xDelta;
+} DfuPipe_t;
+
+static DfuPipe_t xDfuPipe;
+
+static bool prvDfuPipePump(uint32_t ulWords) {
+    DfuPipe_t *pipe = &xDfuPipe;
+    if (pipe->ucCount == 0 || pipe->xError) {
+        return pipe->xError == false;
+    }
+    uint8_t idx = pipe->ucTail;
+    uint32_t done = pipe->usDone[idx];
+    uint32_t size = MIN(pipe->usLen[idx] - done, ulWords * sizeof(uint32_t));
+    if (xFlashIfWrite(pipe->ulAddr[idx] + done, (uint8_t *)pipe->ulBuf[idx] + done, size) == false) {
+        pipe->xError = true;
+        return false;
+    }
+    pipe->usDone[idx] += size;
+    if (pipe->usDone[idx] == pipe->usLen[idx]) {
+        // read back, only verified buffers go into the journal
+        if (xFlashIfVerify(pipe->ulAddr[idx], pipe->ulBuf[idx], pipe->usLen[idx], &pipe->ulBadAddr) == false) {
+            pipe->xError = true;
             return false;
         }
+        if (pipe->xJournal) {
+            // journal full only costs the resume point
+            xJournalRecord(pipe->ulAddr[idx] + pipe->usLen[idx] - pipe->ulBase, pipe->ulImgCrc[idx], xFlashIfWrite);
+        }
+        pipe->ucTail = (idx + 1) % DFU_PIPE_DEPTH;
+        pipe->ucCount--;
     }
+    return true;
+}
+
+static void prvDfuPipeIdle(void) {
+    prvDfuPipePump(DFU_PIPE_BURST);
+}
 
-    uint8_t *pucDest = (uint8_t *)pulDest;
-    uint8_t *pucSrc = (uint8_t *)pulSrc;
-    cnt = ulSize % sizeof(*pulSrc);
-
-    /* Program byte (8-bit) at a specified address */
-    for (int i = 0; i < cnt; i++) {
-        HAL_FLASH_Unlock();
-        CLEAR_BIT(FLASH->CR, FLASH_CR_PSIZE);
-        FLASH->CR |= FLASH_PSIZE_BYTE;
-        FLASH->CR |= FLASH_CR_PG;
-        *pucDest = *pucSrc;
-        /* Wait for last operation to be completed */
-        HAL_StatusTypeDef status = FLASH_WaitForLastOperation(5000);
-        /* If the program operation is completed, disable the PG Bit */
-        FLASH->CR &= (~FLASH_CR_PG);
-        HAL_FLASH_Lock();
-        pucDest++;
-        pucSrc++;
-        if (status != HAL_OK) {
+static void prvDfuPipeCommit(DfuPipe_t *pipe) {
+    if (pipe->xFilling == false) {
+        return;
+    }
+    uint8_t idx = pipe->ucHead;
+    uint32_t seg_crc = ulChkSumCalc(pipe->ucChkAlg, pipe->ulBuf[idx], pipe->usLen[idx]);
+    pipe->ulChkSum = ulChkSumCombine(pipe->ucChkAlg, pipe->ulChkSum, seg_crc, pipe->usLen[idx]);
+    pipe->ulImgCrc[idx] = pipe->ulChkSum;
+    pipe->ucHead = (idx + 1) % DFU_PIPE_DEPTH;
+    pipe->ucCount++;
+    pipe->xFilling = false;
+}
+
+static bool prvDfuPipeDrain(void) {
+    prvDfuPipeCommit(&xDfuPipe);
+    while (xDfuPipe.ucCount) {
+        if (prvDfuPipePump(DFU_SEG_SIZE / sizeof(uint32_t)) == false) {
             return false;
         }
     }
-    
+    return xDfuPipe.xError == false;
+}
+
+static bool prvDfuPipeWrite(DfuPipe_t *pipe, const uint8_t *pucData, uint32_t ulLen) {
+    if (pipe->xError || pipe->ulWritten + ulLen > pipe->ulSize) {
+        return false;
+    }
+    while (ulLen) {
+        if (pipe->xFilling == false) {
+            // both buffers busy, finish the older one first
+            while (pipe->ucCount == DFU_PIPE_DEPTH) {
+                if (prvDfuPipePump(DFU_SEG_SIZE / sizeof(uint32_t)) == false) {
+                    return false;
+                }
+            }
+            pipe->ulAddr[pipe->ucHead] = pipe->ulBase + pipe->ulWritten;
+            pipe->usLen[pipe->ucHead] = 0;
+            pipe->usDone[pipe->ucHead] = 0;
+            pipe->xFilling = true;
+        }
+        uint8_t idx = pipe->ucHead;
+        uint32_t len = MIN(ulLen, (uint32_t)DFU_SEG_SIZE - pipe->usLen[idx]);
+        memcpy((uint8_t *)pipe->ulBuf[idx] + pipe->usLen[idx], pucData, len);
+        pipe->usLen[idx] += len;
+        pipe->ulWritten += len;
+        pucData += len;
+        ulLen -= len;
+        if (pipe->usLen[idx] == DFU_SEG_SIZE) {
+            prvDfuPipeCommit(pipe);
+        }
+    }
     return true;
 }
 
-static bool prvAppFlashErase(void) {
-    #define FLASH_TIMEOUT 5000
-    const uint32_t app_sectors[] = { 6, 7 };
-    bool ret = false;
-    HAL_FLASH_Unlock();
-    for (int i = 0; i < COUNTOF(app_sectors); i++) {
-        FLASH_Erase_Sector(app_sectors[i], FLASH_VOLTAGE_RANGE_3);
-        HAL_StatusTypeDef status = FLASH_WaitForLastOperation(FLASH_TIMEOUT);
-        if (status != HAL_OK) {
-            goto __EXIT;
+static bool prvDfuPipePut(uint8_t ucByte, void *pvCtx) {
+    return prvDfuPipeWrite(pvCtx, &ucByte, 1);
+}
+
+static uint8_t prvDfuPipeGet(uint32_t ulDist, void *pvCtx) {
+    DfuPipe_t *pipe = pvCtx;
+    uint32_t addr = pipe->ulBase + pipe->ulWritten - ulDist;
+    for (int i = 0; i < DFU_PIPE_DEPTH; i++) {
+        bool queued = ((i - pipe->ucTail + DFU_PIPE_DEPTH) % DFU_PIPE_DEPTH) < pipe->ucCount;
+        bool filling = pipe->xFilling && i == pipe->ucHead;
+        if ((queued || filling) && addr >= pipe->ulAddr[i] && addr < pipe->ulAddr[i] + pipe->usLen[i]) {
+            return ((uint8_t *)pipe->ulBuf[i])[addr - pipe->ulAddr[i]];
         }
     }
-    ret = true;
-__EXIT:
-    HAL_FLASH_Lock();  
-    
-    return ret;
+    // already programmed
+    return *(uint8_t *)addr;
 }
 
-static void prvDfuMode(void) {
-	// get size of dfu image
-    uint32_t dfu_size = prvDfuSizeReq();
-    if (dfu_size < 448 || dfu_size > DFU_MAX_SIZE) {
-        return;
-    }        
-	// get checksum of dfu image
-    uint32_t dfu_chksum = prvDfuChkSumReq();
-    if (dfu_chksum == 0) {
-        return;
+static uint8_t prvDfuPipeSrc(uint32_t ulOffset, void *pvCtx) {
+    DfuPipe_t *pipe = pvCtx;
+    return *(uint8_t *)(pipe->ulSrcBase + ulOffset);
+}
+
+static bool prvDfuSegReceived(uint16_t usSeq, const uint8_t *pucData, uint16_t usLen, void *pvCtx) {
+    DfuPipe_t *pipe = pvCtx;
+    uint32_t offset = (uint32_t)usSeq * usDfuSegSize;
+    if (offset + usLen > pipe->ulStreamSize || (usLen != usDfuSegSize && offset + usLen != pipe->ulStreamSize)) {
+        return false;
     }
-	// check whole dfu image
-    if (prvDfuChkSumCal((void *)DFU_BASE, dfu_size) != dfu_chksum) {
-        return;
+    if (pipe->ucFormat == DFU_FORMAT_LZ4) {
+        return xLz4StreamFeed(&pipe->xLz4, pucData, usLen) && pipe->xError == false;
     }
-	// erase application
-    if (prvAppFlashErase() == false) {
-        return;
+    if (pipe->ucFormat == DFU_FORMAT_DELTA) {
+        return xDeltaFeed(&pipe->xDelta, pucData, usLen) && pipe->xError == false;
     }
-	// copy dfu image to application
-    if (prvFlashProgram((void *)APP_BASE, (void *)DFU_BASE, dfu_size) == false) {
-        return;
+    if (offset < pipe->ulWritten) {
+        // resumed, the head of this segment is already in flash
+        uint32_t skip = MIN(pipe->ulWritten - offset, usLen);
+        pucData += skip;
+        usLen -= skip;
+    }
+    return prvDfuPipeWrite(pipe, pucData, usLen);
+}
+
+// Raw images may start at ulDone, the bytes before it are in flash and sum up to ulDoneChkSum
+static bool prvDfuSegDataReq(const Slot_t *pxSlot, const Slot_t *pxSource, const DfuImage_t *pxImage,
+                             uint32_t ulDone, uint32_t ulDoneChkSum, uint32_t *pulChkSum) {
+    uint32_t stream_size = pxImage->ulStreamSize;
+    uint8_t format = pxImage->ucFormat;
+    uint32_t seg_cnt = (stream_size + usDfuSegSize - 1) / usDfuSegSize;
+    if (stream_size == 0 || seg_cnt > UINT16_MAX) {
+        return false;
+    }
+    if (format != DFU_FORMAT_RAW && format != DFU_FORMAT_LZ4 && format != DFU_FORMAT_DELTA) {
+        return false;
     }
-	// compare dfu image vs application
-    for (int i = 0; i < dfu_size; i++) {
-        if (((uint8_t *)APP_BASE)[i] != ((uint8_t *)DFU_BASE)[i]) {
-			return;
+    // a patch needs a committed source, its trailer names the exact image
+    if (format == DFU_FORMAT_DELTA && (pxSource == NULL || pxSlotHeader(pxSource)->ulMagic != IMG_MAGIC)) {
+        return false;
+    }
+    memset(&xDfuPipe, 0, sizeof(xDfuPipe));
+    xDfuPipe.ulBase = pxSlot->ulBase;
+    xDfuPipe.ulSize = pxImage->ulSize;
+    xDfuPipe.ulStreamSize = stream_size;
+    xDfuPipe.ucFormat = format;
+    xDfuPipe.ucChkAlg = pxImage->ucChkAlg;
+    xDfuPipe.ulChkSum = ulChkSumFinal(pxImage->ucChkAlg, ulChkSumInit(pxImage->ucChkAlg));
+    if (format == DFU_FORMAT_RAW) {
+        xDfuPipe.xJournal = true;
+        xDfuPipe.ulWritten = ulDone;
+        xDfuPipe.ulChkSum = ulDoneChkSum;
+    }
+    vLz4StreamInit(&xDfuPipe.xLz4, prvDfuPipePut, prvDfuPipeGet, &xDfuPipe);
+    if (format == DFU_FORMAT_DELTA) {
+        const ImageHeader_t *src = pxSlotHeader(pxSource);
+        xDfuPipe.ulSrcBase = pxSource->ulBase;
+        vDeltaInit(&xDfuPipe.xDelta, src->ulLength, src->ulChkSum, prvDfuPipePut, prvDfuPipeSrc, &xDfuPipe);
+    }
+
+    // slot stays unlocked for the whole download
+    if (xFlashIfBegin() == false) {
+        return false;
+    }
+    vSplSetIdleHook(prvDfuPipeIdle);
+    bool ret = xSplWindowRecv(DFU_SEG_DATA_REQ, xDfuPipe.ulWritten / usDfuSegSize, seg_cnt, ucDfuWindow, prvDfuSegReceived, &xDfuPipe);
+    vSplSetIdleHook(NULL);
+    ret = ret && prvDfuPipeDrain();
+    if (xFlashIfEnd() == false || ret == false) {
+        return false;
+    }
+    if (format == DFU_FORMAT_LZ4 && xLz4StreamIsDone(&xDfuPipe.xLz4) == false) {
+        return false;
+    }
+    if (format == DFU_FORMAT_DELTA && xDeltaIsDone(&xDfuPipe.xDelta) == false) {
+        return false;
+    }
+    if (xDfuPipe.ulWritten != pxImage->ulSize) {
+        return false;
+    }
+    *pulChkSum = xDfuPipe.ulChkSum;
+    return true;
+}
+
+// Abort carries the first address that would not program, if that was the cause
+static void prvDfuCpltReq(bool xSuccess) {
+    uint8_t data[5] = { 0 };
+    uint16_t len = 1;
+    if (xSuccess == false) {
+        data[0] = 1;
+        if (xDfuPipe.ulBadAddr) {
+            data[0] = 2;
+            prvPut32(&data[1], xDfuPipe.ulBadAddr);
+            len = 5;
+        }
+    }
+    // the reset follows, the host must have it first
+    if (xSplSend(xSuccess ? DFU_CPLT_REQ : DFU_ABORD_REQ, 0, data, len)) {
+        xSplFlush();
+    }
+}
+
+static uint32_t prvDfuChkSumCal(uint8_t ucAlg, void *pvDst, uint32_t ulSize) {
+    return ulChkSumCalc(ucAlg, pvDst, ulSize);
+}
+
+static bool prvFlashProgram(uint32_t ulAddr, const void *pvSrc, uint32_t ulSize) {
+    if (xFlashIfBegin() == false) {
+        return false;
+    }
+    bool ret = xFlashIfWrite(ulAddr, pvSrc, ulSize);
+    return xFlashIfEnd() && ret;
+}
+
+static bool prvFlashIsBlank(uint32_t ulAddr, uint32_t ulSize) {
+    for (uint32_t off = 0; off < ulSize; off += sizeof(uint32_t)) {
+        if (*(uint32_t *)(ulAddr + off) != 0xFFFFFFFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Erase the sectors an image of ulSize spans, blank sectors are skipped. The old trailer
+// is retired first, its sector is only erased when no blank trailer is left. Sectors go
+// in address order, the vector table is gone before the trailer sector is touched
+static bool prvSlotErase(const Slot_t *pxSlot, uint32_t ulSize) {
+    uint32_t trailer = (uint32_t)pxSlotHeader(pxSlot);
+    bool trailer_full = xSlotRetire(pxSlot, prvFlashProgram) == false;
+    for (uint32_t i = 0; i < COUNTOF(xSlotSectors); i++) {
+        const FlashSector_t *sector = &xSlotSectors[i];
+        uint32_t end = sector->ulBase + sector->ulSize;
+        if (sector->ulBase < pxSlot->ulBase || end > pxSlot->ulBase + pxSlot->ulSize) {
+            continue;
+        }
+        bool spanned = sector->ulBase < pxSlot->ulBase + ulSize;
+        bool has_trailer = trailer >= sector->ulBase && trailer < end;
+        if ((spanned || (has_trailer && trailer_full)) && prvFlashIsBlank(sector->ulBase, sector->ulSize) == false) {
+            if (xFlashIfErase(sector->ulSector) == false) {
+                return false;
+            }
+        }
+    }
+    // the blank check pulled erased lines into the data cache, the read back must miss
+    vPlatFlashFlush();
+    return true;
+}
+
+// Drop the session of an older download, before the slot it describes is erased
+static bool prvJournalReset(void) {
+    if (xJournalIsBlank()) {
+        return true;
+    }
+    return xFlashIfErase(JOURNAL_SECTOR);
+}
+
+static bool prvDfuInstall(const Slot_t *pxSlot, const Slot_t *pxSource, uint32_t ulVersion, bool xFromHost) {
+    DfuImage_t image = { 0 };
+    const AppHeader_t *app = NULL;
+
+    if (xFromHost) {
+        // get size & checksum of dfu image from host
+        if (prvDfuSizeReq(&image) == false || prvDfuChkSumReq(&image) == false) {
+            return false;
+        }
+        prvDfuVersionReq(&ulVersion);
+    } else if ((app = pxSlotAppHeader(pxSlot)) != NULL) {
+        // dfu image was staged in the slot by the application, it carries its own header
+        image.ulSize = app->ulLength;
+        image.ulChkSum = app->ulChkSum;
+        image.ucChkAlg = app->ucChkAlg;
+    } else {
+        // dfu image was staged in the slot by the application
+        image.ulSize = prvBcbSize();
+        image.ulChkSum = prvBcbChkSum();
+        image.ucChkAlg = CHK_ALG_CRC16;
+    }
+    if (image.ulSize < IMG_MIN_SIZE || image.ulSize > ulSlotCapacity(pxSlot)) {
+        return false;
+    }        
+    if (image.ulChkSum == 0) {
+        return false;
+    }
+    if (xFromHost) {
+        JournalSession_t session = { pxSlot->ulBase, image.ulSize, image.ulChkSum, image.ucChkAlg, JOURNAL_MAGIC };
+        uint32_t done = 0;
+        uint32_t done_chksum = ulChkSumFinal(image.ucChkAlg, ulChkSumInit(image.ucChkAlg));
+        uint32_t recv_chksum;
+
+        // same image cut short last time ? keep what is in flash, the trailer must still be blank.
+        // A session without a record may have been cut in the erase, it starts over
+        bool resume = image.ucFormat == DFU_FORMAT_RAW && pxSlotHeader(pxSlot)->ulMagic == 0xFFFFFFFF &&
+                      xJournalFind(&session, &done, &done_chksum) && done > 0;
+        if (resume == false) {
+            // erase the slot, then start the session and stream the image into it
+            done = 0;
+            done_chksum = ulChkSumFinal(image.ucChkAlg, ulChkSumInit(image.ucChkAlg));
+            if (prvJournalReset() == false || prvSlotErase(pxSlot, image.ulSize) == false) {
+                return false;
+            }
+            if (image.ucFormat == DFU_FORMAT_RAW && xJournalStart(&session, prvFlashProgram) == false) {
+                return false;
+            }
+        }
+        vTraceMark(TRACE_DFU_ERASE, 0);
+        bool received = prvDfuSegDataReq(pxSlot, pxSource, &image, done, done_chksum, &recv_chksum);
+        vTraceMark(TRACE_DFU_DOWNLOAD, received);
+        if (received == false) {
+            // only a power cut resumes, a download that failed here starts over next time
+            xJournalClose(prvFlashProgram);
+            return false;
+        }
+        // every buffer was read back as it was programmed, resumed ones included
+        if (recv_chksum != image.ulChkSum) {
+            xJournalClose(prvFlashProgram);
+            return false;
+        }
+    } else if (app != NULL) {
+        // the header checksum skips the header, the trailer gets the one of the whole image
+        if (app->ulLoadAddr != pxSlot->ulBase || xSlotAppImageValid(pxSlot, app) == false) {
+            return false;
+        }
+        image.ulChkSum = prvDfuChkSumCal(image.ucChkAlg, (void *)pxSlot->ulBase, image.ulSize);
+    } else {
+        // check whole dfu image
+        if (prvDfuChkSumCal(image.ucChkAlg, (void *)pxSlot->ulBase, image.ulSize) != image.ulChkSum) {
+            return false;
         }
-    }  
+    }
+    // image is complete, make the slot bootable
+    if (xSlotCommit(pxSlot, ulVersion, image.ulSize, image.ulChkSum, image.ucChkAlg, prvFlashProgram) == false) {
+        return false;
+    }
+    vTraceMark(TRACE_DFU_COMMIT, 0);
+    return xJournalClose(prvFlashProgram);
+}
+
+static void prvDfuMode(int lBootSlot) {
+    // update goes to the slot that is not booted, slot B if none is bootable
+    const Slot_t *slot = &xSlots[lBootSlot == 1 ? 0 : 1];
+    const Slot_t *source = lBootSlot >= 0 ? &xSlots[lBootSlot] : NULL;
+    uint32_t version = 0;
+    if (lBootSlot >= 0) {
+        xSlotIsBootable(&xSlots[lBootSlot], &version, NULL);
+    }
+    version++;
+
+    // host attached ? download over SPL, otherwise install the staged image
+    bool from_host = prvDfuStartReq(slot);
+    vTraceMark(TRACE_DFU_START, from_host);
+    bool ok = prvDfuInstall(slot, source, version, from_host);
+    vTraceMark(TRACE_DFU_DONE, ok);
+    if (from_host) {
+        prvDfuCpltReq(ok);
+    }
 }
 
 static void prvBootCtrlBlockReset(void) {
-    *((uint32_t *)BCB_MAGIC_BASE) = 0;
+    pxPlatBcb()->ulMagic = 0;
 }
 
 static bool prvIsDfuMagicValid(void) {
-    bool valid = *(uint32_t *)BCB_MAGIC_BASE == DFU_MAGIC_VALUE;
+    bool valid = pxPlatBcb()->ulMagic == BCB_DFU_MAGIC;
     return valid;
 }
 
-static bool prvIsAppSignatureValid(void) {
-    return *(uint32_t *)APP_SIGNATURE_BASE == APP_SIGNATURE_VALUE;
-}
-
-static bool prvEnterDfuMode(void) {
-    if (prvIsDfuMagicValid() && prvIsAppSignatureValid()) {
+static bool prvEnterDfuMode(int lBootSlot) {
+    if (prvIsDfuMagicValid() || lBootSlot < 0) {
         return true;
     }    
     return false;
 }
 
-static void prvApplicationJump(uint32_t ulVectorTabAddr) {
-    struct vectors {
-        uint32_t __initial_sp;
-        void(*Reset_Handler)(void) __attribute__((noreturn));
-    };		
-    SCB->VTOR = ulVectorTabAddr;
-    ((struct vectors *)SCB->VTOR)->Reset_Handler();
-}
-
 void vBootloader(void) {
+    // Slot checks and DFU on the PLL, locking it costs less than hashing one block at 16 MHz
+    vTraceMark(TRACE_CLOCK_FAST, xClockFast());
+
+    // CRC32 images are checked on the CRC unit, software model if it does not come up
+    vChkSumSetCrc32Engine(pxChkSumHwInit());
+    vTraceMark(TRACE_CHKSUM_INIT, 0);
+
+    // Newest valid slot, an image with a header verified before gets a partial check (slot.h)
+    int boot_slot = lSlotSelect(xSlots, COUNTOF(xSlots), prvFlashProgram);
+    vTraceMark(TRACE_SLOT_SELECT, (uint16_t)boot_slot);
+
     // Enter Dfu Mode ?
-    if (prvEnterDfuMode()) {        
-        prvDfuMode();
+    if (prvEnterDfuMode(boot_slot)) {        
+        prvDfuMode(boot_slot);
         prvBootCtrlBlockReset();
-        HAL_NVIC_SystemReset();
+        vPlatReset();
     }       
     
-    // Reset all peripherals, and irqs
-    HAL_DeInit();
-    for (int i = WWDG_IRQn; i < (FMPI2C1_ER_IRQn + 1); i++) {
-        if (HAL_NVIC_GetActive((IRQn_Type)i)) {
-            HAL_NVIC_DisableIRQ((IRQn_Type)i);
-            if (HAL_NVIC_GetPendingIRQ((IRQn_Type)i)) {
-                HAL_NVIC_ClearPendingIRQ((IRQn_Type)i);
-            }
-        }
-    }    
-    SysTick->CTRL = 0;    
+    // Not confirmed by the application yet ? count this boot
+    xSlotBootAttempt(&xSlots[boot_slot], prvFlashProgram);
+    vTraceMark(TRACE_BOOT_ATTEMPT, 0);
     
-    // If application is exist, enter application.
-    prvApplicationJump(APP_BASE);
+    // Reset clocking, the peripherals and irqs go in the jump
+    vClockReset();
+    vTraceMark(TRACE_CLOCK_RESET, 0);
+
+    // Run the image in place
+    vPlatJump(xSlots[boot_slot].ulBase);
 }
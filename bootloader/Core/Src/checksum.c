@@ -0,0 +1,101 @@
+#include "checksum.h"
+#include "crc16.h"
+
+#define CHK_CRC32_POLY      0x04C11DB7
+
+// CRC32, MSB first, one nibble per step
+static const uint32_t ulCrc32Nibble[16] = {
+    0x00000000, 0x04C11DB7, 0x09823B6E, 0x0D4326D9, 0x130476DC, 0x17C56B6B, 0x1A864DB2, 0x1E475005,
+    0x2608EDB8, 0x22C9F00F, 0x2F8AD6D6, 0x2B4BCB61, 0x350C9B64, 0x31CD86D3, 0x3C8EA00A, 0x384FBDBD,
+};
+
+static const ChkSumEngine_t xCrc32Soft = {
+    .pxUpdate = ulChkSumCrc32Soft,
+};
+
+static const ChkSumEngine_t *pxCrc32Engine = &xCrc32Soft;
+
+static uint32_t prvCrc32Word(uint32_t ulCrc, uint32_t ulWord) {
+    ulCrc ^= ulWord;
+    for (int i = 0; i < 8; i++) {
+        ulCrc = (ulCrc << 4) ^ ulCrc32Nibble[ulCrc >> 28];
+    }
+    return ulCrc;
+}
+
+uint32_t ulChkSumCrc32Soft(uint32_t ulCrc, const void *pvData, uint32_t ulSize) {
+    const uint8_t *p = pvData;
+    for (; ulSize >= 4; ulSize -= 4, p += 4) {
+        ulCrc = prvCrc32Word(ulCrc, p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+    }
+    if (ulSize) {
+        uint32_t tail = 0;
+        for (uint32_t i = 0; i < ulSize; i++) {
+            tail |= (uint32_t)p[i] << (8 * i);
+        }
+        ulCrc = prvCrc32Word(ulCrc, tail);
+    }
+    return ulCrc;
+}
+
+void vChkSumSetCrc32Engine(const ChkSumEngine_t *pxEngine) {
+    pxCrc32Engine = pxEngine ? pxEngine : &xCrc32Soft;
+}
+
+bool xChkSumAlgValid(uint8_t ucAlg) {
+    return ucAlg == CHK_ALG_CRC16 || ucAlg == CHK_ALG_CRC32;
+}
+
+uint32_t ulChkSumInit(uint8_t ucAlg) {
+    return ucAlg == CHK_ALG_CRC32 ? CHK_CRC32_INIT : CHK_CRC16_INIT;
+}
+
+uint32_t ulChkSumUpdate(uint8_t ucAlg, uint32_t ulCrc, const void *pvData, uint32_t ulSize) {
+    if (ucAlg == CHK_ALG_CRC32) {
+        return pxCrc32Engine->pxUpdate(ulCrc, pvData, ulSize);
+    }
+    return CRC16_Update(ulCrc, (unsigned char *)pvData, ulSize);
+}
+
+uint32_t ulChkSumFinal(uint8_t ucAlg, uint32_t ulCrc) {
+    return ucAlg == CHK_ALG_CRC32 ? ulCrc : CRC16_Final(ulCrc);
+}
+
+uint32_t ulChkSumCalc(uint8_t ucAlg, const void *pvData, uint32_t ulSize) {
+    return ulChkSumFinal(ucAlg, ulChkSumUpdate(ucAlg, ulChkSumInit(ucAlg), pvData, ulSize));
+}
+
+// a * b mod P, CRC32 register order, bit 31 = x^31
+static uint32_t prvCrc32MulModP(uint32_t a, uint32_t b) {
+    uint32_t p = 0;
+    for (int i = 31; i >= 0; i--) {
+        p = (p & 0x80000000) ? (p << 1) ^ CHK_CRC32_POLY : p << 1;
+        if ((a >> i) & 1) {
+            p ^= b;
+        }
+    }
+    return p;
+}
+
+// x^(32 ulWords) mod P
+static uint32_t prvCrc32ZeroWords(uint32_t ulWords) {
+    uint32_t p = 1;
+    uint32_t x2n = CHK_CRC32_POLY;          // x^32 mod P, one word
+    while (ulWords) {
+        if (ulWords & 1) {
+            p = prvCrc32MulModP(x2n, p);
+        }
+        ulWords >>= 1;
+        x2n = prvCrc32MulModP(x2n, x2n);
+    }
+    return p;
+}
+
+uint32_t ulChkSumCombine(uint8_t ucAlg, uint32_t ulCrc1, uint32_t ulCrc2, uint32_t ulSize2) {
+    if (ucAlg != CHK_ALG_CRC32) {
+        return CRC16_Combine(ulCrc1, ulCrc2, ulSize2);
+    }
+    // the tail of b was padded to a word
+    uint32_t words = (ulSize2 + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+    return prvCrc32MulModP(prvCrc32ZeroWords(words), ulCrc1 ^ CHK_CRC32_INIT) ^ ulCrc2;
+}
@@ -0,0 +1,92 @@
+#include "main.h"
+#include "checksum.h"
+
+/* CRC32 on the CRC unit, fed by DMA2 stream 0 in memory to memory mode
+ *
+ * The unit can not be loaded with a value, it starts from its reset value or goes on
+ * from its own last result. Any other starting value (a resumed download) falls back
+ * to the software model, which gives the same result.
+ **/
+
+#define MIN(X, Y)           (((X) < (Y)) ? (X) : (Y))
+#define CHK_HW_DMA_MAX      0xFFFF  // words per DMA transfer
+#define CHK_HW_TIMEOUT      100     // ms
+
+CRC_HandleTypeDef hcrc;
+static DMA_HandleTypeDef hdma_crc;
+static uint32_t ulHwCrc;            // value the unit holds
+static bool xHwValid;
+
+static bool prvHwFeed(const uint32_t *pulData, uint32_t ulWords) {
+    while (ulWords) {
+        uint32_t n = MIN(ulWords, CHK_HW_DMA_MAX);
+        if (HAL_DMA_Start(&hdma_crc, (uint32_t)pulData, (uint32_t)&hcrc.Instance->DR, n) != HAL_OK) {
+            return false;
+        }
+        if (HAL_DMA_PollForTransfer(&hdma_crc, HAL_DMA_FULL_TRANSFER, CHK_HW_TIMEOUT) != HAL_OK) {
+            HAL_DMA_Abort(&hdma_crc);
+            return false;
+        }
+        pulData += n;
+        ulWords -= n;
+    }
+    return true;
+}
+
+static uint32_t prvHwUpdate(uint32_t ulCrc, const void *pvData, uint32_t ulSize) {
+    // DMA reads whole words
+    if (((uint32_t)pvData & 3) || (ulCrc != CHK_CRC32_INIT && (xHwValid == false || ulCrc != ulHwCrc))) {
+        return ulChkSumCrc32Soft(ulCrc, pvData, ulSize);
+    }
+    if (ulCrc == CHK_CRC32_INIT) {
+        __HAL_CRC_DR_RESET(&hcrc);
+    }
+    uint32_t words = ulSize / sizeof(uint32_t);
+    if (prvHwFeed(pvData, words) == false) {
+        xHwValid = false;
+        return ulChkSumCrc32Soft(ulCrc, pvData, ulSize);
+    }
+    if (ulSize % sizeof(uint32_t)) {
+        const uint8_t *tail = (const uint8_t *)pvData + words * sizeof(uint32_t);
+        uint32_t word = 0;
+        for (uint32_t i = 0; i < ulSize % sizeof(uint32_t); i++) {
+            word |= (uint32_t)tail[i] << (8 * i);
+        }
+        hcrc.Instance->DR = word;
+    }
+    ulHwCrc = hcrc.Instance->DR;
+    xHwValid = true;
+    return ulHwCrc;
+}
+
+static const ChkSumEngine_t xHwEngine = {
+    .pxUpdate = prvHwUpdate,
+};
+
+const ChkSumEngine_t *pxChkSumHwInit(void) {
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    hcrc.Instance = CRC;
+    if (HAL_CRC_Init(&hcrc) != HAL_OK) {
+        return NULL;
+    }
+    // memory to memory needs the FIFO, destination stays on CRC->DR
+    hdma_crc.Instance = DMA2_Stream0;
+    hdma_crc.Init.Channel = DMA_CHANNEL_0;
+    hdma_crc.Init.Direction = DMA_MEMORY_TO_MEMORY;
+    hdma_crc.Init.PeriphInc = DMA_PINC_ENABLE;
+    hdma_crc.Init.MemInc = DMA_MINC_DISABLE;
+    hdma_crc.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+    hdma_crc.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    hdma_crc.Init.Mode = DMA_NORMAL;
+    hdma_crc.Init.Priority = DMA_PRIORITY_LOW;
+    hdma_crc.Init.FIFOMode = DMA_FIFOMODE_ENABLE;
+    hdma_crc.Init.FIFOThreshold = DMA_FIFO_THRESHOLD_FULL;
+    hdma_crc.Init.MemBurst = DMA_MBURST_SINGLE;
+    hdma_crc.Init.PeriphBurst = DMA_PBURST_SINGLE;
+    if (HAL_DMA_Init(&hdma_crc) != HAL_OK) {
+        return NULL;
+    }
+    xHwValid = false;
+    return &xHwEngine;
+}
@@ -0,0 +1,115 @@
+#include "main.h"
+#include "clock.h"
+
+/* HSI 16 MHz / M 8 = 2 MHz, * N 96 = 192 MHz VCO, / P 2 = 96 MHz SYSCLK, / Q 4 = 48 MHz
+ *
+ * 96 MHz at 2.7 ~ 3.6 V takes 3 wait states (RM0402, table 6), APB1 is limited to
+ * 50 MHz. HAL_RCC_ClockConfig() raises the latency before the switch and updates
+ * SystemCoreClock and the tick.
+ * USB needs its 48 MHz within 0.25 %, the HSI only holds 1 %: xClockUsb() moves the
+ * same PLL onto the 8 MHz HSE / M 4.
+ **/
+
+#define CLOCK_PLL_M         8
+#define CLOCK_PLL_M_HSE     (HSE_VALUE / 2000000)
+#define CLOCK_PLL_N         96
+#define CLOCK_PLL_Q         4
+#define CLOCK_PLL_R         2
+#define CLOCK_FAST_LATENCY  FLASH_LATENCY_3
+
+static uint32_t ulPllCfgrReset;
+
+// Latency stays at the fast one, the core only runs slower in between
+static bool prvClockSwitch(uint32_t ulSysclk) {
+    RCC_ClkInitTypeDef clk = { 0 };
+
+    clk.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    clk.SYSCLKSource = ulSysclk;
+    clk.AHBCLKDivider = RCC_SYSCLK_DIV1;
+    clk.APB1CLKDivider = RCC_HCLK_DIV2;
+    clk.APB2CLKDivider = RCC_HCLK_DIV1;
+    return HAL_RCC_ClockConfig(&clk, CLOCK_FAST_LATENCY) == HAL_OK;
+}
+
+bool xClockFast(void) {
+    RCC_OscInitTypeDef osc = { 0 };
+
+    if (__HAL_RCC_GET_SYSCLK_SOURCE() == RCC_SYSCLKSOURCE_STATUS_PLLCLK) {
+        return true;
+    }
+    ulPllCfgrReset = RCC->PLLCFGR;
+
+    osc.OscillatorType = RCC_OSCILLATORTYPE_HSI;
+    osc.HSIState = RCC_HSI_ON;
+    osc.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+    osc.PLL.PLLState = RCC_PLL_ON;
+    osc.PLL.PLLSource = RCC_PLLSOURCE_HSI;
+    osc.PLL.PLLM = CLOCK_PLL_M;
+    osc.PLL.PLLN = CLOCK_PLL_N;
+    osc.PLL.PLLP = RCC_PLLP_DIV2;
+    osc.PLL.PLLQ = CLOCK_PLL_Q;
+    osc.PLL.PLLR = CLOCK_PLL_R;
+    if (HAL_RCC_OscConfig(&osc) != HAL_OK) {
+        return false;
+    }
+    if (prvClockSwitch(RCC_SYSCLKSOURCE_PLLCLK) == false) {
+        return false;
+    }
+
+    // HAL_Init() turned the ART on already, without it every fetch waits 3 cycles
+    __HAL_FLASH_PREFETCH_BUFFER_ENABLE();
+    __HAL_FLASH_INSTRUCTION_CACHE_ENABLE();
+    __HAL_FLASH_DATA_CACHE_ENABLE();
+    return true;
+}
+
+bool xClockUsb(void) {
+    RCC_OscInitTypeDef osc = { 0 };
+
+    if (xClockFast() == false) {
+        return false;
+    }
+    if (__HAL_RCC_GET_PLL_OSCSOURCE() == RCC_PLLSOURCE_HSE) {
+        return true;
+    }
+    // the PLL can only be changed while it does not clock the core
+    if (prvClockSwitch(RCC_SYSCLKSOURCE_HSI) == false) {
+        return false;
+    }
+    osc.OscillatorType = RCC_OSCILLATORTYPE_HSE;
+    osc.HSEState = RCC_HSE_ON;
+    osc.PLL.PLLState = RCC_PLL_ON;
+    osc.PLL.PLLSource = RCC_PLLSOURCE_HSE;
+    osc.PLL.PLLM = CLOCK_PLL_M_HSE;
+    osc.PLL.PLLN = CLOCK_PLL_N;
+    osc.PLL.PLLP = RCC_PLLP_DIV2;
+    osc.PLL.PLLQ = CLOCK_PLL_Q;
+    osc.PLL.PLLR = CLOCK_PLL_R;
+    bool ok = HAL_RCC_OscConfig(&osc) == HAL_OK;
+    if (ok == false) {
+        // no crystal: HSE off, the PLL still runs from the HSI
+        __HAL_RCC_HSE_CONFIG(RCC_HSE_OFF);
+    }
+    return prvClockSwitch(RCC_SYSCLKSOURCE_PLLCLK) && ok;
+}
+
+// Not HAL_RCC_DeInit(), it clears the reset flags the application may want to read
+void vClockReset(void) {
+    if (__HAL_RCC_GET_SYSCLK_SOURCE() != RCC_SYSCLKSOURCE_STATUS_PLLCLK) {
+        return;
+    }
+    // HSI, all prescalers / 1
+    CLEAR_REG(RCC->CFGR);
+    while (__HAL_RCC_GET_SYSCLK_SOURCE() != RCC_SYSCLKSOURCE_STATUS_HSI) {
+    }
+    __HAL_RCC_PLL_DISABLE();
+    while (__HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY)) {
+    }
+    RCC->PLLCFGR = ulPllCfgrReset;
+    __HAL_RCC_HSE_CONFIG(RCC_HSE_OFF);
+
+    // wait states down only once the core runs slow
+    __HAL_FLASH_SET_LATENCY(FLASH_LATENCY_0);
+    SystemCoreClock = HSI_VALUE;
+    HAL_InitTick(uwTickPrio);
+}
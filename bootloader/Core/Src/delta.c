@@ -0,0 +1,121 @@
+#include "delta.h"
+
+enum {
+    DELTA_ST_HEADER,
+    DELTA_ST_OP,
+    DELTA_ST_ARG,
+    DELTA_ST_DATA,
+};
+
+void vDeltaInit(Delta_t *pxDelta, uint32_t ulSrcSize, uint32_t ulSrcChkSum,
+                bool (*pxPut)(uint8_t, void *), uint8_t (*pxSrc)(uint32_t, void *), void *pvCtx) {
+    pxDelta->pxPut = pxPut;
+    pxDelta->pxSrc = pxSrc;
+    pxDelta->pvCtx = pvCtx;
+    pxDelta->ulSrcSize = ulSrcSize;
+    pxDelta->ulSrcChkSum = ulSrcChkSum;
+    pxDelta->ucState = DELTA_ST_HEADER;
+    pxDelta->ulArg = 0;
+    pxDelta->ulSrcPos = 0;
+}
+
+static bool prvDeltaHeader(Delta_t *pxDelta) {
+    const uint8_t *hdr = pxDelta->ucHdr;
+    uint32_t size = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | ((uint32_t)hdr[3] << 24);
+    uint32_t chksum = hdr[4] | (hdr[5] << 8) | (hdr[6] << 16) | ((uint32_t)hdr[7] << 24);
+    return size == pxDelta->ulSrcSize && chksum == pxDelta->ulSrcChkSum;
+}
+
+// Argument complete, run the op or wait for its data
+static bool prvDeltaExec(Delta_t *pxDelta) {
+    switch (pxDelta->ucOp) {
+    case DELTA_OP_COPY:
+        if (pxDelta->ulArg > pxDelta->ulSrcSize - pxDelta->ulSrcPos) {
+            return false;
+        }
+        for (uint32_t i = 0; i < pxDelta->ulArg; i++) {
+            if (pxDelta->pxPut(pxDelta->pxSrc(pxDelta->ulSrcPos++, pxDelta->pvCtx), pxDelta->pvCtx) == false) {
+                return false;
+            }
+        }
+        break;
+    case DELTA_OP_DIFF:
+        if (pxDelta->ulArg > pxDelta->ulSrcSize - pxDelta->ulSrcPos) {
+            return false;
+        }
+        // fall through
+    case DELTA_OP_INSERT:
+        if (pxDelta->ulArg) {
+            pxDelta->ucState = DELTA_ST_DATA;
+            return true;
+        }
+        break;
+    case DELTA_OP_SEEK: {
+        // zigzag, the new position must stay inside the source
+        int32_t seek = (int32_t)(pxDelta->ulArg >> 1) ^ -(int32_t)(pxDelta->ulArg & 1);
+        int64_t pos = (int64_t)pxDelta->ulSrcPos + seek;
+        if (pos < 0 || pos > pxDelta->ulSrcSize) {
+            return false;
+        }
+        pxDelta->ulSrcPos = (uint32_t)pos;
+        break;
+    }
+    default:
+        return false;
+    }
+    pxDelta->ucState = DELTA_ST_OP;
+    return true;
+}
+
+bool xDeltaFeed(Delta_t *pxDelta, const uint8_t *pucIn, uint32_t ulLen) {
+    while (ulLen--) {
+        uint8_t byte = *pucIn++;
+        switch (pxDelta->ucState) {
+        case DELTA_ST_HEADER:
+            pxDelta->ucHdr[pxDelta->ulArg++] = byte;
+            if (pxDelta->ulArg == DELTA_HDR_SIZE) {
+                if (prvDeltaHeader(pxDelta) == false) {
+                    return false;
+                }
+                pxDelta->ucState = DELTA_ST_OP;
+            }
+            break;
+        case DELTA_ST_OP:
+            pxDelta->ucOp = byte;
+            pxDelta->ulArg = 0;
+            pxDelta->ucShift = 0;
+            pxDelta->ucState = DELTA_ST_ARG;
+            break;
+        case DELTA_ST_ARG:
+            // LEB128
+            if (pxDelta->ucShift > 28) {
+                return false;
+            }
+            pxDelta->ulArg |= (uint32_t)(byte & 0x7F) << pxDelta->ucShift;
+            pxDelta->ucShift += 7;
+            if ((byte & 0x80) == 0 && prvDeltaExec(pxDelta) == false) {
+                return false;
+            }
+            break;
+        case DELTA_ST_DATA:
+            if (pxDelta->ucOp == DELTA_OP_DIFF) {
+                byte += pxDelta->pxSrc(pxDelta->ulSrcPos++, pxDelta->pvCtx);
+            }
+            if (pxDelta->pxPut(byte, pxDelta->pvCtx) == false) {
+                return false;
+            }
+            if (--pxDelta->ulArg == 0) {
+                pxDelta->ucState = DELTA_ST_OP;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+// Only between two ops
+bool xDeltaIsDone(const Delta_t *pxDelta) {
+    return pxDelta->ucState == DELTA_ST_OP;
+}
@@ -0,0 +1,162 @@
+#include "main.h"
+#include "flash_if.h"
+
+/* Flash programming executed from internal SRAM
+ *
+ * Unlock and lock once per batch, PSIZE is only rewritten where the access
+ * width changes (unaligned head/tail), the status register is checked once at
+ * the end: after a program error the controller ignores further writes until
+ * the flags are cleared, so nothing is lost by not checking every word.
+ * Runs and erases use the widest parallelism of the supply (flash_if.h), a program
+ * operation takes about as long at x8 as at x32, so x32 moves 4 times the data.
+ *
+ * The write loop must not fetch from flash while the flash is busy:
+ *   - GNU/IAR: functions are placed in RAM by __RAM_FUNC
+ *   - ARM Compiler: __RAM_FUNC is empty, 'Code / Const' of this module is assigned
+ *     to IRAM1 in 'Options for File' (MDK-ARM/bootloader.uvprojx, RVCTCodeConst 9),
+ *     the linker then copies the whole module to RAM with the RW data
+ **/
+
+#if FLASH_IF_WIDTH == 8
+#define FLASH_IF_RANGE      FLASH_VOLTAGE_RANGE_4
+#elif FLASH_IF_WIDTH == 4
+#define FLASH_IF_RANGE      FLASH_VOLTAGE_RANGE_3
+#elif FLASH_IF_WIDTH == 2
+#define FLASH_IF_RANGE      FLASH_VOLTAGE_RANGE_2
+#else
+#define FLASH_IF_RANGE      FLASH_VOLTAGE_RANGE_1
+#endif
+#define FLASH_IF_ERASE_TIMEOUT  5000    // ms, a 128KB sector takes up to 4 s at x8
+
+#define FLASH_IF_ERRORS     (FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR | \
+                             FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR)
+
+__RAM_FUNC static void prvFlashIfWait(void) {
+    while (FLASH->SR & FLASH_SR_BSY) {
+    }
+}
+
+__RAM_FUNC static void prvFlashIfPsize(uint32_t ulPsize) {
+    FLASH->CR = (FLASH->CR & ~FLASH_CR_PSIZE) | ulPsize;
+}
+
+bool xFlashIfBegin(void) {
+    if (HAL_FLASH_Unlock() != HAL_OK) {
+        return false;
+    }
+    prvFlashIfWait();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_IF_ERRORS | FLASH_FLAG_EOP);
+    return true;
+}
+
+__RAM_FUNC bool xFlashIfWrite(uint32_t ulAddr, const void *pvSrc, uint32_t ulSize) {
+    const uint8_t *pucSrc = pvSrc;
+    uint32_t ulWidth = 0;
+
+    FLASH->CR |= FLASH_CR_PG;
+
+    // narrow accesses up to alignment, the run at FLASH_IF_WIDTH, narrow tail
+    while (ulSize) {
+        uint32_t w = FLASH_IF_WIDTH;
+        while (w > 1 && ((ulAddr & (w - 1)) || ulSize < w)) {
+            w >>= 1;
+        }
+        if (w != ulWidth) {
+            prvFlashIfPsize(w == 8 ? FLASH_PSIZE_DOUBLE_WORD : w == 4 ? FLASH_PSIZE_WORD :
+                            w == 2 ? FLASH_PSIZE_HALF_WORD : FLASH_PSIZE_BYTE);
+            ulWidth = w;
+        }
+        switch (w) {
+        case 8:
+            // one program operation, both halves before the controller starts
+            *(__IO uint32_t *)ulAddr = __UNALIGNED_UINT32_READ(pucSrc);
+            __ISB();
+            *(__IO uint32_t *)(ulAddr + 4) = __UNALIGNED_UINT32_READ(pucSrc + 4);
+            break;
+        case 4:
+            *(__IO uint32_t *)ulAddr = __UNALIGNED_UINT32_READ(pucSrc);
+            break;
+        case 2:
+            *(__IO uint16_t *)ulAddr = __UNALIGNED_UINT16_READ(pucSrc);
+            break;
+        default:
+            *(__IO uint8_t *)ulAddr = *pucSrc;
+            break;
+        }
+        prvFlashIfWait();
+        ulAddr += w;
+        pucSrc += w;
+        ulSize -= w;
+    }
+
+    FLASH->CR &= ~FLASH_CR_PG;
+    return (FLASH->SR & FLASH_IF_ERRORS) == 0;
+}
+
+bool xFlashIfEnd(void) {
+    bool ret = (FLASH->SR & FLASH_IF_ERRORS) == 0;
+    __HAL_FLASH_CLEAR_FLAG(FLASH_IF_ERRORS | FLASH_FLAG_EOP);
+    // drop stale lines of the programmed area
+    FLASH_FlushCaches();
+    HAL_FLASH_Lock();
+    return ret;
+}
+
+bool xFlashIfErase(uint32_t ulSector) {
+    if (HAL_FLASH_Unlock() != HAL_OK) {
+        return false;
+    }
+    FLASH_Erase_Sector(ulSector, FLASH_IF_RANGE);
+    HAL_StatusTypeDef status = FLASH_WaitForLastOperation(FLASH_IF_ERASE_TIMEOUT);
+    CLEAR_BIT(FLASH->CR, (FLASH_CR_SER | FLASH_CR_SNB));
+    FLASH_FlushCaches();
+    HAL_FLASH_Lock();
+    return status == HAL_OK;
+}
+
+uint32_t ulFlashIfCompare(uint32_t ulAddr, const void *pvSrc, uint32_t ulSize) {
+    const uint8_t *pucFlash = (const uint8_t *)ulAddr;
+    const uint8_t *pucSrc = pvSrc;
+    uint32_t off = 0;
+
+    // both aligned, a word per step, the byte loop below finds the byte in a bad word
+    if (((ulAddr | (uint32_t)pvSrc) & 3) == 0) {
+        const uint32_t *pulFlash = (const uint32_t *)pucFlash;
+        const uint32_t *pulSrc = (const uint32_t *)pucSrc;
+        while (off + sizeof(uint32_t) <= ulSize && *pulFlash == *pulSrc) {
+            pulFlash++;
+            pulSrc++;
+            off += sizeof(uint32_t);
+        }
+    }
+    while (off < ulSize && pucFlash[off] == pucSrc[off]) {
+        off++;
+    }
+    return off;
+}
+
+bool xFlashIfVerify(uint32_t ulAddr, const void *pvSrc, uint32_t ulSize, uint32_t *pulBad) {
+    for (int i = 0; ; i++) {
+        uint32_t off = ulFlashIfCompare(ulAddr, pvSrc, ulSize);
+        if (off == ulSize) {
+            return true;
+        }
+        if (i == FLASH_IF_VERIFY_RETRY) {
+            if (pulBad != NULL) {
+                *pulBad = ulAddr + off;
+            }
+            return false;
+        }
+        // bits that did not take can still be cleared, a 0 where a 1 belongs needs an erase
+        off &= ~(sizeof(uint32_t) - 1);
+        __HAL_FLASH_CLEAR_FLAG(FLASH_IF_ERRORS);
+        if (xFlashIfWrite(ulAddr + off, (const uint8_t *)pvSrc + off, ulSize - off) == false) {
+            if (pulBad != NULL) {
+                *pulBad = ulAddr + off;
+            }
+            return false;
+        }
+        // the compare above cached the bad lines
+        FLASH_FlushCaches();
+    }
+}
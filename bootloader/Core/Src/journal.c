@@ -0,0 +1,80 @@
+#include "journal.h"
+#include <stddef.h>
+
+/* Journal, no HAL access here: read through the memory map, written through the
+ * SlotProgram_t callback only, like slot.c.
+ **/
+
+#define JOURNAL_ERASED_WORD     0xFFFFFFFF
+#define JOURNAL_ENTRY_MAX       ((JOURNAL_SIZE - sizeof(JournalSession_t)) / sizeof(JournalEntry_t))
+
+static const JournalSession_t *const pxJournalSession = (const JournalSession_t *)JOURNAL_BASE;
+static const JournalEntry_t *const pxJournalEntry = (const JournalEntry_t *)(JOURNAL_BASE + sizeof(JournalSession_t));
+
+// next free entry, found by xJournalFind() or xJournalStart()
+static uint32_t ulJournalNext;
+
+static bool prvJournalEntryValid(const JournalEntry_t *pxEntry) {
+    return pxEntry->ulDone != JOURNAL_ERASED_WORD && pxEntry->ulCheck == ~(pxEntry->ulDone ^ pxEntry->ulChkSum);
+}
+
+bool xJournalIsBlank(void) {
+    for (uint32_t off = 0; off < JOURNAL_SIZE; off += sizeof(uint32_t)) {
+        if (*(uint32_t *)(JOURNAL_BASE + off) != JOURNAL_ERASED_WORD) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool xJournalFind(const JournalSession_t *pxSession, uint32_t *pulDone, uint32_t *pulChkSum) {
+    const JournalSession_t *session = pxJournalSession;
+    if (session->ulMagic != JOURNAL_MAGIC || session->ulSlotBase != pxSession->ulSlotBase ||
+        session->ulSize != pxSession->ulSize || session->ulChkSum != pxSession->ulChkSum ||
+        session->ulChkAlg != pxSession->ulChkAlg) {
+        return false;
+    }
+    // entries only grow, the last good one wins
+    uint32_t i;
+    for (i = 0; i < JOURNAL_ENTRY_MAX && pxJournalEntry[i].ulDone != JOURNAL_ERASED_WORD; i++) {
+        const JournalEntry_t *entry = &pxJournalEntry[i];
+        if (prvJournalEntryValid(entry) && entry->ulDone > *pulDone && entry->ulDone <= session->ulSize) {
+            *pulDone = entry->ulDone;
+            *pulChkSum = entry->ulChkSum;
+        }
+    }
+    // a torn entry is left behind, append after it
+    ulJournalNext = i;
+    return true;
+}
+
+bool xJournalStart(const JournalSession_t *pxSession, SlotProgram_t pxProgram) {
+    uint32_t addr = JOURNAL_BASE;
+    uint32_t magic = JOURNAL_MAGIC;
+    ulJournalNext = 0;
+    if (pxProgram(addr, pxSession, offsetof(JournalSession_t, ulMagic)) == false) {
+        return false;
+    }
+    return pxProgram(addr + offsetof(JournalSession_t, ulMagic), &magic, sizeof(magic));
+}
+
+bool xJournalRecord(uint32_t ulDone, uint32_t ulChkSum, SlotProgram_t pxProgram) {
+    if (ulJournalNext >= JOURNAL_ENTRY_MAX) {
+        return false;
+    }
+    uint32_t addr = (uint32_t)&pxJournalEntry[ulJournalNext++];
+    JournalEntry_t entry = {
+        .ulDone = ulDone,
+        .ulChkSum = ulChkSum,
+        .ulCheck = ~(ulDone ^ ulChkSum),
+    };
+    return pxProgram(addr, &entry, sizeof(entry));
+}
+
+bool xJournalClose(SlotProgram_t pxProgram) {
+    uint32_t magic = JOURNAL_CLOSED;
+    if (pxJournalSession->ulMagic != JOURNAL_MAGIC) {
+        return true;
+    }
+    return pxProgram(JOURNAL_BASE + offsetof(JournalSession_t, ulMagic), &magic, sizeof(magic));
+}
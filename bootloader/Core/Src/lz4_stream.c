@@ -0,0 +1,102 @@
+#include "lz4_stream.h"
+
+/* LZ4 block format
+ *   sequence: [token] [literal length ext] [literals] [offset 2] [match length ext]
+ *   token   : literal length (high 4 bits), match length - 4 (low 4 bits), 15 = ext bytes follow
+ *   the last sequence has literals only
+ **/
+
+#define LZ4_MIN_MATCH       4
+#define LZ4_RUN_MASK        0x0F
+
+enum {
+    LZ4_ST_TOKEN,
+    LZ4_ST_LIT_LEN,
+    LZ4_ST_LITERAL,
+    LZ4_ST_OFFSET_LO,
+    LZ4_ST_OFFSET_HI,
+    LZ4_ST_MATCH_LEN,
+};
+
+void vLz4StreamInit(Lz4Stream_t *pxStream, bool (*pxPut)(uint8_t, void *), uint8_t (*pxGet)(uint32_t, void *), void *pvCtx) {
+    pxStream->pxPut = pxPut;
+    pxStream->pxGet = pxGet;
+    pxStream->pvCtx = pvCtx;
+    pxStream->ucState = LZ4_ST_TOKEN;
+    pxStream->ulOutput = 0;
+}
+
+static bool prvLz4Copy(Lz4Stream_t *pxStream) {
+    if (pxStream->ulOffset == 0 || pxStream->ulOffset > pxStream->ulOutput) {
+        return false;
+    }
+    // byte by byte, the match may overlap its own output
+    for (uint32_t i = 0; i < pxStream->ulLen; i++) {
+        uint8_t byte = pxStream->pxGet(pxStream->ulOffset, pxStream->pvCtx);
+        if (pxStream->pxPut(byte, pxStream->pvCtx) == false) {
+            return false;
+        }
+        pxStream->ulOutput++;
+    }
+    pxStream->ucState = LZ4_ST_TOKEN;
+    return true;
+}
+
+bool xLz4StreamFeed(Lz4Stream_t *pxStream, const uint8_t *pucIn, uint32_t ulLen) {
+    while (ulLen--) {
+        uint8_t byte = *pucIn++;
+        switch (pxStream->ucState) {
+        case LZ4_ST_TOKEN:
+            pxStream->ucToken = byte;
+            pxStream->ulLen = byte >> 4;
+            if (pxStream->ulLen == LZ4_RUN_MASK) {
+                pxStream->ucState = LZ4_ST_LIT_LEN;
+            } else {
+                pxStream->ucState = pxStream->ulLen ? LZ4_ST_LITERAL : LZ4_ST_OFFSET_LO;
+            }
+            break;
+        case LZ4_ST_LIT_LEN:
+            pxStream->ulLen += byte;
+            if (byte != 0xFF) {
+                pxStream->ucState = pxStream->ulLen ? LZ4_ST_LITERAL : LZ4_ST_OFFSET_LO;
+            }
+            break;
+        case LZ4_ST_LITERAL:
+            if (pxStream->pxPut(byte, pxStream->pvCtx) == false) {
+                return false;
+            }
+            pxStream->ulOutput++;
+            if (--pxStream->ulLen == 0) {
+                pxStream->ucState = LZ4_ST_OFFSET_LO;
+            }
+            break;
+        case LZ4_ST_OFFSET_LO:
+            pxStream->ulOffset = byte;
+            pxStream->ucState = LZ4_ST_OFFSET_HI;
+            break;
+        case LZ4_ST_OFFSET_HI:
+            pxStream->ulOffset |= (uint32_t)byte << 8;
+            pxStream->ulLen = (pxStream->ucToken & LZ4_RUN_MASK) + LZ4_MIN_MATCH;
+            if ((pxStream->ucToken & LZ4_RUN_MASK) == LZ4_RUN_MASK) {
+                pxStream->ucState = LZ4_ST_MATCH_LEN;
+            } else if (prvLz4Copy(pxStream) == false) {
+                return false;
+            }
+            break;
+        case LZ4_ST_MATCH_LEN:
+            pxStream->ulLen += byte;
+            if (byte != 0xFF && prvLz4Copy(pxStream) == false) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+// The block may only end after the literals of a sequence
+bool xLz4StreamIsDone(const Lz4Stream_t *pxStream) {
+    return pxStream->ucState == LZ4_ST_OFFSET_LO;
+}
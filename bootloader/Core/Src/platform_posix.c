@@ -0,0 +1,489 @@
+/* Linux backend of platform.h, runs vBootloader() on a host
+ *
+ *   cd bootloader/Core/Src
+ *   gcc -O2 -D_GNU_SOURCE -Wno-int-to-pointer-cast -Wno-pointer-to-int-cast -I../Inc \
+ *       platform_posix.c bootloader.c slot.c journal.c spl.c checksum.c crc16.c lz4_stream.c \
+ *       delta.c -o boot_host
+ *   ./boot_host flash.bin [--dfu] [--bcb=len,crc16] [--link] [--trace] [--boots=n]
+ *               [--flash-max] [--baud=n] [--dfuse=app.bin] [--cut-erase=n] [--cut-write=n]
+ *
+ * flash.bin is the 512KB flash from 0x08000000 (created erased if missing), mapped at
+ * its real address so the core reads it in place, every change lands in the file.
+ * Programming ANDs bits like NOR flash, erase sets a sector to 0xFF.
+ * --link puts the SPL link on stdin / stdout for a host, tools/dfu_sim.py drives it;
+ * without it there is no host and a DFU request installs the staged image. Linked with
+ * usbd_conf_posix.c (build: see there) the link is the USB CDC transport instead, and
+ * --dfuse has an emulated dfu-util write app.bin to the update slot over USB DFU.
+ * The BCB is process RAM: it survives vPlatReset(), which starts vBootloader() over,
+ * and vPlatJump() ends the run, exit code 0, the slot base on stderr.
+ * --cut-erase=n cuts the power in the n-th sector erase of the process, the upper half
+ * of the sector reads erased, the lower half still holds the old data, --cut-write=n
+ * cuts it before the n-th flash write, exit code 3 either way.
+ * This file also stands in for the clock, the UART, the CRC unit and the trace, marks
+ * are stamped with CLOCK_MONOTONIC and listed with --trace.
+ *
+ * Flash timing model, STM32F412 datasheet (DS10314) flash characteristics at
+ * 2.7 ~ 3.6 V, typical figures or the maximum ones with --flash-max. Nothing waits,
+ * the time the target would take is added up per boot and printed with the run:
+ *   erase      by sector size and parallelism
+ *   program    one operation per access the way flash_if.c splits a write, tprog
+ *              does not depend on PSIZE so x8 costs 4 times x32
+ * The parallelism is the one flash_if.h picks, x32 for the 3.3 V of the board, add
+ * -DVDD_VALUE=1800 (mV) or -DFLASH_IF_VPP=1 to the build to model another supply.
+ *   verify     the read back misses the ART after a flush, every 128-bit line costs
+ *              1 + wait states cycles on top of the compare loop, at CLOCK_FAST_HZ
+ *   link       UART bytes at 115200 8N1 (--baud), 10 bits a byte
+ * The predicted update time is the erase, then the download or the programming,
+ * whichever is slower: the pipeline in bootloader.c overlaps the two.
+ **/
+#ifndef VDD_VALUE
+#define VDD_VALUE           3300        // stm32f4xx_hal_conf.h
+#endif
+
+#include "platform.h"
+#include "checksum.h"
+#include "clock.h"
+#include "flash_if.h"
+#include "spl.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HOST_FLASH_BASE     0x08000000
+#define HOST_FLASH_SIZE     0x00080000
+#define HOST_BOOTS_MAX      8           // resets before giving up, DFU keeps failing
+
+#define HOST_FLASH_WS       3           // wait states at CLOCK_FAST_HZ, clock.c
+#define HOST_FLASH_LINE     16          // bytes per flash read
+#define HOST_CMP_CYCLES     5           // compare loop per word, ldr ldr cmp bne add
+#define HOST_BAUD           115200
+
+typedef enum {
+    HOST_PSIZE_X8,
+    HOST_PSIZE_X16,
+    HOST_PSIZE_X32,
+    HOST_PSIZE_X64,
+    HOST_PSIZE_COUNT,
+} HostPsize_t;
+
+typedef struct {
+    uint32_t ulEraseMs[3][HOST_PSIZE_COUNT];    // 16KB, 64KB, 128KB sector
+    uint32_t ulProgNs;                          // one program operation, any PSIZE
+} HostFlashTiming_t;
+
+// x64 (VPP) only has typical figures
+static const HostFlashTiming_t xHostTiming[] = {
+    { { { 400, 300, 250, 230 }, { 1200, 700, 550, 490 }, { 2000, 1300, 1000, 875 } }, 16000 },     // typ
+    { { { 800, 600, 500, 230 }, { 2400, 1400, 1100, 490 }, { 4000, 2600, 2000, 875 } }, 100000 },   // max
+};
+
+// PSIZE of an access of ulWidth bytes
+static HostPsize_t prvHostPsize(uint32_t ulWidth) {
+    return ulWidth == 8 ? HOST_PSIZE_X64 : ulWidth == 4 ? HOST_PSIZE_X32 : ulWidth == 2 ? HOST_PSIZE_X16 : HOST_PSIZE_X8;
+}
+
+typedef struct {
+    uint32_t ulBase;
+    uint32_t ulSize;
+} HostSector_t;
+
+// STM32F412xE, RM0402 table 5
+static const HostSector_t xHostSectors[] = {
+    { 0x08000000, 0x00004000 },
+    { 0x08004000, 0x00004000 },
+    { 0x08008000, 0x00004000 },
+    { 0x0800C000, 0x00004000 },
+    { 0x08010000, 0x00010000 },
+    { 0x08020000, 0x00020000 },
+    { 0x08040000, 0x00020000 },
+    { 0x08060000, 0x00020000 },
+};
+
+static volatile Bcb_t xHostBcb;
+static jmp_buf xHostBoot;
+static uint32_t ulHostBoots;
+bool xHostLink;                         // usbd_conf_posix.c enumerates only with a host
+const char *pcHostDfuSe;                // or for dfu-util writing this image
+static bool xHostTrace;
+static bool xHostUnlocked;
+static bool xHostError;
+static const HostFlashTiming_t *pxHostTiming = &xHostTiming[0];
+static uint32_t ulHostBaud = HOST_BAUD;
+static uint32_t ulHostBootsMax = HOST_BOOTS_MAX;    // not a local of main(), setjmp() returns there
+static uint32_t ulHostCutErase;         // power cut, 1 = first of the process, 0 = none
+static uint32_t ulHostCutWrite;
+static uint32_t ulHostErases;
+static uint32_t ulHostWrites;
+
+// Counters of one run, printed when it ends
+static uint32_t ulHostErased;
+static uint32_t ulHostProgrammed;
+static uint64_t ullHostEraseNs;
+static uint32_t ulHostOps[HOST_PSIZE_COUNT];
+static uint32_t ulHostVerified;         // bytes read back
+static uint32_t ulHostLinkRx;
+static uint32_t ulHostLinkTx;
+
+static uint64_t prvHostNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool prvHostInFlash(uint32_t ulAddr, uint32_t ulSize) {
+    return ulAddr >= HOST_FLASH_BASE && ulSize <= HOST_FLASH_SIZE && ulAddr - HOST_FLASH_BASE <= HOST_FLASH_SIZE - ulSize;
+}
+
+/* Trace, one boot only **/
+typedef struct {
+    uint64_t ullNs;
+    uint8_t ucPhase;
+    uint16_t usArg;
+} HostMark_t;
+
+static const char *const pcHostPhase[] = {
+    "", "reset", "hal_init", "clock_config", "gpio_init", "clock_fast", "chksum_init", "slot_select",
+    "dfu_start", "dfu_erase", "dfu_download", "dfu_commit", "dfu_done", "boot_attempt", "clock_reset", "jump",
+};
+
+static HostMark_t xHostMark[TRACE_ENTRIES];
+static uint32_t ulHostMarks;
+
+void vTraceInit(void) {
+    ulHostMarks = 0;
+    vTraceMark(TRACE_RESET, (uint16_t)ulHostBoots);
+}
+
+void vTraceMark(TracePhase_t xPhase, uint16_t usArg) {
+    if (ulHostMarks < TRACE_ENTRIES) {
+        xHostMark[ulHostMarks++] = (HostMark_t){ prvHostNs(), (uint8_t)xPhase, usArg };
+    }
+}
+
+static void prvHostReport(const char *pcEnd) {
+    if (xHostTrace) {
+        for (uint32_t i = 1; i < ulHostMarks; i++) {
+            uint8_t phase = xHostMark[i].ucPhase;
+            fprintf(stderr, "  %-14s %12.1f us  arg %u\n", phase <= TRACE_JUMP ? pcHostPhase[phase] : "?",
+                    (xHostMark[i].ullNs - xHostMark[i - 1].ullNs) / 1000.0, xHostMark[i].usArg);
+        }
+    }
+    fprintf(stderr, "boot %u: %s, erased %u sectors, programmed %u bytes\n", ulHostBoots, pcEnd,
+            ulHostErased, ulHostProgrammed);
+    // a boot that only counted itself in a trailer has nothing to model
+    if (ulHostErased == 0 && ulHostLinkRx == 0) {
+        return;
+    }
+    uint32_t ops = ulHostOps[HOST_PSIZE_X8] + ulHostOps[HOST_PSIZE_X16] + ulHostOps[HOST_PSIZE_X32] + ulHostOps[HOST_PSIZE_X64];
+    double erase = ullHostEraseNs / 1e6;
+    double program = (double)ops * pxHostTiming->ulProgNs / 1e6;
+    double cycles = (double)(ulHostVerified + HOST_FLASH_LINE - 1) / HOST_FLASH_LINE * (1 + HOST_FLASH_WS) +
+                    (double)ulHostVerified / sizeof(uint32_t) * HOST_CMP_CYCLES;
+    double verify = cycles * 1e3 / CLOCK_FAST_HZ;
+    double rx = ulHostLinkRx * 10e3 / ulHostBaud;
+    double tx = ulHostLinkTx * 10e3 / ulHostBaud;
+    double link = rx > tx ? rx : tx;
+    double flash = program + verify;
+    fprintf(stderr, "  model %s x%u: erase %.1f ms, program %.1f ms (x8 %u, x16 %u, x32 %u, x64 %u ops), verify %.2f ms\n",
+            pxHostTiming == &xHostTiming[0] ? "typ" : "max", FLASH_IF_WIDTH * 8, erase, program,
+            ulHostOps[HOST_PSIZE_X8], ulHostOps[HOST_PSIZE_X16], ulHostOps[HOST_PSIZE_X32], ulHostOps[HOST_PSIZE_X64], verify);
+    // the DFU went over USB (usbd_conf_posix.c), bus time is printed at exit
+    if (ulHostLinkRx || ulHostLinkTx) {
+        fprintf(stderr, "  link %u baud: rx %u bytes %.1f ms, tx %u bytes %.1f ms\n", ulHostBaud,
+                ulHostLinkRx, rx, ulHostLinkTx, tx);
+    }
+    fprintf(stderr, "  predicted %.1f ms, %s bound\n", erase + (link > flash ? link : flash),
+            link > flash ? "link" : "flash");
+}
+
+// Power lost, nothing else reaches the flash file
+static void prvHostCut(const char *pcWhere) {
+    fprintf(stderr, "boot %u: power cut %s\n", ulHostBoots, pcWhere);
+    _exit(3);
+}
+
+/* platform.h **/
+volatile Bcb_t *pxPlatBcb(void) {
+    return &xHostBcb;
+}
+
+void vPlatFlashFlush(void) {
+}
+
+void vPlatReset(void) {
+    prvHostReport("reset");
+    longjmp(xHostBoot, 1);
+}
+
+void vPlatJump(uint32_t ulVectorTabAddr) {
+    vTraceMark(TRACE_JUMP, 0);
+    char end[32];
+    snprintf(end, sizeof(end), "jump 0x%08x", ulVectorTabAddr);
+    prvHostReport(end);
+    exit(0);
+}
+
+/* flash_if.h, same contract as flash_if.c **/
+bool xFlashIfBegin(void) {
+    xHostUnlocked = true;
+    xHostError = false;
+    return true;
+}
+
+bool xFlashIfWrite(uint32_t ulAddr, const void *pvSrc, uint32_t ulSize) {
+    if (xHostUnlocked == false || prvHostInFlash(ulAddr, ulSize) == false) {
+        xHostError = true;
+        return false;
+    }
+    if (++ulHostWrites == ulHostCutWrite) {
+        prvHostCut("before a write");
+    }
+    uint8_t *dst = (uint8_t *)(uintptr_t)ulAddr;
+    const uint8_t *src = pvSrc;
+    for (uint32_t i = 0; i < ulSize; i++) {
+        dst[i] &= src[i];
+    }
+    ulHostProgrammed += ulSize;
+
+    // operations as flash_if.c issues them, widest the alignment and the rest allow
+    while (ulSize) {
+        uint32_t w = FLASH_IF_WIDTH;
+        while (w > 1 && ((ulAddr & (w - 1)) || ulSize < w)) {
+            w >>= 1;
+        }
+        ulHostOps[prvHostPsize(w)]++;
+        ulAddr += w;
+        ulSize -= w;
+    }
+    return true;
+}
+
+bool xFlashIfEnd(void) {
+    xHostUnlocked = false;
+    return xHostError == false;
+}
+
+bool xFlashIfErase(uint32_t ulSector) {
+    if (ulSector >= sizeof(xHostSectors) / sizeof(xHostSectors[0])) {
+        return false;
+    }
+    const HostSector_t *sector = &xHostSectors[ulSector];
+    if (++ulHostErases == ulHostCutErase) {
+        memset((void *)(uintptr_t)(sector->ulBase + sector->ulSize / 2), 0xFF, sector->ulSize / 2);
+        prvHostCut("in an erase");
+    }
+    memset((void *)(uintptr_t)sector->ulBase, 0xFF, sector->ulSize);
+    ulHostErased++;
+    uint32_t size = sector->ulSize == 0x4000 ? 0 : sector->ulSize == 0x10000 ? 1 : 2;
+    ullHostEraseNs += pxHostTiming->ulEraseMs[size][prvHostPsize(FLASH_IF_WIDTH)] * 1000000ULL;
+    return true;
+}
+
+uint32_t ulFlashIfCompare(uint32_t ulAddr, const void *pvSrc, uint32_t ulSize) {
+    const uint8_t *flash = (const uint8_t *)(uintptr_t)ulAddr;
+    const uint8_t *src = pvSrc;
+    uint32_t off = 0;
+    while (off < ulSize && flash[off] == src[off]) {
+        off++;
+    }
+    ulHostVerified += off < ulSize ? off + 1 : ulSize;
+    return off;
+}
+
+bool xFlashIfVerify(uint32_t ulAddr, const void *pvSrc, uint32_t ulSize, uint32_t *pulBad) {
+    for (int pass = 0; ; pass++) {
+        uint32_t off = ulFlashIfCompare(ulAddr, pvSrc, ulSize);
+        if (off == ulSize) {
+            return true;
+        }
+        off &= ~(sizeof(uint32_t) - 1);
+        if (pass == FLASH_IF_VERIFY_RETRY) {
+            if (pulBad) {
+                *pulBad = ulAddr + off;
+            }
+            return false;
+        }
+        xFlashIfWrite(ulAddr + off, (const uint8_t *)pvSrc + off, ulSize - off);
+    }
+}
+
+/* clock.h, checksum.h: nothing to switch, CRC32 runs on the software model **/
+bool xClockFast(void) {
+    return true;
+}
+
+bool xClockUsb(void) {
+    return true;
+}
+
+void vClockReset(void) {
+}
+
+const ChkSumEngine_t *pxChkSumHwInit(void) {
+    return NULL;
+}
+
+/* spl.h, the UART is stdin / stdout **/
+static bool prvHostWrite(const uint8_t *pucBuf, uint32_t ulLen) {
+    while (ulLen) {
+        ssize_t n = write(STDOUT_FILENO, pucBuf, ulLen);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        pucBuf += n;
+        ulLen -= (uint32_t)n;
+        ulHostLinkTx += (uint32_t)n;
+    }
+    return true;
+}
+
+static uint32_t prvHostRead(uint8_t *pucBuf, uint32_t ulLen) {
+    // non-blocking like the UART ring, the core polls and runs its idle hook meanwhile
+    struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    if (poll(&pfd, 1, 0) <= 0 || (pfd.revents & (POLLIN | POLLHUP)) == 0) {
+        return 0;
+    }
+    ssize_t n = read(STDIN_FILENO, pucBuf, ulLen);
+    if (n <= 0) {
+        return 0;
+    }
+    ulHostLinkRx += (uint32_t)n;
+    return (uint32_t)n;
+}
+
+static uint32_t prvHostGetTick(void) {
+    return (uint32_t)(prvHostNs() / 1000000);
+}
+
+// write() returns once the bytes are in the pipe, nothing to flush
+static const SplPort_t xHostPort = {
+    .pxWrite = prvHostWrite,
+    .pxRead = prvHostRead,
+    .pxGetTick = prvHostGetTick,
+    .pxFlush = NULL,
+};
+
+const SplPort_t *pxSplUartInit(void) {
+    return xHostLink ? &xHostPort : NULL;
+}
+
+// No USB unless spl_usb.c and usbd_conf_posix.c are linked in
+__attribute__((weak)) const SplPort_t *pxSplUsbInit(uint32_t ulDfuBase, uint32_t ulDfuSize) {
+    (void)ulDfuBase;
+    (void)ulDfuSize;
+    return NULL;
+}
+
+__attribute__((weak)) bool xSplUsbDfuStaged(void) {
+    return false;
+}
+
+static bool prvHostMapFlash(const char *pcPath) {
+    int fd = open(pcPath, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(pcPath);
+        return false;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size < HOST_FLASH_SIZE) {
+        // new or short file, the rest reads erased
+        static uint8_t erased[4096];
+        memset(erased, 0xFF, sizeof(erased));
+        while (size < HOST_FLASH_SIZE) {
+            size_t len = (size_t)(HOST_FLASH_SIZE - size);
+            if (len > sizeof(erased)) {
+                len = sizeof(erased);
+            }
+            if (pwrite(fd, erased, len, size) != (ssize_t)len) {
+                perror(pcPath);
+                close(fd);
+                return false;
+            }
+            size += len;
+        }
+    }
+#ifdef MAP_FIXED_NOREPLACE
+    int flags = MAP_SHARED | MAP_FIXED_NOREPLACE;
+#else
+    int flags = MAP_SHARED | MAP_FIXED;
+#endif
+    void *map = mmap((void *)(uintptr_t)HOST_FLASH_BASE, HOST_FLASH_SIZE, PROT_READ | PROT_WRITE, flags, fd, 0);
+    close(fd);
+    if (map != (void *)(uintptr_t)HOST_FLASH_BASE) {
+        fprintf(stderr, "%s: can not map at 0x%08x\n", pcPath, HOST_FLASH_BASE);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    extern void vBootloader(void) __attribute__((noreturn));
+    const char *path = NULL;
+    unsigned len, chksum;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dfu") == 0) {
+            xHostBcb.ulMagic = BCB_DFU_MAGIC;
+        } else if (sscanf(argv[i], "--bcb=%i,%i", &len, &chksum) == 2) {
+            xHostBcb.ulMagic = BCB_DFU_MAGIC;
+            xHostBcb.usLen = (uint16_t)len;
+            xHostBcb.usChkSum = (uint16_t)chksum;
+        } else if (strcmp(argv[i], "--link") == 0) {
+            xHostLink = true;
+        } else if (strncmp(argv[i], "--dfuse=", 8) == 0 && argv[i][8] != 0) {
+            pcHostDfuSe = argv[i] + 8;
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            xHostTrace = true;
+        } else if (strcmp(argv[i], "--flash-max") == 0) {
+            pxHostTiming = &xHostTiming[1];
+        } else if (strncmp(argv[i], "--baud=", 7) == 0 && strtoul(argv[i] + 7, NULL, 0) != 0) {
+            ulHostBaud = (uint32_t)strtoul(argv[i] + 7, NULL, 0);
+        } else if (strncmp(argv[i], "--cut-erase=", 12) == 0) {
+            ulHostCutErase = (uint32_t)strtoul(argv[i] + 12, NULL, 0);
+        } else if (strncmp(argv[i], "--cut-write=", 12) == 0) {
+            ulHostCutWrite = (uint32_t)strtoul(argv[i] + 12, NULL, 0);
+        } else if (strncmp(argv[i], "--boots=", 8) == 0) {
+            ulHostBootsMax = (uint32_t)strtoul(argv[i] + 8, NULL, 0);
+        } else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if (path == NULL) {
+        fprintf(stderr, "usage: %s flash.bin [--dfu] [--bcb=len,crc16] [--link] [--trace] [--boots=n] "
+                "[--flash-max] [--baud=n] [--dfuse=app.bin] [--cut-erase=n] [--cut-write=n]\n", argv[0]);
+        return 1;
+    }
+    if (prvHostMapFlash(path) == false) {
+        return 1;
+    }
+
+    // a reset comes back here, flash and BCB stay as they are
+    setjmp(xHostBoot);
+    if (ulHostBoots++ == ulHostBootsMax) {
+        fprintf(stderr, "no jump after %u boots\n", ulHostBootsMax);
+        return 2;
+    }
+    ulHostErased = 0;
+    ulHostProgrammed = 0;
+    ullHostEraseNs = 0;
+    memset(ulHostOps, 0, sizeof(ulHostOps));
+    ulHostVerified = 0;
+    ulHostLinkRx = 0;
+    ulHostLinkTx = 0;
+    vTraceInit();
+    vBootloader();
+}
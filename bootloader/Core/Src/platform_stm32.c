@@ -0,0 +1,98 @@
+#include "main.h"
+#include "stm32f412rx.h"
+#include "cmsis_armcc.h"
+#include "platform.h"
+#include "trace.h"
+
+/* STM32F412 backend of platform.h
+ *
+ * The BCB sits in IRAM2 of the Keil project (NoInit) next to the boot trace.
+ **/
+
+#define BCB             ((volatile Bcb_t *)BCB_BASE)
+
+volatile Bcb_t *pxPlatBcb(void) {
+    return BCB;
+}
+
+void vPlatFlashFlush(void) {
+    FLASH_FlushCaches();
+}
+
+void vPlatReset(void) {
+    HAL_NVIC_SystemReset();
+    for (;;) {
+    }
+}
+
+// Cycles from main() to the branch into the application
+__weak void vBootHandOffHook(uint32_t ulCycles) {
+    (void)ulCycles;
+}
+
+// Undo only what the boot path turned on, HAL_DeInit() resets every bus
+static void prvHandOffTeardown(void) {
+    const uint32_t ahb1 = RCC_AHB1ENR_GPIOAEN | RCC_AHB1ENR_GPIOCEN | RCC_AHB1ENR_GPIOHEN | RCC_AHB1ENR_CRCEN | RCC_AHB1ENR_DMA2EN;
+
+    SysTick->CTRL = 0;
+    SysTick->LOAD = 0;
+    SysTick->VAL = 0;
+    SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk;
+
+    // every irq line off and not pending, 32 at a time
+    for (int i = 0; i <= FMPI2C1_ER_IRQn / 32; i++) {
+        NVIC->ICER[i] = 0xFFFFFFFF;
+        NVIC->ICPR[i] = 0xFFFFFFFF;
+    }
+
+    RCC->AHB1RSTR = ahb1;
+    RCC->AHB1RSTR = 0;
+    RCC->AHB1ENR &= ~ahb1;
+    RCC->APB1RSTR = RCC_APB1RSTR_PWRRST;
+    RCC->APB1RSTR = 0;
+    RCC->APB1ENR &= ~RCC_APB1ENR_PWREN;
+    RCC->APB2RSTR = RCC_APB2RSTR_SYSCFGRST;
+    RCC->APB2RSTR = 0;
+    RCC->APB2ENR &= ~RCC_APB2ENR_SYSCFGEN;
+
+    // ART off and flushed, latency is 0 since vClockReset()
+    FLASH->ACR &= ~(FLASH_ACR_PRFTEN | FLASH_ACR_ICEN | FLASH_ACR_DCEN);
+    FLASH->ACR |= FLASH_ACR_ICRST | FLASH_ACR_DCRST;
+    FLASH->ACR &= ~(FLASH_ACR_ICRST | FLASH_ACR_DCRST);
+}
+
+/* As out of reset: stack from the vector table, interrupts enabled (all lines are off).
+ * Stack pointer and entry come in r0 / r1, nothing is read from the old stack once MSP
+ * is switched, a C local of the caller could be (at -O0).
+ **/
+#if defined(__CC_ARM)
+static __asm void prvBootEnter(uint32_t ulStack, uint32_t ulEntry) {
+    MSR     MSP, r0
+    CPSIE   i
+    BX      r1
+}
+#else
+__attribute__((naked, noreturn)) static void prvBootEnter(uint32_t ulStack, uint32_t ulEntry) {
+    __asm volatile (
+        "msr    msp, r0 \n"
+        "cpsie  i       \n"
+        "bx     r1      \n"
+    );
+}
+#endif
+
+void vPlatJump(uint32_t ulVectorTabAddr) {
+    const uint32_t *vectors = (const uint32_t *)ulVectorTabAddr;
+
+    __disable_irq();
+    prvHandOffTeardown();
+    vTraceMark(TRACE_JUMP, 0);
+    vBootHandOffHook(DWT->CYCCNT);
+
+    SCB->VTOR = ulVectorTabAddr;
+    __DSB();
+    __ISB();
+    prvBootEnter(vectors[0], vectors[1]);
+    for (;;) {
+    }
+}
@@ -0,0 +1,323 @@
+#include "slot.h"
+#include "checksum.h"
+#include <stddef.h>
+
+/* Slot selection, no HAL access here: flash is read through the memory map and
+ * written through the SlotProgram_t callback only.
+ **/
+
+#define IMG_ERASED_WORD     0xFFFFFFFF
+#define IMG_BYTE_UNUSED     0xFF
+#define IMG_BYTE_USED       0x00
+
+static const ImageHeader_t *prvSlotTrailer(const Slot_t *pxSlot, int lIndex) {
+    return (const ImageHeader_t *)(pxSlot->ulBase + pxSlot->ulSize - IMG_TRAILER_AREA + lIndex * IMG_TRAILER_SIZE);
+}
+
+const ImageHeader_t *pxSlotHeader(const Slot_t *pxSlot) {
+    int i = 0;
+    while (i < IMG_TRAILER_COUNT - 1 && prvSlotTrailer(pxSlot, i)->ulMagic == IMG_MAGIC_RETIRED) {
+        i++;
+    }
+    return prvSlotTrailer(pxSlot, i);
+}
+
+uint32_t ulSlotCapacity(const Slot_t *pxSlot) {
+    return pxSlot->ulSize - IMG_TRAILER_AREA;
+}
+
+static bool prvSlotTrailerBlank(const ImageHeader_t *pxHdr) {
+    const uint32_t *word = (const uint32_t *)pxHdr;
+    for (uint32_t i = 0; i < IMG_TRAILER_SIZE / sizeof(uint32_t); i++) {
+        if (word[i] != IMG_ERASED_WORD) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool prvSlotSignatureValid(const Slot_t *pxSlot) {
+    return *(uint32_t *)(pxSlot->ulBase + IMG_SIGNATURE_OFFSET) == IMG_SIGNATURE_VALUE;
+}
+
+const AppHeader_t *pxSlotAppHeader(const Slot_t *pxSlot) {
+    const AppHeader_t *app = (const AppHeader_t *)(pxSlot->ulBase + IMG_HDR_OFFSET);
+
+    if (app->ulMagic != IMG_HDR_MAGIC || app->usHdrVersion < IMG_HDR_VERSION) {
+        return NULL;
+    }
+    if (app->usHdrSize < sizeof(AppHeader_t) || (app->usHdrSize & 3) != 0) {
+        return NULL;
+    }
+    if (xChkSumAlgValid(app->ucChkAlg) == false || ulChkSumCalc(app->ucChkAlg, app, offsetof(AppHeader_t, ulHdrChkSum)) != app->ulHdrChkSum) {
+        return NULL;
+    }
+    if (app->ulLength < (uint32_t)IMG_HDR_OFFSET + app->usHdrSize || app->ulLength > ulSlotCapacity(pxSlot)) {
+        return NULL;
+    }
+    // blocks cover the image behind the header exactly
+    uint32_t body = app->ulLength - IMG_HDR_OFFSET - app->usHdrSize;
+    if (app->usBlockCount == 0 || app->usBlockCount > IMG_HDR_BLOCKS || app->ulBlockSize == 0 || (app->ulBlockSize & 3) != 0) {
+        return NULL;
+    }
+    if (body > app->usBlockCount * app->ulBlockSize || body <= (app->usBlockCount - 1) * app->ulBlockSize) {
+        return NULL;
+    }
+    return app;
+}
+
+static uint32_t prvSlotBlockSize(const AppHeader_t *pxApp, uint32_t ulBlock) {
+    uint32_t body = pxApp->ulLength - IMG_HDR_OFFSET - pxApp->usHdrSize;
+    uint32_t start = ulBlock * pxApp->ulBlockSize;
+    return body - start < pxApp->ulBlockSize ? body - start : pxApp->ulBlockSize;
+}
+
+// Vector table, block table against ulChkSum, and one block
+static bool prvSlotBlockValid(const Slot_t *pxSlot, const AppHeader_t *pxApp, uint32_t ulBlock) {
+    uint8_t alg = pxApp->ucChkAlg;
+    uint32_t crc = ulChkSumCalc(alg, (void *)pxSlot->ulBase, IMG_HDR_OFFSET);
+    for (uint32_t i = 0; i < pxApp->usBlockCount; i++) {
+        crc = ulChkSumCombine(alg, crc, pxApp->ulBlockChkSum[i], prvSlotBlockSize(pxApp, i));
+    }
+    if (crc != pxApp->ulChkSum) {
+        return false;
+    }
+    uint32_t addr = pxSlot->ulBase + IMG_HDR_OFFSET + pxApp->usHdrSize + ulBlock * pxApp->ulBlockSize;
+    return ulChkSumCalc(alg, (void *)addr, prvSlotBlockSize(pxApp, ulBlock)) == pxApp->ulBlockChkSum[ulBlock];
+}
+
+// Checksum of the image around its header
+bool xSlotAppImageValid(const Slot_t *pxSlot, const AppHeader_t *pxApp) {
+    const uint8_t *image = (const uint8_t *)pxSlot->ulBase;
+    uint32_t skip = IMG_HDR_OFFSET + pxApp->usHdrSize;
+    uint32_t crc = ulChkSumInit(pxApp->ucChkAlg);
+    crc = ulChkSumUpdate(pxApp->ucChkAlg, crc, image, IMG_HDR_OFFSET);
+    crc = ulChkSumUpdate(pxApp->ucChkAlg, crc, image + skip, pxApp->ulLength - skip);
+    return ulChkSumFinal(pxApp->ucChkAlg, crc) == pxApp->ulChkSum;
+}
+
+static bool prvSlotIsCached(const ImageHeader_t *pxHdr, const AppHeader_t *pxApp) {
+    if (pxApp == NULL || (pxApp->ucFlags & IMG_HDR_FLAG_NO_CACHE) || pxApp->ulHdrChkSum == IMG_ERASED_WORD) {
+        return false;
+    }
+    return pxHdr->ulVerified == pxApp->ulHdrChkSum;
+}
+
+// Remember a passed full check, a word holding the tag of an older image stays as is
+static void prvSlotCache(const ImageHeader_t *pxHdr, const AppHeader_t *pxApp, SlotProgram_t pxProgram) {
+    if (pxProgram == NULL || pxApp == NULL || (pxApp->ucFlags & IMG_HDR_FLAG_NO_CACHE)) {
+        return;
+    }
+    if (pxHdr->ulVerified == IMG_ERASED_WORD) {
+        uint32_t tag = pxApp->ulHdrChkSum;
+        pxProgram((uint32_t)&pxHdr->ulVerified, &tag, sizeof(tag));
+    }
+}
+
+static uint32_t prvSlotCheckCount(const ImageHeader_t *pxHdr) {
+    uint32_t count = 0;
+    for (int i = 0; i < IMG_CHECK_LOG_SIZE && pxHdr->ucCheckLog[i] != IMG_BYTE_UNUSED; i++) {
+        for (uint8_t used = ~pxHdr->ucCheckLog[i]; used; used >>= 1) {
+            count += used & 1;
+        }
+    }
+    return count;
+}
+
+// One more 0 bit in the first byte that has a 1 left, no erase needed
+static void prvSlotCheckCountUp(const ImageHeader_t *pxHdr, SlotProgram_t pxProgram) {
+    for (int i = 0; i < IMG_CHECK_LOG_SIZE; i++) {
+        if (pxHdr->ucCheckLog[i] != IMG_BYTE_USED) {
+            uint8_t log = (uint8_t)(pxHdr->ucCheckLog[i] << 1);
+            pxProgram((uint32_t)&pxHdr->ucCheckLog[i], &log, sizeof(log));
+            return;
+        }
+    }
+}
+
+// Check 0 is the one that verified the image, then one block per check, then a full one
+int lSlotCheckPlan(uint32_t ulCount, uint32_t ulBlocks) {
+    if (ulBlocks == 0 || ulCount >= IMG_CHECK_LOG_SIZE * 8) {
+        return -1;
+    }
+    uint32_t cursor = ulCount % (ulBlocks + 1);
+    return cursor == 0 ? -1 : (int)(cursor - 1);
+}
+
+static bool prvSlotFullValid(const Slot_t *pxSlot, const ImageHeader_t *pxHdr, const AppHeader_t *pxApp) {
+    if (pxHdr->ulMagic == IMG_ERASED_WORD) {
+        return xSlotAppImageValid(pxSlot, pxApp);
+    }
+    return xChkSumAlgValid(pxHdr->ucChkAlg) && ulChkSumCalc(pxHdr->ucChkAlg, (void *)pxSlot->ulBase, pxHdr->ulLength) == pxHdr->ulChkSum;
+}
+
+// Full or partial check as the policy asks, counted in the trailer once it passed
+static bool prvSlotCheck(const Slot_t *pxSlot, const ImageHeader_t *pxHdr, const AppHeader_t *pxApp, SlotProgram_t pxProgram) {
+    int block = -1;
+    if (prvSlotIsCached(pxHdr, pxApp)) {
+        block = lSlotCheckPlan(prvSlotCheckCount(pxHdr), pxApp->usBlockCount);
+    }
+    if (block < 0) {
+        if (prvSlotFullValid(pxSlot, pxHdr, pxApp) == false) {
+            return false;
+        }
+        prvSlotCache(pxHdr, pxApp, pxProgram);
+    } else if (prvSlotBlockValid(pxSlot, pxApp, block) == false) {
+        return false;
+    }
+    if (pxProgram != NULL && prvSlotIsCached(pxHdr, pxApp)) {
+        prvSlotCheckCountUp(pxHdr, pxProgram);
+    }
+    return true;
+}
+
+static int prvSlotAttemptsLeft(const ImageHeader_t *pxHdr) {
+    int left = 0;
+    for (int i = 0; i < IMG_BOOT_ATTEMPTS; i++) {
+        if (pxHdr->ucAttempt[i] == IMG_BYTE_UNUSED) {
+            left++;
+        }
+    }
+    return left;
+}
+
+bool xSlotIsBootable(const Slot_t *pxSlot, uint32_t *pulVersion, SlotProgram_t pxProgram) {
+    const ImageHeader_t *hdr = pxSlotHeader(pxSlot);
+    const AppHeader_t *app = pxSlotAppHeader(pxSlot);
+
+    if (prvSlotSignatureValid(pxSlot) == false) {
+        return false;
+    }
+    // image must be linked for this slot, with or without a trailer
+    uint32_t reset = ((uint32_t *)pxSlot->ulBase)[1];
+    if (reset < pxSlot->ulBase || reset - pxSlot->ulBase >= ulSlotCapacity(pxSlot)) {
+        return false;
+    }
+    if (app != NULL && app->ulLoadAddr != pxSlot->ulBase) {
+        return false;
+    }
+    if (hdr->ulMagic == IMG_ERASED_WORD) {
+        // a retired trailer before it, the update did not finish
+        if (hdr != prvSlotTrailer(pxSlot, 0)) {
+            return false;
+        }
+        // image installed before A/B slots or by a programmer, only its own header to check
+        if (app != NULL && prvSlotCheck(pxSlot, hdr, app, pxProgram) == false) {
+            return false;
+        }
+        *pulVersion = 0;
+        return true;
+    }
+    if (hdr->ulMagic != IMG_MAGIC) {
+        return false;
+    }
+    if (hdr->ulLength < IMG_MIN_SIZE || hdr->ulLength > ulSlotCapacity(pxSlot)) {
+        return false;
+    }
+    if (app != NULL && app->ulLength != hdr->ulLength) {
+        return false;
+    }
+    // and its reset handler inside the image
+    if (reset >= pxSlot->ulBase + hdr->ulLength) {
+        return false;
+    }
+    // not confirmed by the application and out of attempts, roll back
+    if (hdr->ucConfirmed != IMG_BYTE_USED && prvSlotAttemptsLeft(hdr) == 0) {
+        return false;
+    }
+    if (prvSlotCheck(pxSlot, hdr, app, pxProgram) == false) {
+        return false;
+    }
+    *pulVersion = hdr->ulVersion;
+    return true;
+}
+
+// Order of a slot from its trailer alone, -1 if it cannot boot: a committed image by its
+// version, above an image without a trailer
+static int64_t prvSlotRank(const Slot_t *pxSlot) {
+    const ImageHeader_t *hdr = pxSlotHeader(pxSlot);
+    if (hdr->ulMagic == IMG_MAGIC) {
+        return ((int64_t)1 << 32) | hdr->ulVersion;
+    }
+    if (hdr->ulMagic == IMG_ERASED_WORD && hdr == prvSlotTrailer(pxSlot, 0)) {
+        return 0;
+    }
+    return -1;
+}
+
+// Newest bootable slot, -1 if none. An image without a trailer loses to any committed one,
+// ties go to the later slot, slot B held the application before A/B slots. Slots are
+// checked newest first and the first that passes is taken, a boot checks one image only
+// as long as the newest is good.
+int lSlotSelect(const Slot_t *pxSlots, int lCount, SlotProgram_t pxProgram) {
+    uint32_t tried = 0;
+    for (;;) {
+        int select = -1;
+        int64_t select_rank = -1;
+        for (int i = 0; i < lCount && i < 32; i++) {
+            int64_t rank = prvSlotRank(&pxSlots[i]);
+            if ((tried & (1UL << i)) == 0 && rank >= 0 && rank >= select_rank) {
+                select = i;
+                select_rank = rank;
+            }
+        }
+        if (select < 0) {
+            return -1;
+        }
+        uint32_t version;
+        if (xSlotIsBootable(&pxSlots[select], &version, pxProgram)) {
+            return select;
+        }
+        tried |= 1UL << select;
+    }
+}
+
+bool xSlotCommit(const Slot_t *pxSlot, uint32_t ulVersion, uint32_t ulLength, uint32_t ulChkSum, uint8_t ucChkAlg, SlotProgram_t pxProgram) {
+    uint32_t addr = (uint32_t)pxSlotHeader(pxSlot);
+    uint32_t fields[] = { ulVersion, ulLength, ulChkSum };
+    uint32_t magic = IMG_MAGIC;
+
+    if (pxSlotHeader(pxSlot)->ulMagic != IMG_ERASED_WORD) {
+        return false;
+    }
+    if (pxProgram(addr + offsetof(ImageHeader_t, ulVersion), fields, sizeof(fields)) == false) {
+        return false;
+    }
+    if (pxProgram(addr + offsetof(ImageHeader_t, ucChkAlg), &ucChkAlg, sizeof(ucChkAlg)) == false) {
+        return false;
+    }
+    return pxProgram(addr + offsetof(ImageHeader_t, ulMagic), &magic, sizeof(magic));
+}
+
+// A trailer with a torn commit in it is retired as well, the next commit needs a blank one
+bool xSlotRetire(const Slot_t *pxSlot, SlotProgram_t pxProgram) {
+    const uint32_t retired = IMG_MAGIC_RETIRED;
+    const ImageHeader_t *hdr = pxSlotHeader(pxSlot);
+
+    while (prvSlotTrailerBlank(hdr) == false) {
+        if (hdr->ulMagic != IMG_MAGIC_RETIRED) {
+            pxProgram((uint32_t)&hdr->ulMagic, &retired, sizeof(retired));
+        }
+        if (hdr->ulMagic != IMG_MAGIC_RETIRED || hdr == prvSlotTrailer(pxSlot, IMG_TRAILER_COUNT - 1)) {
+            return false;
+        }
+        hdr = pxSlotHeader(pxSlot);
+    }
+    return true;
+}
+
+// Burn one attempt before booting an image the application did not confirm yet
+bool xSlotBootAttempt(const Slot_t *pxSlot, SlotProgram_t pxProgram) {
+    const ImageHeader_t *hdr = pxSlotHeader(pxSlot);
+    const uint8_t used = IMG_BYTE_USED;
+
+    if (hdr->ulMagic != IMG_MAGIC || hdr->ucConfirmed == IMG_BYTE_USED) {
+        return true;
+    }
+    for (int i = 0; i < IMG_BOOT_ATTEMPTS; i++) {
+        if (hdr->ucAttempt[i] == IMG_BYTE_UNUSED) {
+            return pxProgram((uint32_t)&hdr->ucAttempt[i], &used, sizeof(used));
+        }
+    }
+    return false;
+}
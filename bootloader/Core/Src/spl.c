@@ -0,0 +1,260 @@
+#include "spl.h"
+#include "crc16.h"
+#include <string.h>
+
+/* Serial Protocol Layer
+ *
+ * Framing: see spl.h, frames are parsed from a byte stream, bad frames are dropped
+ * silently and the parser resyncs on the next preamble.
+ *
+ * Segment stream (sliding window, receiver side):
+ *   - receiver grants credits by ACK(seq = base, window = w), the sender may have
+ *     segments [base, base + w - 1) in flight, one slot stays with the consumer
+ *   - every segment carries its own sequence number, segments ahead of a hole are
+ *     kept in their slot and only the missing ones are NAKed
+ *   - a segment is ACKed as soon as it is in order, before it is handed to the
+ *     consumer, so the sender keeps streaming while the consumer programs flash
+ **/
+
+#define SPL_FRAME_OVERHEAD  (2 + 2 + 2) // preamble + size + chksum
+
+typedef enum {
+    SPL_ST_PREAMBLE_LO,
+    SPL_ST_PREAMBLE_HI,
+    SPL_ST_SIZE_LO,
+    SPL_ST_SIZE_HI,
+    SPL_ST_PAYLOAD,
+    SPL_ST_CHKSUM_LO,
+    SPL_ST_CHKSUM_HI,
+} SplState_t;
+
+static const SplPort_t *pxSplPort;
+static void (*pxSplIdle)(void);
+
+// Receive, [payload size] [payload]
+static SplState_t xSplState;
+static uint16_t usSplRxSize;
+static uint16_t usSplRxCnt;
+static uint16_t usSplRxChkSum;
+static uint8_t ucSplRxBuf[2 + SPL_HDR_SIZE + SPL_DATA_MAX_SIZE];
+static uint8_t ucSplChunk[64];
+static uint32_t ulSplChunkHead;
+static uint32_t ulSplChunkTail;
+
+// Transmit, whole frame
+static uint8_t ucSplTxBuf[SPL_FRAME_OVERHEAD + SPL_HDR_SIZE + SPL_DATA_MAX_SIZE];
+
+// Window slots
+static uint8_t ucSplSlot[SPL_WINDOW_MAX][SPL_DATA_MAX_SIZE];
+static uint16_t usSplSlotLen[SPL_WINDOW_MAX];
+
+static void prvPut16(uint8_t *pucBuf, uint16_t usVal) {
+    pucBuf[0] = (uint8_t)usVal;
+    pucBuf[1] = (uint8_t)(usVal >> 8);
+}
+
+static uint16_t prvGet16(const uint8_t *pucBuf) {
+    return (uint16_t)(pucBuf[0] | (pucBuf[1] << 8));
+}
+
+static void prvSplReset(void) {
+    xSplState = SPL_ST_PREAMBLE_LO;
+    ulSplChunkHead = 0;
+    ulSplChunkTail = 0;
+}
+
+// Feed one byte, return true when a good frame is in ucSplRxBuf
+static bool prvSplParse(uint8_t ucByte) {
+    switch (xSplState) {
+    case SPL_ST_PREAMBLE_LO:
+        if (ucByte == (uint8_t)SPL_PREAMBLE) {
+            xSplState = SPL_ST_PREAMBLE_HI;
+        }
+        break;
+    case SPL_ST_PREAMBLE_HI:
+        if (ucByte == (uint8_t)(SPL_PREAMBLE >> 8)) {
+            xSplState = SPL_ST_SIZE_LO;
+        } else if (ucByte != (uint8_t)SPL_PREAMBLE) {
+            xSplState = SPL_ST_PREAMBLE_LO;
+        }
+        break;
+    case SPL_ST_SIZE_LO:
+        ucSplRxBuf[0] = ucByte;
+        xSplState = SPL_ST_SIZE_HI;
+        break;
+    case SPL_ST_SIZE_HI:
+        ucSplRxBuf[1] = ucByte;
+        usSplRxSize = prvGet16(ucSplRxBuf);
+        usSplRxCnt = 0;
+        if (usSplRxSize < SPL_HDR_SIZE || usSplRxSize > SPL_HDR_SIZE + SPL_DATA_MAX_SIZE) {
+            xSplState = SPL_ST_PREAMBLE_LO;
+        } else {
+            xSplState = SPL_ST_PAYLOAD;
+        }
+        break;
+    case SPL_ST_PAYLOAD:
+        ucSplRxBuf[2 + usSplRxCnt++] = ucByte;
+        if (usSplRxCnt == usSplRxSize) {
+            xSplState = SPL_ST_CHKSUM_LO;
+        }
+        break;
+    case SPL_ST_CHKSUM_LO:
+        usSplRxChkSum = ucByte;
+        xSplState = SPL_ST_CHKSUM_HI;
+        break;
+    case SPL_ST_CHKSUM_HI:
+        usSplRxChkSum |= (uint16_t)(ucByte << 8);
+        xSplState = SPL_ST_PREAMBLE_LO;
+        return CRC16(ucSplRxBuf, 2 + usSplRxSize) == usSplRxChkSum;
+    }
+    return false;
+}
+
+void vSplInit(const SplPort_t *pxPort) {
+    pxSplPort = pxPort;
+    pxSplIdle = NULL;
+    prvSplReset();
+}
+
+void vSplSetIdleHook(void (*pxIdle)(void)) {
+    pxSplIdle = pxIdle;
+}
+
+bool xSplSend(uint16_t usCmd, uint16_t usSeq, const void *pvData, uint16_t usLen) {
+    if (usLen > SPL_DATA_MAX_SIZE) {
+        return false;
+    }
+    uint16_t usSize = SPL_HDR_SIZE + usLen;
+    prvPut16(&ucSplTxBuf[0], SPL_PREAMBLE);
+    prvPut16(&ucSplTxBuf[2], usSize);
+    prvPut16(&ucSplTxBuf[4], usCmd);
+    prvPut16(&ucSplTxBuf[6], usSeq);
+    if (usLen) {
+        memcpy(&ucSplTxBuf[8], pvData, usLen);
+    }
+    prvPut16(&ucSplTxBuf[4 + usSize], CRC16(&ucSplTxBuf[2], 2 + usSize));
+    return pxSplPort->pxWrite(ucSplTxBuf, SPL_FRAME_OVERHEAD + usSize);
+}
+
+bool xSplFlush(void) {
+    if (pxSplPort->pxFlush == NULL) {
+        return true;
+    }
+    return pxSplPort->pxFlush();
+}
+
+bool xSplRecv(SplFrame_t *pxFrame, uint32_t ulTimeout) {
+    uint32_t ulStart = pxSplPort->pxGetTick();
+    for (;;) {
+        if (ulSplChunkHead == ulSplChunkTail) {
+            ulSplChunkHead = 0;
+            ulSplChunkTail = pxSplPort->pxRead(ucSplChunk, sizeof(ucSplChunk));
+            if (ulSplChunkTail == 0) {
+                if (pxSplPort->pxGetTick() - ulStart >= ulTimeout) {
+                    return false;
+                }
+                if (pxSplIdle) {
+                    pxSplIdle();
+                }
+                continue;
+            }
+        }
+        if (prvSplParse(ucSplChunk[ulSplChunkHead++])) {
+            pxFrame->usCmd = prvGet16(&ucSplRxBuf[2]);
+            pxFrame->usSeq = prvGet16(&ucSplRxBuf[4]);
+            pxFrame->usLen = usSplRxSize - SPL_HDR_SIZE;
+            pxFrame->pucData = &ucSplRxBuf[2 + SPL_HDR_SIZE];
+            return true;
+        }
+    }
+}
+
+// Lock-step request, resend until a response with the same cmd arrives
+bool xSplRequest(uint16_t usCmd, const void *pvReq, uint16_t usReqLen, SplFrame_t *pxRsp) {
+    for (int i = 0; i < SPL_RETRY_MAX; i++) {
+        if (xSplSend(usCmd, 0, pvReq, usReqLen) == false) {
+            return false;
+        }
+        uint32_t ulStart = pxSplPort->pxGetTick();
+        uint32_t ulElapsed = 0;
+        while (ulElapsed < SPL_TIMEOUT) {
+            if (xSplRecv(pxRsp, SPL_TIMEOUT - ulElapsed) && pxRsp->usCmd == usCmd) {
+                return true;
+            }
+            ulElapsed = pxSplPort->pxGetTick() - ulStart;
+        }
+    }
+    return false;
+}
+
+static bool prvSplAck(uint16_t usBase, uint8_t ucWindow) {
+    return xSplSend(SPL_CMD_ACK, usBase, &ucWindow, sizeof(ucWindow));
+}
+
+static bool prvSplNak(uint16_t usSeq) {
+    return xSplSend(SPL_CMD_NAK, usSeq, NULL, 0);
+}
+
+bool xSplWindowRecv(uint16_t usCmd, uint16_t usFirst, uint16_t usSegCount, uint8_t ucWindow, SplSegmentCb_t pxOnSegment, void *pvCtx) {
+    SplFrame_t xFrame;
+    uint16_t usBase = usFirst;  // next segment to hand to the consumer
+    uint32_t ulValid = 0;       // slot holds a segment
+    uint32_t ulNaked = 0;       // slot already NAKed
+    int retry = 0;
+
+    if (ucWindow < 2 || ucWindow > SPL_WINDOW_MAX) {
+        return false;
+    }
+    if (prvSplAck(usBase, ucWindow) == false) {
+        return false;
+    }
+    while (usBase < usSegCount) {
+        if (xSplRecv(&xFrame, SPL_TIMEOUT) == false) {
+            if (++retry > SPL_RETRY_MAX) {
+                return false;
+            }
+            // lost the tail of the window, ask for the oldest hole again
+            prvSplNak(usBase);
+            ulNaked = 1UL << (usBase % ucWindow);
+            continue;
+        }
+        if (xFrame.usCmd != usCmd || xFrame.usLen == 0) {
+            continue;
+        }
+        uint16_t usOffset = xFrame.usSeq - usBase;
+        if (usOffset >= ucWindow - 1 || xFrame.usSeq >= usSegCount) {
+            // duplicate of a delivered segment, the ACK got lost
+            if ((uint16_t)(usBase - xFrame.usSeq) <= ucWindow) {
+                prvSplAck(usBase, ucWindow);
+            }
+            continue;
+        }
+        retry = 0;
+        uint32_t ulSlot = xFrame.usSeq % ucWindow;
+        memcpy(ucSplSlot[ulSlot], xFrame.pucData, xFrame.usLen);
+        usSplSlotLen[ulSlot] = xFrame.usLen;
+        ulValid |= 1UL << ulSlot;
+        ulNaked &= ~(1UL << ulSlot);
+
+        // selective NAK, holes in front of this segment
+        for (uint16_t usSeq = usBase; usSeq != xFrame.usSeq; usSeq++) {
+            uint32_t ulMask = 1UL << (usSeq % ucWindow);
+            if ((ulValid & ulMask) == 0 && (ulNaked & ulMask) == 0) {
+                prvSplNak(usSeq);
+                ulNaked |= ulMask;
+            }
+        }
+
+        // hand over in order, ACK first so the sender refills the window meanwhile
+        while (usBase < usSegCount && (ulValid & (1UL << (usBase % ucWindow)))) {
+            uint32_t ulMask = 1UL << (usBase % ucWindow);
+            uint16_t usSeq = usBase++;
+            prvSplAck(usBase, ucWindow);
+            if (pxOnSegment(usSeq, ucSplSlot[usSeq % ucWindow], usSplSlotLen[usSeq % ucWindow], pvCtx) == false) {
+                return false;
+            }
+            ulValid &= ~ulMask;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,58 @@
+#include "main.h"
+#include "spl.h"
+
+/* SPL over USART2 (PA2 TX, PA3 RX)
+ *
+ * RX runs on DMA1 stream 5 in circular mode into a ring, so bytes keep landing
+ * while the CPU is stalled by flash program/erase, TX is blocking.
+ **/
+
+#define SPL_UART_BAUDRATE   115200
+#define SPL_UART_RX_SIZE    4096
+
+UART_HandleTypeDef huart2;
+DMA_HandleTypeDef hdma_usart2_rx;
+
+static uint8_t ucUartRxRing[SPL_UART_RX_SIZE];
+static uint32_t ulUartRxTail;
+
+static bool prvUartWrite(const uint8_t *pucBuf, uint32_t ulLen) {
+    return HAL_UART_Transmit(&huart2, pucBuf, ulLen, SPL_TIMEOUT) == HAL_OK;
+}
+
+static uint32_t prvUartRead(uint8_t *pucBuf, uint32_t ulLen) {
+    uint32_t ulHead = (SPL_UART_RX_SIZE - __HAL_DMA_GET_COUNTER(&hdma_usart2_rx)) % SPL_UART_RX_SIZE;
+    uint32_t cnt = 0;
+    while (ulUartRxTail != ulHead && cnt < ulLen) {
+        pucBuf[cnt++] = ucUartRxRing[ulUartRxTail];
+        ulUartRxTail = (ulUartRxTail + 1) % SPL_UART_RX_SIZE;
+    }
+    return cnt;
+}
+
+static const SplPort_t xUartPort = {
+    .pxWrite = prvUartWrite,
+    .pxRead = prvUartRead,
+    .pxGetTick = HAL_GetTick,
+};
+
+const SplPort_t *pxSplUartInit(void) {
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    huart2.Instance = USART2;
+    huart2.Init.BaudRate = SPL_UART_BAUDRATE;
+    huart2.Init.WordLength = UART_WORDLENGTH_8B;
+    huart2.Init.StopBits = UART_STOPBITS_1;
+    huart2.Init.Parity = UART_PARITY_NONE;
+    huart2.Init.Mode = UART_MODE_TX_RX;
+    huart2.Init.HwFlowCtl = UART_HWCONTROL_NONE;
+    huart2.Init.OverSampling = UART_OVERSAMPLING_16;
+    if (HAL_UART_Init(&huart2) != HAL_OK) {
+        return NULL;
+    }
+    ulUartRxTail = 0;
+    if (HAL_UART_Receive_DMA(&huart2, ucUartRxRing, SPL_UART_RX_SIZE) != HAL_OK) {
+        return NULL;
+    }
+    return &xUartPort;
+}
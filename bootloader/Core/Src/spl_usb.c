@@ -0,0 +1,233 @@
+#include "clock.h"
+#include "spl.h"
+#include "usbd_cdc.h"
+#include "usbd_composite.h"
+#include "usbd_core.h"
+#include "usbd_desc.h"
+#include "usbd_dfu_if.h"
+
+/* SPL over USB full speed, a CDC-ACM function on the OTG FS core (usbd_conf.c)
+ *
+ * The class receives straight into a ring of 512 byte slots (USBD_CDC_SetRxRing()),
+ * the OUT endpoint is armed for a whole slot and the Receive() callback (OTG irq)
+ * comes once a slot is full or a short packet ends the host's write, it only notes
+ * the length. prvUsbRead() copies out of the slots and gives them back, the tail of
+ * a write that ended on a full packet is read from the slot still being filled.
+ * With every slot taken the endpoint stays NAKing until one is given back, so nothing
+ * is lost while the CPU is stalled by flash program/erase, the host just waits.
+ * TX goes through the class queue (USBD_CDC_SetTxQueue()), prvUsbWrite() returns once
+ * the frame is queued and the class chains transfers from the IN completion, frames
+ * written while one is in flight go out together. A transfer ending on a full packet
+ * gets its ZLP from the class, prvUsbFlush() waits for all of it before a reset.
+ * Line coding means nothing here, the host only has to open the port (DTR), bytes
+ * written before are dropped like on a UART nobody listens to.
+ *
+ * The device is a composite (usbd_composite.c), next to the CDC function sits a DfuSe
+ * interface on the update slot, so dfu-util can write an image there instead. While
+ * waiting for the port this thread runs USBD_DFU_Process(): the class takes DNLOAD
+ * blocks in the OTG irq, the erase and program happen here, the next block comes in
+ * while the last one is programmed. Every DFU request restarts the wait, a session
+ * ends when dfu-util leaves (manifest) with every block programmed, the device goes
+ * off the bus and the image is installed like one the application staged. Once the
+ * port is open SPL owns the slot, the DFU interface stalls every request.
+ **/
+
+#define SPL_USB_SLOT_SIZE       512     // 8 FS packets, half an SPL segment
+#define SPL_USB_SLOT_COUNT      8
+#define SPL_USB_TX_SIZE         2048    // a full segment frame and the ACKs behind it
+#define SPL_USB_ENUM_TIMEOUT    1000    // ms, pull-up to SET_CONFIGURATION
+#define SPL_USB_OPEN_TIMEOUT    5000    // ms, then to DTR
+
+USBD_HandleTypeDef hUsbDeviceFS;
+
+static uint32_t ulUsbCdcArena[(USBD_CDC_ARENA_SIZE + 3) / 4];
+static uint32_t ulUsbDfuArena[(USBD_DFU_ARENA_SIZE + 3) / 4];
+static bool xUsbDfuStaged;
+static uint32_t ulUsbRxRing[SPL_USB_SLOT_COUNT][SPL_USB_SLOT_SIZE / 4];  // word aligned slots
+static volatile uint32_t ulUsbRxLen[SPL_USB_SLOT_COUNT];
+static volatile uint32_t ulUsbRxDone;   // irq, slots received
+static uint32_t ulUsbRxTaken;           // thread, slots read and given back
+static uint32_t ulUsbRxOffset;          // thread, read position in slot ulUsbRxTaken
+static uint8_t ucUsbTxQueue[SPL_USB_TX_SIZE];
+static volatile bool xUsbDtr;
+static uint8_t ucUsbLineCoding[7] = { 0x00, 0xC2, 0x01, 0x00, 0x00, 0x00, 0x08 };  // 115200 8N1
+
+/* USBD_CDC_ItfTypeDef, called from the OTG irq **/
+static int8_t prvCdcInit(void) {
+    // new session, what the last one left is stale
+    USBD_CDC_SetTxBuffer(&hUsbDeviceFS, NULL, 0);
+    USBD_CDC_SetTxQueue(&hUsbDeviceFS, ucUsbTxQueue, sizeof(ucUsbTxQueue));
+    USBD_CDC_SetRxRing(&hUsbDeviceFS, (uint8_t *)ulUsbRxRing, SPL_USB_SLOT_SIZE, SPL_USB_SLOT_COUNT);
+    ulUsbRxDone = 0;
+    ulUsbRxTaken = 0;
+    ulUsbRxOffset = 0;
+    return USBD_OK;
+}
+
+static int8_t prvCdcDeInit(void) {
+    xUsbDtr = false;
+    return USBD_OK;
+}
+
+static int8_t prvCdcControl(uint8_t cmd, uint8_t *pbuf, uint16_t length) {
+    switch (cmd) {
+    case CDC_SET_LINE_CODING:
+        memcpy(ucUsbLineCoding, pbuf, MIN(length, sizeof(ucUsbLineCoding)));
+        break;
+    case CDC_GET_LINE_CODING:
+        memcpy(pbuf, ucUsbLineCoding, MIN(length, sizeof(ucUsbLineCoding)));
+        break;
+    case CDC_SET_CONTROL_LINE_STATE:
+        // no data stage, pbuf is the setup packet
+        xUsbDtr = (((USBD_SetupReqTypedef *)pbuf)->wValue & 0x0001) != 0;
+        break;
+    default:
+        break;
+    }
+    return USBD_OK;
+}
+
+static int8_t prvCdcReceive(uint8_t *Buf, uint32_t *Len) {
+    (void)Buf;  // the slot after the last one
+    ulUsbRxLen[ulUsbRxDone % SPL_USB_SLOT_COUNT] = *Len;
+    ulUsbRxDone++;
+    return USBD_OK;
+}
+
+static USBD_CDC_ItfTypeDef xCdcItf = {
+    prvCdcInit,
+    prvCdcDeInit,
+    prvCdcControl,
+    prvCdcReceive,
+    NULL,
+};
+
+/* SplPort_t, the irq is masked while the thread calls into the stack **/
+static bool prvUsbWrite(const uint8_t *pucBuf, uint32_t ulLen) {
+    if (hUsbDeviceFS.dev_state != USBD_STATE_CONFIGURED || hUsbDeviceFS.pClassData == NULL) {
+        return false;
+    }
+    if (xUsbDtr == false) {
+        return true;
+    }
+
+    // copied into the queue, only waits while the queue is full
+    uint32_t start = HAL_GetTick();
+    while (ulLen) {
+        HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+        uint32_t n = USBD_CDC_Queue(&hUsbDeviceFS, pucBuf, ulLen);
+        HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+        pucBuf += n;
+        ulLen -= n;
+        if (n) {
+            start = HAL_GetTick();
+        } else if (HAL_GetTick() - start >= SPL_TIMEOUT || hUsbDeviceFS.dev_state != USBD_STATE_CONFIGURED) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool prvUsbFlush(void) {
+    USBD_CDC_HandleTypeDef *hcdc = hUsbDeviceFS.pClassData;
+    uint32_t start = HAL_GetTick();
+    while (hUsbDeviceFS.dev_state == USBD_STATE_CONFIGURED && hcdc != NULL && hcdc->TxState) {
+        if (HAL_GetTick() - start >= SPL_TIMEOUT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t prvUsbRead(uint8_t *pucBuf, uint32_t ulLen) {
+    uint32_t cnt = 0;
+    while (cnt < ulLen) {
+        uint32_t slot = ulUsbRxTaken % SPL_USB_SLOT_COUNT;
+        const uint8_t *data = (const uint8_t *)ulUsbRxRing[slot];
+        uint32_t avail;
+        bool done = ulUsbRxDone != ulUsbRxTaken;
+
+        if (done) {
+            avail = ulUsbRxLen[slot];
+        } else {
+            // every slot given back, this is the one being filled
+            HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+            done = ulUsbRxDone != ulUsbRxTaken;
+            avail = done ? ulUsbRxLen[slot] : USBD_CDC_GetRxPending(&hUsbDeviceFS);
+            HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+        }
+        uint32_t n = MIN(avail - ulUsbRxOffset, ulLen - cnt);
+        memcpy(&pucBuf[cnt], &data[ulUsbRxOffset], n);
+        cnt += n;
+        ulUsbRxOffset += n;
+        if (done == false || ulUsbRxOffset < avail) {
+            break;
+        }
+        ulUsbRxOffset = 0;
+        ulUsbRxTaken++;
+        HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+        USBD_CDC_ReleaseRxSlot(&hUsbDeviceFS);
+        HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+    }
+    return cnt;
+}
+
+static const SplPort_t xUsbPort = {
+    .pxWrite = prvUsbWrite,
+    .pxRead = prvUsbRead,
+    .pxGetTick = HAL_GetTick,
+    .pxFlush = prvUsbFlush,
+};
+
+bool xSplUsbDfuStaged(void) {
+    return xUsbDfuStaged;
+}
+
+const SplPort_t *pxSplUsbInit(uint32_t ulDfuBase, uint32_t ulDfuSize) {
+    ulUsbRxDone = 0;
+    ulUsbRxTaken = 0;
+    ulUsbRxOffset = 0;
+    xUsbDtr = false;
+    xUsbDfuStaged = false;
+    if (xClockUsb() == false) {
+        return NULL;
+    }
+    if (USBD_Init(&hUsbDeviceFS, &FS_Desc, DEVICE_FS) != USBD_OK) {
+        return NULL;
+    }
+    // a slot that is not whole sectors gets no DFU memory, the interface stalls
+    if (USBD_RegisterClass(&hUsbDeviceFS, &USBD_Composite) == USBD_OK &&
+        USBD_CDC_RegisterInterface(&hUsbDeviceFS, &xCdcItf) == USBD_OK &&
+        USBD_CDC_RegisterArena(ulUsbCdcArena, sizeof(ulUsbCdcArena)) == USBD_OK &&
+        USBD_DFU_RegisterArena(ulUsbDfuArena, sizeof(ulUsbDfuArena)) == USBD_OK &&
+        USBD_DFU_RegisterMedia(&hUsbDeviceFS, pxDfuIfInit(ulDfuBase, ulDfuSize)) == USBD_OK &&
+        USBD_Start(&hUsbDeviceFS) == USBD_OK) {
+        // enumerated by a host, then opened by the tool on it or written by dfu-util
+        uint32_t start = HAL_GetTick();
+        while (hUsbDeviceFS.dev_state != USBD_STATE_CONFIGURED && HAL_GetTick() - start < SPL_USB_ENUM_TIMEOUT) {
+        }
+        start = HAL_GetTick();
+        uint32_t requests = USBD_DFU_GetRequestCount(&hUsbDeviceFS);
+        while (hUsbDeviceFS.dev_state == USBD_STATE_CONFIGURED && xUsbDtr == false && HAL_GetTick() - start < SPL_USB_OPEN_TIMEOUT) {
+            USBD_DFU_Process(&hUsbDeviceFS);
+            if (USBD_DFU_IsManifested(&hUsbDeviceFS)) {
+                xUsbDfuStaged = true;
+                break;
+            }
+            if (USBD_DFU_GetRequestCount(&hUsbDeviceFS) != requests) {
+                requests = USBD_DFU_GetRequestCount(&hUsbDeviceFS);
+                start = HAL_GetTick();
+            }
+        }
+        if (xUsbDfuStaged == false && hUsbDeviceFS.dev_state == USBD_STATE_CONFIGURED && xUsbDtr) {
+            // blocks still queued are dropped, SPL erases the slot anyway
+            HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+            USBD_DFU_RegisterMedia(&hUsbDeviceFS, NULL);
+            HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+            return &xUsbPort;
+        }
+    }
+    // no host, pull-up off and the core back in reset for the next transport
+    USBD_DeInit(&hUsbDeviceFS);
+    return NULL;
+}
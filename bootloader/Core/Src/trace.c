@@ -0,0 +1,39 @@
+#include "main.h"
+#include "trace.h"
+
+/* Boot trace
+ *
+ * The block is addressed like the BCB, IRAM2 of the Keil project (NoInit) covers it so
+ * the linker keeps out. A bad magic means the RAM lost power, the ring starts over.
+ * A mark is a handful of stores, no interrupt masking: marks come from thread mode only.
+ **/
+
+#define TRACE   ((Trace_t *)TRACE_BASE)
+
+void vTraceInit(void) {
+    Trace_t *trace = TRACE;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    if (trace->ulMagic != TRACE_MAGIC) {
+        trace->ulMagic = TRACE_MAGIC;
+        trace->ulBoot = 0;
+        trace->ulHead = 0;
+        trace->ulReserved = 0;
+    }
+    trace->ulBoot++;
+    vTraceMark(TRACE_RESET, (uint16_t)trace->ulBoot);
+}
+
+void vTraceMark(TracePhase_t xPhase, uint16_t usArg) {
+    Trace_t *trace = TRACE;
+    TraceEntry_t *entry = &trace->xEntry[trace->ulHead % TRACE_ENTRIES];
+
+    entry->ulCycles = DWT->CYCCNT;
+    entry->ucPhase = (uint8_t)xPhase;
+    entry->ucMHz = (uint8_t)(SystemCoreClock / 1000000);
+    entry->usArg = usArg;
+    trace->ulHead++;
+}
@@ -0,0 +1,131 @@
+#include "usbd_cdc.h"
+#include "usbd_composite.h"
+#include "usbd_dfu.h"
+
+/* CDC + DFU on one device
+ *
+ * Requests to the DFU interface go to USBD_DFU, everything else (the CDC interfaces,
+ * the bulk endpoints) to USBD_CDC. The data stage of a control transfer completes in
+ * the class its setup went to. USBD_CDC keeps its data in pClassData / pUserData,
+ * USBD_DFU in its own statics, so the two share the handle.
+ **/
+
+__ALIGN_BEGIN static uint8_t ucCompositeCfgDesc[USBD_COMPOSITE_CONFIG_DESC_SIZ] __ALIGN_END = {
+    0x09, USB_DESC_TYPE_CONFIGURATION,
+    LOBYTE(USBD_COMPOSITE_CONFIG_DESC_SIZ), HIBYTE(USBD_COMPOSITE_CONFIG_DESC_SIZ),
+    0x03,                               // bNumInterfaces
+    0x01,                               // bConfigurationValue
+    0x00,
+#if (USBD_SELF_POWERED == 1U)
+    0xC0,
+#else
+    0x80,
+#endif
+    USBD_MAX_POWER,
+
+    // IAD, binds the two CDC interfaces into one function
+    0x08, USB_DESC_TYPE_IAD,
+    0x00,                               // bFirstInterface
+    0x02,                               // bInterfaceCount
+    0x02, 0x02, 0x01,                   // CDC, ACM, AT commands
+    0x00,
+
+    // CDC communication interface
+    0x09, USB_DESC_TYPE_INTERFACE, 0x00, 0x00, 0x01, 0x02, 0x02, 0x01, 0x00,
+    0x05, 0x24, 0x00, 0x10, 0x01,       // header, CDC 1.10
+    0x05, 0x24, 0x01, 0x00, 0x01,       // call management, data interface 1
+    0x04, 0x24, 0x02, 0x02,             // ACM, line coding and state
+    0x05, 0x24, 0x06, 0x00, 0x01,       // union, 0 master, 1 slave
+    0x07, USB_DESC_TYPE_ENDPOINT, CDC_CMD_EP, 0x03,
+    LOBYTE(CDC_CMD_PACKET_SIZE), HIBYTE(CDC_CMD_PACKET_SIZE), CDC_FS_BINTERVAL,
+
+    // CDC data interface
+    0x09, USB_DESC_TYPE_INTERFACE, 0x01, 0x00, 0x02, 0x0A, 0x00, 0x00, 0x00,
+    0x07, USB_DESC_TYPE_ENDPOINT, CDC_OUT_EP, 0x02,
+    LOBYTE(CDC_DATA_FS_MAX_PACKET_SIZE), HIBYTE(CDC_DATA_FS_MAX_PACKET_SIZE), 0x00,
+    0x07, USB_DESC_TYPE_ENDPOINT, CDC_IN_EP, 0x02,
+    LOBYTE(CDC_DATA_FS_MAX_PACKET_SIZE), HIBYTE(CDC_DATA_FS_MAX_PACKET_SIZE), 0x00,
+
+    // DFU interface, DFU mode, no endpoints
+    0x09, USB_DESC_TYPE_INTERFACE, USBD_DFU_INTERFACE, 0x00, 0x00, 0xFE, 0x01, 0x02, USBD_DFU_STR_INDEX,
+    USB_DFU_DESC_SIZ, DFU_DESCRIPTOR_TYPE, USBD_DFU_ATTRIBUTES,
+    LOBYTE(USBD_DFU_DETACH_TIMEOUT), HIBYTE(USBD_DFU_DETACH_TIMEOUT),
+    LOBYTE(USBD_DFU_XFER_SIZE), HIBYTE(USBD_DFU_XFER_SIZE),
+    LOBYTE(USBD_DFU_BCD_VERSION), HIBYTE(USBD_DFU_BCD_VERSION),
+};
+
+static USBD_ClassTypeDef *pxCompositeEp0 = &USBD_CDC;   // class of the control transfer in progress
+
+static USBD_ClassTypeDef *prvClassOf(USBD_SetupReqTypedef *req) {
+    if ((req->bmRequest & USB_REQ_RECIPIENT_MASK) == USB_REQ_RECIPIENT_INTERFACE &&
+        LOBYTE(req->wIndex) == USBD_DFU_INTERFACE) {
+        return &USBD_DFU;
+    }
+    return &USBD_CDC;
+}
+
+static uint8_t prvInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx) {
+    uint8_t ret = USBD_CDC.Init(pdev, cfgidx);
+    if (ret != USBD_OK) {
+        return ret;
+    }
+    return USBD_DFU.Init(pdev, cfgidx);
+}
+
+static uint8_t prvDeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx) {
+    USBD_DFU.DeInit(pdev, cfgidx);
+    return USBD_CDC.DeInit(pdev, cfgidx);
+}
+
+static uint8_t prvSetup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req) {
+    pxCompositeEp0 = prvClassOf(req);
+    return pxCompositeEp0->Setup(pdev, req);
+}
+
+static uint8_t prvEp0TxSent(USBD_HandleTypeDef *pdev) {
+    return pxCompositeEp0->EP0_TxSent ? pxCompositeEp0->EP0_TxSent(pdev) : USBD_OK;
+}
+
+static uint8_t prvEp0RxReady(USBD_HandleTypeDef *pdev) {
+    return pxCompositeEp0->EP0_RxReady ? pxCompositeEp0->EP0_RxReady(pdev) : USBD_OK;
+}
+
+static uint8_t prvDataIn(USBD_HandleTypeDef *pdev, uint8_t epnum) {
+    return USBD_CDC.DataIn(pdev, epnum);
+}
+
+static uint8_t prvDataOut(USBD_HandleTypeDef *pdev, uint8_t epnum) {
+    return USBD_CDC.DataOut(pdev, epnum);
+}
+
+// Full speed only, the same descriptor for every speed query
+static uint8_t *prvCfgDesc(uint16_t *length) {
+    *length = sizeof(ucCompositeCfgDesc);
+    return ucCompositeCfgDesc;
+}
+
+static uint8_t *prvDeviceQualifierDesc(uint16_t *length) {
+    return USBD_CDC.GetDeviceQualifierDescriptor(length);
+}
+
+static uint8_t *prvUsrStrDesc(USBD_HandleTypeDef *pdev, uint8_t index, uint16_t *length) {
+    return USBD_DFU.GetUsrStrDescriptor(pdev, index, length);
+}
+
+USBD_ClassTypeDef USBD_Composite = {
+    prvInit,
+    prvDeInit,
+    prvSetup,
+    prvEp0TxSent,
+    prvEp0RxReady,
+    prvDataIn,
+    prvDataOut,
+    NULL,
+    NULL,
+    NULL,
+    prvCfgDesc,
+    prvCfgDesc,
+    prvCfgDesc,
+    prvDeviceQualifierDesc,
+    prvUsrStrDesc,
+};
@@ -0,0 +1,190 @@
+#include "main.h"
+#include "usbd_core.h"
+
+/* USBD_LL_* on the OTG FS core (PA11 DM, PA12 DP) through the HAL PCD driver
+ *
+ * Device only, no VBUS sensing: the pull-up goes on at USBD_Start(), a host that is
+ * there resets and enumerates the device, otherwise nothing happens (spl_usb.c times
+ * out). The 48 MHz comes from the PLL Q output, see xClockUsb().
+ * FIFO RAM is 320 words: RX 128, EP0 IN 64, EP1 IN (CDC data) 128. The CDC
+ * notification endpoint never sends, it gets none.
+ **/
+
+#define USBD_RX_FIFO_WORDS      0x80
+#define USBD_EP0_FIFO_WORDS     0x40
+#define USBD_EP1_FIFO_WORDS     0x80
+
+PCD_HandleTypeDef hpcd_USB_OTG_FS;
+
+static USBD_StatusTypeDef prvUsbdStatus(HAL_StatusTypeDef xStatus) {
+    switch (xStatus) {
+    case HAL_OK:
+        return USBD_OK;
+    case HAL_BUSY:
+        return USBD_BUSY;
+    default:
+        return USBD_FAIL;
+    }
+}
+
+/* HAL PCD, MSP and callbacks from HAL_PCD_IRQHandler() **/
+void HAL_PCD_MspInit(PCD_HandleTypeDef *hpcd) {
+    GPIO_InitTypeDef gpio = { 0 };
+
+    if (hpcd->Instance != USB_OTG_FS) {
+        return;
+    }
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    gpio.Pin = GPIO_PIN_11 | GPIO_PIN_12;
+    gpio.Mode = GPIO_MODE_AF_PP;
+    gpio.Pull = GPIO_NOPULL;
+    gpio.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    gpio.Alternate = GPIO_AF10_OTG_FS;
+    HAL_GPIO_Init(GPIOA, &gpio);
+
+    __HAL_RCC_USB_OTG_FS_CLK_ENABLE();
+    HAL_NVIC_SetPriority(OTG_FS_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+}
+
+void HAL_PCD_MspDeInit(PCD_HandleTypeDef *hpcd) {
+    if (hpcd->Instance != USB_OTG_FS) {
+        return;
+    }
+    HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+    __HAL_RCC_USB_OTG_FS_CLK_DISABLE();
+    HAL_GPIO_DeInit(GPIOA, GPIO_PIN_11 | GPIO_PIN_12);
+}
+
+void HAL_PCD_SetupStageCallback(PCD_HandleTypeDef *hpcd) {
+    USBD_LL_SetupStage(hpcd->pData, (uint8_t *)hpcd->Setup);
+}
+
+void HAL_PCD_DataOutStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum) {
+    USBD_LL_DataOutStage(hpcd->pData, epnum, hpcd->OUT_ep[epnum].xfer_buff);
+}
+
+void HAL_PCD_DataInStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum) {
+    USBD_LL_DataInStage(hpcd->pData, epnum, hpcd->IN_ep[epnum].xfer_buff);
+}
+
+void HAL_PCD_SOFCallback(PCD_HandleTypeDef *hpcd) {
+    USBD_LL_SOF(hpcd->pData);
+}
+
+void HAL_PCD_ResetCallback(PCD_HandleTypeDef *hpcd) {
+    USBD_LL_SetSpeed(hpcd->pData, USBD_SPEED_FULL);
+    USBD_LL_Reset(hpcd->pData);
+}
+
+void HAL_PCD_SuspendCallback(PCD_HandleTypeDef *hpcd) {
+    USBD_LL_Suspend(hpcd->pData);
+}
+
+void HAL_PCD_ResumeCallback(PCD_HandleTypeDef *hpcd) {
+    USBD_LL_Resume(hpcd->pData);
+}
+
+void HAL_PCD_ISOOUTIncompleteCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum) {
+    USBD_LL_IsoOUTIncomplete(hpcd->pData, epnum);
+}
+
+void HAL_PCD_ISOINIncompleteCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum) {
+    USBD_LL_IsoINIncomplete(hpcd->pData, epnum);
+}
+
+void HAL_PCD_ConnectCallback(PCD_HandleTypeDef *hpcd) {
+    USBD_LL_DevConnected(hpcd->pData);
+}
+
+void HAL_PCD_DisconnectCallback(PCD_HandleTypeDef *hpcd) {
+    USBD_LL_DevDisconnected(hpcd->pData);
+}
+
+/* usbd_core.h low level interface **/
+USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev) {
+    if (pdev->id != DEVICE_FS) {
+        return USBD_FAIL;
+    }
+    hpcd_USB_OTG_FS.pData = pdev;
+    pdev->pData = &hpcd_USB_OTG_FS;
+
+    hpcd_USB_OTG_FS.Instance = USB_OTG_FS;
+    hpcd_USB_OTG_FS.Init.dev_endpoints = 4;
+    hpcd_USB_OTG_FS.Init.speed = PCD_SPEED_FULL;
+    hpcd_USB_OTG_FS.Init.dma_enable = DISABLE;
+    hpcd_USB_OTG_FS.Init.phy_itface = PCD_PHY_EMBEDDED;
+    hpcd_USB_OTG_FS.Init.Sof_enable = DISABLE;
+    hpcd_USB_OTG_FS.Init.low_power_enable = DISABLE;
+    hpcd_USB_OTG_FS.Init.lpm_enable = DISABLE;
+    hpcd_USB_OTG_FS.Init.battery_charging_enable = DISABLE;
+    hpcd_USB_OTG_FS.Init.vbus_sensing_enable = DISABLE;
+    hpcd_USB_OTG_FS.Init.use_dedicated_ep1 = DISABLE;
+    if (HAL_PCD_Init(&hpcd_USB_OTG_FS) != HAL_OK) {
+        return USBD_FAIL;
+    }
+    HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_FS, USBD_RX_FIFO_WORDS);
+    HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 0, USBD_EP0_FIFO_WORDS);
+    HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 1, USBD_EP1_FIFO_WORDS);
+    return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_DeInit(USBD_HandleTypeDef *pdev) {
+    return prvUsbdStatus(HAL_PCD_DeInit(pdev->pData));
+}
+
+USBD_StatusTypeDef USBD_LL_Start(USBD_HandleTypeDef *pdev) {
+    return prvUsbdStatus(HAL_PCD_Start(pdev->pData));
+}
+
+USBD_StatusTypeDef USBD_LL_Stop(USBD_HandleTypeDef *pdev) {
+    return prvUsbdStatus(HAL_PCD_Stop(pdev->pData));
+}
+
+USBD_StatusTypeDef USBD_LL_OpenEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t ep_type, uint16_t ep_mps) {
+    return prvUsbdStatus(HAL_PCD_EP_Open(pdev->pData, ep_addr, ep_mps, ep_type));
+}
+
+USBD_StatusTypeDef USBD_LL_CloseEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+    return prvUsbdStatus(HAL_PCD_EP_Close(pdev->pData, ep_addr));
+}
+
+USBD_StatusTypeDef USBD_LL_FlushEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+    return prvUsbdStatus(HAL_PCD_EP_Flush(pdev->pData, ep_addr));
+}
+
+USBD_StatusTypeDef USBD_LL_StallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+    return prvUsbdStatus(HAL_PCD_EP_SetStall(pdev->pData, ep_addr));
+}
+
+USBD_StatusTypeDef USBD_LL_ClearStallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+    return prvUsbdStatus(HAL_PCD_EP_ClrStall(pdev->pData, ep_addr));
+}
+
+uint8_t USBD_LL_IsStallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+    PCD_HandleTypeDef *hpcd = pdev->pData;
+    if (ep_addr & 0x80) {
+        return hpcd->IN_ep[ep_addr & 0x7F].is_stall;
+    }
+    return hpcd->OUT_ep[ep_addr & 0x7F].is_stall;
+}
+
+USBD_StatusTypeDef USBD_LL_SetUSBAddress(USBD_HandleTypeDef *pdev, uint8_t dev_addr) {
+    return prvUsbdStatus(HAL_PCD_SetAddress(pdev->pData, dev_addr));
+}
+
+USBD_StatusTypeDef USBD_LL_Transmit(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *pbuf, uint32_t size) {
+    return prvUsbdStatus(HAL_PCD_EP_Transmit(pdev->pData, ep_addr, pbuf, size));
+}
+
+USBD_StatusTypeDef USBD_LL_PrepareReceive(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *pbuf, uint32_t size) {
+    return prvUsbdStatus(HAL_PCD_EP_Receive(pdev->pData, ep_addr, pbuf, size));
+}
+
+uint32_t USBD_LL_GetRxDataSize(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+    return HAL_PCD_EP_GetRxCount(pdev->pData, ep_addr);
+}
+
+void USBD_LL_Delay(uint32_t Delay) {
+    HAL_Delay(Delay);
+}
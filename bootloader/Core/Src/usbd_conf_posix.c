@@ -0,0 +1,697 @@
+/* Linux stand-in for usbd_conf.c, USBD_LL_* with the USB host played in process
+ *
+ *   cd bootloader/Core/Src
+ *   gcc -O2 -D_GNU_SOURCE -DUSBD_POSIX -Wno-int-to-pointer-cast -Wno-pointer-to-int-cast \
+ *       -I../Inc -I../../Middlewares/ST/STM32_USB_Device_Library/Core/Inc \
+ *       -I../../Middlewares/ST/STM32_USB_Device_Library/Class/CDC/Inc \
+ *       -I../../Middlewares/ST/STM32_USB_Device_Library/Class/DFU/Inc \
+ *       platform_posix.c bootloader.c slot.c journal.c spl.c checksum.c crc16.c lz4_stream.c \
+ *       delta.c spl_usb.c usbd_desc.c usbd_composite.c usbd_dfu_if.c usbd_conf_posix.c \
+ *       ../../Middlewares/ST/STM32_USB_Device_Library/Core/Src/usbd_core.c \
+ *       ../../Middlewares/ST/STM32_USB_Device_Library/Core/Src/usbd_ctlreq.c \
+ *       ../../Middlewares/ST/STM32_USB_Device_Library/Core/Src/usbd_ioreq.c \
+ *       ../../Middlewares/ST/STM32_USB_Device_Library/Class/CDC/Src/usbd_cdc.c \
+ *       ../../Middlewares/ST/STM32_USB_Device_Library/Class/DFU/Src/usbd_dfu.c -o boot_host_usb
+ *
+ * boot_host_usb takes the arguments of boot_host (platform_posix.c), with --link the
+ * DFU runs over spl_usb.c and the real stack: the host enumerates the device once it
+ * is started, opens the port (DTR) and moves the bulk data, OUT packets from stdin,
+ * IN transfers to stdout, so tools/dfu_sim.py drives it as it drives the UART build.
+ * Without --link nobody enumerates, pxSplUsbInit() times out to the UART.
+ *
+ * --dfuse=app.bin (with --dfu) makes the host dfu-util on the DfuSe interface instead,
+ * "dfu-util -a 0 -s <slot>:leave -D app.bin" for an image imgpack linked for the update
+ * slot: the address and the sectors come from the layout string, the sectors the image
+ * spans are erased, then a SET_ADDRESS and a DNLOAD per block, GETSTATUS after each
+ * until the device is no longer busy, waiting out bwPollTimeout in real time. The
+ * image is read back with UPLOAD (a stall while blocks are still programmed is cleared
+ * and the block asked again) and the host leaves with a zero length DNLOAD.
+ *
+ * The LL calls only note what the stack armed, the "irqs" run from HAL_GetTick(),
+ * the tick every wait loop of the device polls: enumeration as one burst, then once a
+ * millisecond a full speed frame of bulk packets, IN first, or of DFU control
+ * transfers. EP0 data goes a packet at a time either way like on the OTG core, a bulk
+ * OUT transfer takes packets until its length or a short packet, the class sees the
+ * same completions as on the target. The host counts the SPL frames the device sends
+ * per USB frame, or the DFU blocks and busy polls, printed at exit.
+ **/
+#include "spl.h"
+#include "usbd_core.h"
+#include "usbd_cdc.h"
+#include "usbd_composite.h"
+#include "usbd_dfu.h"
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HOST_UID_PAGE       0x1FFF7000
+#define HOST_EP_COUNT       4
+#define HOST_EP0_SIZE       64
+#define HOST_ADDRESS        5
+#define HOST_BULK_PER_FRAME 19          // 64 byte bulk packets in a 1 ms full speed frame
+#define HOST_DFU_GROUPS     4           // sector groups of a layout string
+
+typedef struct {
+    uint8_t *pucBuf;
+    uint32_t ulLen;
+    bool xArmed;
+    uint32_t ulCount;                   // OUT, bytes in so far (xfer_count)
+} HostEp_t;
+
+extern bool xHostLink;                  // platform_posix.c, a host is on stdin / stdout
+extern const char *pcHostDfuSe;         // platform_posix.c, image dfu-util writes
+
+typedef enum {
+    HOST_DFU_START,
+    HOST_DFU_ERASE,
+    HOST_DFU_DNLOAD,
+    HOST_DFU_REWIND,
+    HOST_DFU_UPLOAD,
+    HOST_DFU_LEAVE,
+    HOST_DFU_DONE,
+} HostDfuStep_t;
+
+typedef struct {
+    uint32_t ulCount;
+    uint32_t ulSize;
+} HostDfuGroup_t;
+
+static USBD_HandleTypeDef *pxHostDev;
+static PCD_HandleTypeDef xHostPcd;
+static HostEp_t xHostIn[HOST_EP_COUNT];
+static HostEp_t xHostOut[HOST_EP_COUNT];
+static uint32_t ulHostRxCount[HOST_EP_COUNT];
+static bool xHostEp0Stall;
+static bool xHostPullUp;
+static bool xHostEnumerated;
+static bool xHostInPump;
+
+// Bulk traffic of the run, printed at exit
+static uint32_t ulHostOutPackets;
+static uint32_t ulHostOutBytes;
+static uint32_t ulHostOutTransfers;    // completions the class saw
+static uint32_t ulHostInPackets;
+static uint32_t ulHostInBytes;
+static uint32_t ulHostInTransfers;
+static uint32_t ulHostInZlps;
+static uint32_t ulHostInMessages;       // SPL frames
+static uint32_t ulHostInFrames;         // USB frames with IN data
+static uint32_t ulHostInMaxMessages;    // SPL frames ended in one USB frame
+static uint32_t ulHostBulkFrames;       // USB frames with any bulk data
+
+// SPL framing of the IN stream, header bytes seen or bytes left of the frame
+static uint8_t ucHostSplHdr[4];
+static uint32_t ulHostSplHdrLen;
+static uint32_t ulHostSplLeft;
+
+// dfu-util, the DFU interface found in the configuration and where the session is
+static uint8_t ucHostDfuItf = 0xFF;
+static uint8_t ucHostDfuStr;
+static HostDfuStep_t xHostDfuStep;
+static uint8_t *pucHostDfuImage;
+static uint32_t ulHostDfuLen;
+static uint32_t ulHostDfuBase;
+static HostDfuGroup_t xHostDfuGroups[HOST_DFU_GROUPS];
+static uint32_t ulHostDfuOffset;        // image offset of the next erase / block
+static bool xHostDfuAddrSet;            // SET_ADDRESS of the step done
+static bool xHostDfuPoll;               // GETSTATUS due, the device was busy
+static uint32_t ulHostDfuWait;          // ms, bwPollTimeout from the last GETSTATUS
+static int32_t lHostDfuBudget;          // EP0 packets left in the frame
+
+static uint32_t ulHostDfuErased;
+static uint32_t ulHostDfuBlocks;
+static uint32_t ulHostDfuBusy;          // GETSTATUS answered dfuDNBUSY
+static uint32_t ulHostDfuStalls;        // UPLOAD stalled, blocks still being programmed
+static uint32_t ulHostDfuUpFrames;      // frames the read back took
+static uint32_t ulHostDfuDnFrames;      // frames from the first erase to the last block
+static bool xHostDfuOk;
+
+static void prvHostReport(void) {
+    if (pucHostDfuImage != NULL) {
+        fprintf(stderr, "dfuse: %s, %u bytes, %u sectors erased, %u blocks in %u frames, %u busy polls, "
+                "read back in %u frames, %u upload stalls\n", xHostDfuOk ? "done" : "failed", ulHostDfuLen,
+                ulHostDfuErased, ulHostDfuBlocks, ulHostDfuDnFrames, ulHostDfuBusy, ulHostDfuUpFrames, ulHostDfuStalls);
+    }
+    if (ulHostOutPackets + ulHostInPackets == 0) {
+        return;
+    }
+    fprintf(stderr, "usb: out %u packets %u bytes in %u transfers, in %u packets %u bytes in %u transfers (%u ZLP)\n",
+            ulHostOutPackets, ulHostOutBytes, ulHostOutTransfers,
+            ulHostInPackets, ulHostInBytes, ulHostInTransfers, ulHostInZlps);
+    fprintf(stderr, "usb: %u bulk frames, %u messages in %u frames, %.2f a frame, max %u\n",
+            ulHostBulkFrames, ulHostInMessages, ulHostInFrames,
+            ulHostInFrames ? (double)ulHostInMessages / ulHostInFrames : 0.0, ulHostInMaxMessages);
+}
+
+// SPL frames the bytes end
+static uint32_t prvHostSplCount(const uint8_t *pucBuf, uint32_t ulLen) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < ulLen; i++) {
+        if (ulHostSplLeft) {
+            if (--ulHostSplLeft == 0) {
+                count++;
+            }
+            continue;
+        }
+        ucHostSplHdr[ulHostSplHdrLen++] = pucBuf[i];
+        if ((ulHostSplHdrLen == 1 && pucBuf[i] != LOBYTE(SPL_PREAMBLE)) ||
+            (ulHostSplHdrLen == 2 && pucBuf[i] != HIBYTE(SPL_PREAMBLE))) {
+            ulHostSplHdrLen = 0;
+        } else if (ulHostSplHdrLen == 4) {
+            ulHostSplLeft = (ucHostSplHdr[2] | (ucHostSplHdr[3] << 8)) + 2;  // payload, check sum
+            ulHostSplHdrLen = 0;
+        }
+    }
+    return count;
+}
+
+static uint32_t prvHostMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/* Emulated host, control transfers on EP0 **/
+// Returns the bytes of the data stage, -1 if the device stalled the request
+static int prvHostControl(uint8_t ucType, uint8_t ucReq, uint16_t usValue, uint16_t usIndex, uint8_t *pucData, uint16_t usLen) {
+    uint8_t setup[8] = {
+        ucType, ucReq, LOBYTE(usValue), HIBYTE(usValue), LOBYTE(usIndex), HIBYTE(usIndex), LOBYTE(usLen), HIBYTE(usLen),
+    };
+    uint32_t got = 0;
+
+    xHostEp0Stall = false;
+    xHostIn[0].xArmed = false;
+    xHostOut[0].xArmed = false;
+    USBD_LL_SetupStage(pxHostDev, setup);
+    if (ucType & 0x80) {
+        // IN data, a packet per completion until the length asked or a short packet
+        while (xHostEp0Stall == false && xHostIn[0].xArmed && got < usLen) {
+            HostEp_t *ep = &xHostIn[0];
+            uint32_t n = MIN(MIN(ep->ulLen, HOST_EP0_SIZE), usLen - got);
+            memcpy(&pucData[got], ep->pucBuf, n);
+            got += n;
+            ep->xArmed = false;
+            USBD_LL_DataInStage(pxHostDev, 0, ep->pucBuf + n);
+            if (n < HOST_EP0_SIZE) {
+                break;
+            }
+        }
+        if (xHostEp0Stall == false) {
+            USBD_LL_DataOutStage(pxHostDev, 0, NULL);
+        }
+    } else {
+        // OUT data, a packet per completion, the core arms EP0 again for the next one
+        while (got < usLen && xHostEp0Stall == false && xHostOut[0].xArmed) {
+            HostEp_t *ep = &xHostOut[0];
+            uint32_t n = MIN(MIN(ep->ulLen, HOST_EP0_SIZE), usLen - got);
+            memcpy(ep->pucBuf, &pucData[got], n);
+            got += n;
+            ulHostRxCount[0] = got;
+            ep->xArmed = false;
+            USBD_LL_DataOutStage(pxHostDev, 0, ep->pucBuf + n);
+        }
+        // status, the device sends a ZLP
+        if (xHostEp0Stall == false && xHostIn[0].xArmed) {
+            xHostIn[0].xArmed = false;
+            USBD_LL_DataInStage(pxHostDev, 0, NULL);
+        }
+    }
+    return xHostEp0Stall ? -1 : (int)got;
+}
+
+static void prvHostString(uint8_t ucIndex, char *pcOut, size_t size) {
+    uint8_t desc[USBD_MAX_STR_DESC_SIZ];
+    int len = prvHostControl(0x80, USB_REQ_GET_DESCRIPTOR, (USB_DESC_TYPE_STRING << 8) | ucIndex, 0x0409, desc, sizeof(desc));
+    size_t n = 0;
+    for (int i = 2; i + 1 < len && n + 1 < size; i += 2) {
+        pcOut[n++] = (char)desc[i];
+    }
+    pcOut[n] = 0;
+}
+
+// What an OS does when the pull-up comes on, then the terminal opening the port
+static void prvHostEnumerate(void) {
+    uint8_t dev[USB_LEN_DEV_DESC];
+    uint8_t cfg[USBD_COMPOSITE_CONFIG_DESC_SIZ];
+    uint8_t coding[7] = { 0x00, 0xC2, 0x01, 0x00, 0x00, 0x00, 0x08 };
+    char product[48];
+    char serial[32];
+
+    USBD_LL_SetSpeed(pxHostDev, USBD_SPEED_FULL);
+    USBD_LL_Reset(pxHostDev);
+    if (prvHostControl(0x80, USB_REQ_GET_DESCRIPTOR, USB_DESC_TYPE_DEVICE << 8, 0, dev, 8) != 8 ||
+        prvHostControl(0x00, USB_REQ_SET_ADDRESS, HOST_ADDRESS, 0, NULL, 0) != 0 ||
+        prvHostControl(0x80, USB_REQ_GET_DESCRIPTOR, USB_DESC_TYPE_DEVICE << 8, 0, dev, sizeof(dev)) != sizeof(dev) ||
+        prvHostControl(0x80, USB_REQ_GET_DESCRIPTOR, USB_DESC_TYPE_CONFIGURATION << 8, 0, cfg, 9) != 9 ||
+        prvHostControl(0x80, USB_REQ_GET_DESCRIPTOR, USB_DESC_TYPE_CONFIGURATION << 8, 0, cfg, sizeof(cfg)) != sizeof(cfg)) {
+        fprintf(stderr, "usb: enumeration failed\n");
+        return;
+    }
+    prvHostString(dev[15], product, sizeof(product));
+    prvHostString(dev[16], serial, sizeof(serial));
+    for (uint32_t i = 0; i + USB_LEN_IF_DESC <= sizeof(cfg) && cfg[i] != 0; i += cfg[i]) {
+        // DFU interface in DFU mode
+        if (cfg[i + 1] == USB_DESC_TYPE_INTERFACE && cfg[i + 5] == 0xFE && cfg[i + 6] == 0x01) {
+            ucHostDfuItf = cfg[i + 2];
+            ucHostDfuStr = cfg[i + 8];
+        }
+    }
+    if (pcHostDfuSe != NULL) {
+        // dfu-util does not open the port
+        bool ok = prvHostControl(0x00, USB_REQ_SET_CONFIGURATION, cfg[5], 0, NULL, 0) == 0;
+        fprintf(stderr, "usb: %04x:%04x \"%s\" serial %s, %s\n", dev[8] | (dev[9] << 8), dev[10] | (dev[11] << 8),
+                product, serial, ok && ucHostDfuItf != 0xFF ? "DfuSe interface" : "no DfuSe interface");
+        return;
+    }
+    if (prvHostControl(0x00, USB_REQ_SET_CONFIGURATION, cfg[5], 0, NULL, 0) != 0 ||
+        prvHostControl(0x21, CDC_SET_LINE_CODING, 0, 0, coding, sizeof(coding)) != sizeof(coding) ||
+        prvHostControl(0x21, CDC_SET_CONTROL_LINE_STATE, 0x0003, 0, NULL, 0) != 0) {
+        fprintf(stderr, "usb: cdc setup failed\n");
+        return;
+    }
+    fprintf(stderr, "usb: %04x:%04x \"%s\" serial %s, port open\n",
+            dev[8] | (dev[9] << 8), dev[10] | (dev[11] << 8), product, serial);
+}
+
+/* Emulated host, bulk endpoints of the CDC data interface, one frame a call **/
+static void prvHostBulk(void) {
+    uint8_t in = CDC_IN_EP & 0x7F;
+    uint8_t out = CDC_OUT_EP & 0x7F;
+    uint32_t budget = HOST_BULK_PER_FRAME;
+    uint32_t messages = 0;
+    bool in_data = false;
+
+    // IN, a transfer longer than the frame goes on in the next one
+    while (budget && xHostIn[in].xArmed) {
+        HostEp_t *ep = &xHostIn[in];
+        uint32_t len = MIN(ep->ulLen - ep->ulCount, budget * CDC_DATA_FS_MAX_PACKET_SIZE);
+        uint32_t packets = len ? (len + CDC_DATA_FS_MAX_PACKET_SIZE - 1) / CDC_DATA_FS_MAX_PACKET_SIZE : 1;
+        const uint8_t *buf = ep->pucBuf + ep->ulCount;
+        messages += prvHostSplCount(buf, len);
+        for (uint32_t left = len; left;) {
+            ssize_t n = write(STDOUT_FILENO, buf, left);
+            if (n <= 0) {
+                break;
+            }
+            buf += n;
+            left -= (uint32_t)n;
+        }
+        budget -= packets;
+        ulHostInPackets += packets;
+        ulHostInBytes += len;
+        in_data = true;
+        ep->ulCount += len;
+        if (ep->ulCount == ep->ulLen) {
+            ulHostInTransfers++;
+            ulHostInZlps += ep->ulLen == 0;
+            ep->xArmed = false;
+            USBD_LL_DataInStage(pxHostDev, in, ep->pucBuf + ep->ulLen);
+        }
+    }
+    if (in_data) {
+        ulHostInFrames++;
+        ulHostInMessages += messages;
+        ulHostInMaxMessages = MAX(ulHostInMaxMessages, messages);
+    }
+
+    // OUT, what arrived in the rest of the frame. A transfer ends when its length is in
+    // or on a short packet (a read that got less than a packet, the end of a write)
+    while (budget && xHostOut[out].xArmed) {
+        HostEp_t *ep = &xHostOut[out];
+        struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+        if (poll(&pfd, 1, 0) <= 0 || (pfd.revents & POLLIN) == 0) {
+            break;
+        }
+        ssize_t n = read(STDIN_FILENO, ep->pucBuf + ep->ulCount, MIN(ep->ulLen - ep->ulCount, CDC_DATA_FS_MAX_PACKET_SIZE));
+        if (n <= 0) {
+            break;
+        }
+        budget--;
+        ep->ulCount += (uint32_t)n;
+        ulHostRxCount[out] = ep->ulCount;
+        ulHostOutPackets++;
+        ulHostOutBytes += (uint32_t)n;
+        if (n < CDC_DATA_FS_MAX_PACKET_SIZE || ep->ulCount == ep->ulLen) {
+            ulHostOutTransfers++;
+            ep->xArmed = false;
+            USBD_LL_DataOutStage(pxHostDev, out, ep->pucBuf);
+        }
+    }
+    ulHostBulkFrames += budget < HOST_BULK_PER_FRAME;
+}
+
+/* Emulated host, dfu-util on the DfuSe interface, one frame of control transfers a call **/
+// A control transfer in the frame's packets, setup and status included, the last one may overrun
+static int prvHostDfuRequest(uint8_t ucType, uint8_t ucReq, uint16_t usValue, uint8_t *pucData, uint16_t usLen) {
+    lHostDfuBudget -= 2 + (usLen + HOST_EP0_SIZE - 1) / HOST_EP0_SIZE;
+    return prvHostControl(ucType, ucReq, usValue, ucHostDfuItf, pucData, usLen);
+}
+
+// DfuSe command, a DNLOAD of block 0
+static bool prvHostDfuCommand(uint8_t ucCmd, uint32_t ulAddr) {
+    uint8_t cmd[5] = { ucCmd, (uint8_t)ulAddr, (uint8_t)(ulAddr >> 8), (uint8_t)(ulAddr >> 16), (uint8_t)(ulAddr >> 24) };
+    xHostDfuPoll = true;
+    return prvHostDfuRequest(0x21, DFU_DNLOAD, 0, cmd, sizeof(cmd)) == sizeof(cmd);
+}
+
+static bool prvHostDfuStatus(uint8_t *pucStatus) {
+    return prvHostDfuRequest(0xA1, DFU_GETSTATUS, 0, pucStatus, 6) == 6;
+}
+
+// "@name/0xaddr/NN*SSSKg,...", the address and the sector groups
+static bool prvHostDfuLayout(const char *pcLayout) {
+    const char *p = strchr(pcLayout, '/');
+    if (p == NULL) {
+        return false;
+    }
+    ulHostDfuBase = (uint32_t)strtoul(p + 1, (char **)&p, 0);
+    for (uint32_t i = 0; i < HOST_DFU_GROUPS && *p == (i ? ',' : '/'); i++) {
+        xHostDfuGroups[i].ulCount = (uint32_t)strtoul(p + 1, (char **)&p, 10);
+        if (*p++ != '*') {
+            return false;
+        }
+        xHostDfuGroups[i].ulSize = (uint32_t)strtoul(p, (char **)&p, 10);
+        xHostDfuGroups[i].ulSize *= *p == 'K' ? 1024 : *p == 'M' ? 1024 * 1024 : 1;
+        p += *p == ' ' || *p == 'K' || *p == 'M';
+        p += *p != 0;           // memory type
+    }
+    return xHostDfuGroups[0].ulCount && xHostDfuGroups[0].ulSize;
+}
+
+// Size of the sector at ulOffset from the base, 0 past the memory
+static uint32_t prvHostDfuSector(uint32_t ulOffset) {
+    uint32_t start = 0;
+    for (uint32_t i = 0; i < HOST_DFU_GROUPS && xHostDfuGroups[i].ulCount; i++) {
+        uint32_t size = xHostDfuGroups[i].ulCount * xHostDfuGroups[i].ulSize;
+        if (ulOffset - start < size) {
+            return xHostDfuGroups[i].ulSize;
+        }
+        start += size;
+    }
+    return 0;
+}
+
+static bool prvHostDfuStart(void) {
+    uint8_t status[6];
+    char layout[64];
+
+    FILE *f = fopen(pcHostDfuSe, "rb");
+    if (f == NULL) {
+        perror(pcHostDfuSe);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    ulHostDfuLen = (uint32_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    pucHostDfuImage = malloc(ulHostDfuLen ? ulHostDfuLen : 1);
+    bool read = pucHostDfuImage && fread(pucHostDfuImage, 1, ulHostDfuLen, f) == ulHostDfuLen;
+    fclose(f);
+    if (read == false || ulHostDfuLen == 0 || ucHostDfuItf == 0xFF) {
+        return false;
+    }
+
+    // a session left in dfuERROR is cleared first
+    if (prvHostDfuStatus(status) == false) {
+        return false;
+    }
+    if (status[4] == DFU_STATE_ERROR && prvHostDfuRequest(0x21, DFU_CLRSTATUS, 0, NULL, 0) != 0) {
+        return false;
+    }
+    prvHostString(ucHostDfuStr, layout, sizeof(layout));
+    if (prvHostDfuLayout(layout) == false || prvHostDfuSector(ulHostDfuLen - 1) == 0) {
+        fprintf(stderr, "dfuse: \"%s\" does not hold %u bytes\n", layout, ulHostDfuLen);
+        return false;
+    }
+    fprintf(stderr, "dfuse: \"%s\", %u bytes to 0x%08x\n", layout, ulHostDfuLen, ulHostDfuBase);
+    return true;
+}
+
+// Next request of the session, false when it failed
+static bool prvHostDfuStep(void) {
+    uint8_t status[6];
+    uint8_t block[USBD_DFU_XFER_SIZE];
+    uint32_t len = MIN(ulHostDfuLen - ulHostDfuOffset, USBD_DFU_XFER_SIZE);
+    uint16_t num = 2 + (uint16_t)(ulHostDfuOffset / USBD_DFU_XFER_SIZE);
+
+    // busy, ask again once bwPollTimeout is over
+    if (xHostDfuPoll) {
+        if (prvHostDfuStatus(status) == false || status[0] != DFU_ERROR_NONE) {
+            return false;
+        }
+        ulHostDfuWait = prvHostMs() + (status[1] | (status[2] << 8) | (status[3] << 16));
+        xHostDfuPoll = status[4] == DFU_STATE_DNLOAD_BUSY;
+        ulHostDfuBusy += xHostDfuPoll;
+        return true;
+    }
+
+    switch (xHostDfuStep) {
+    case HOST_DFU_START:
+        xHostDfuStep = HOST_DFU_ERASE;
+        return prvHostDfuStart();
+
+    case HOST_DFU_ERASE:
+        // the sectors the image spans, one command each
+        if (ulHostDfuOffset >= ulHostDfuLen) {
+            ulHostDfuOffset = 0;
+            xHostDfuStep = HOST_DFU_DNLOAD;
+            return true;
+        }
+        uint32_t addr = ulHostDfuBase + ulHostDfuOffset;
+        ulHostDfuOffset += prvHostDfuSector(ulHostDfuOffset);
+        ulHostDfuErased++;
+        return prvHostDfuCommand(DFU_CMD_ERASE, addr);
+
+    case HOST_DFU_DNLOAD:
+        if (ulHostDfuOffset >= ulHostDfuLen) {
+            ulHostDfuOffset = 0;
+            xHostDfuStep = HOST_DFU_REWIND;
+            return true;
+        }
+        if (xHostDfuAddrSet == false) {
+            xHostDfuAddrSet = true;
+            return prvHostDfuCommand(DFU_CMD_SETADDRESSPOINTER, ulHostDfuBase + ulHostDfuOffset);
+        }
+        // the block goes to the address pointer, block number 2
+        xHostDfuAddrSet = false;
+        xHostDfuPoll = true;
+        ulHostDfuOffset += len;
+        ulHostDfuBlocks++;
+        return prvHostDfuRequest(0x21, DFU_DNLOAD, 2, &pucHostDfuImage[ulHostDfuOffset - len], len) == (int)len;
+
+    case HOST_DFU_REWIND:
+        // address pointer back to the base, UPLOAD starts from idle
+        if (xHostDfuAddrSet == false) {
+            xHostDfuAddrSet = true;
+            return prvHostDfuCommand(DFU_CMD_SETADDRESSPOINTER, ulHostDfuBase);
+        }
+        xHostDfuAddrSet = false;
+        xHostDfuStep = HOST_DFU_UPLOAD;
+        return prvHostDfuRequest(0x21, DFU_ABORT, 0, NULL, 0) == 0;
+
+    case HOST_DFU_UPLOAD:
+        if (ulHostDfuOffset >= ulHostDfuLen) {
+            xHostDfuStep = HOST_DFU_LEAVE;
+            return prvHostDfuRequest(0x21, DFU_ABORT, 0, NULL, 0) == 0;
+        }
+        if (prvHostDfuRequest(0xA1, DFU_UPLOAD, num, block, len) != (int)len) {
+            // blocks not programmed yet, clear and try again in the next frame
+            ulHostDfuStalls++;
+            lHostDfuBudget = 0;
+            return prvHostDfuStatus(status) && status[4] == DFU_STATE_ERROR &&
+                   prvHostDfuRequest(0x21, DFU_CLRSTATUS, 0, NULL, 0) == 0;
+        }
+        if (memcmp(block, &pucHostDfuImage[ulHostDfuOffset], len) != 0) {
+            fprintf(stderr, "dfuse: read back differs in block at 0x%08x\n", ulHostDfuBase + ulHostDfuOffset);
+            return false;
+        }
+        ulHostDfuOffset += len;
+        return true;
+
+    case HOST_DFU_LEAVE:
+        // "leave": the address to start, then a zero length DNLOAD, the device manifests
+        if (xHostDfuAddrSet == false) {
+            xHostDfuAddrSet = true;
+            return prvHostDfuCommand(DFU_CMD_SETADDRESSPOINTER, ulHostDfuBase);
+        }
+        xHostDfuStep = HOST_DFU_DONE;
+        xHostDfuOk = prvHostDfuRequest(0x21, DFU_DNLOAD, 0, NULL, 0) == 0 &&
+                     prvHostDfuStatus(status) && status[4] == DFU_STATE_MANIFEST;
+        return xHostDfuOk;
+
+    default:
+        return true;
+    }
+}
+
+static void prvHostDfuSe(void) {
+    if (xHostDfuStep == HOST_DFU_DONE) {
+        return;
+    }
+    lHostDfuBudget = MIN(lHostDfuBudget + HOST_BULK_PER_FRAME, HOST_BULK_PER_FRAME);
+    ulHostDfuDnFrames += xHostDfuStep == HOST_DFU_ERASE || xHostDfuStep == HOST_DFU_DNLOAD;
+    ulHostDfuUpFrames += xHostDfuStep == HOST_DFU_UPLOAD;
+    // bwPollTimeout, then the packets of the frame
+    while (lHostDfuBudget > 0 && xHostDfuStep != HOST_DFU_DONE && (int32_t)(prvHostMs() - ulHostDfuWait) >= 0) {
+        if (prvHostDfuStep() == false) {
+            fprintf(stderr, "dfuse: failed, state %u\n", USBD_DFU_GetState(pxHostDev));
+            xHostDfuStep = HOST_DFU_DONE;
+        }
+    }
+}
+
+static void prvHostPump(void) {
+    if (xHostInPump || pxHostDev == NULL || xHostPullUp == false || (xHostLink == false && pcHostDfuSe == NULL)) {
+        return;
+    }
+    xHostInPump = true;
+    if (xHostEnumerated == false) {
+        xHostEnumerated = true;
+        prvHostEnumerate();
+    } else if (pxHostDev->dev_state == USBD_STATE_CONFIGURED) {
+        static uint32_t frame;
+        uint32_t ms = prvHostMs();
+        if (ms != frame) {
+            frame = ms;
+            if (pcHostDfuSe != NULL) {
+                prvHostDfuSe();
+            } else {
+                prvHostBulk();
+            }
+        }
+    }
+    xHostInPump = false;
+}
+
+/* HAL, the tick is where the irqs come in **/
+uint32_t HAL_GetTick(void) {
+    prvHostPump();
+    return prvHostMs();
+}
+
+void HAL_Delay(uint32_t ulDelay) {
+    uint32_t start = HAL_GetTick();
+    while (HAL_GetTick() - start < ulDelay) {
+    }
+}
+
+/* usbd_core.h low level interface **/
+USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev) {
+    static bool mapped;
+    if (pdev->id != DEVICE_FS) {
+        return USBD_FAIL;
+    }
+    // unique ID for the serial number string
+    if (mapped == false) {
+#ifdef MAP_FIXED_NOREPLACE
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE;
+#else
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+#endif
+        void *page = mmap((void *)HOST_UID_PAGE, 0x1000, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (page != (void *)HOST_UID_PAGE) {
+            return USBD_FAIL;
+        }
+        static const uint32_t uid[3] = { 0x00360042, 0x4D4B5011, 0x20383733 };
+        memcpy((void *)UID_BASE, uid, sizeof(uid));
+        atexit(prvHostReport);
+        mapped = true;
+    }
+    memset(&xHostPcd, 0, sizeof(xHostPcd));
+    memset(xHostIn, 0, sizeof(xHostIn));
+    memset(xHostOut, 0, sizeof(xHostOut));
+    pxHostDev = pdev;
+    pdev->pData = &xHostPcd;
+    return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_DeInit(USBD_HandleTypeDef *pdev) {
+    (void)pdev;
+    pxHostDev = NULL;
+    return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_Start(USBD_HandleTypeDef *pdev) {
+    (void)pdev;
+    xHostPullUp = true;
+    xHostEnumerated = false;
+    return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_Stop(USBD_HandleTypeDef *pdev) {
+    (void)pdev;
+    xHostPullUp = false;
+    return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_OpenEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t ep_type, uint16_t ep_mps) {
+    (void)pdev;
+    (void)ep_type;
+    if (ep_addr & 0x80) {
+        xHostPcd.IN_ep[ep_addr & 0x7F].maxpacket = ep_mps;
+    } else {
+        xHostPcd.OUT_ep[ep_addr & 0x7F].maxpacket = ep_mps;
+    }
+    return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_CloseEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+    (void)pdev;
+    HostEp_t *ep = (ep_addr & 0x80) ? &xHostIn[ep_addr & 0x7F] : &xHostOut[ep_addr & 0x7F];
+    ep->xArmed = false;
+    return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_FlushEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+    return USBD_LL_CloseEP(pdev, ep_addr);
+}
+
+USBD_StatusTypeDef USBD_LL_StallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+    (void)pdev;
+    // the core also stalls EP0 IN after every IN data stage, only a stalled OUT is an error
+    if (ep_addr == 0x00) {
+        xHostEp0Stall = true;
+    }
+    return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_ClearStallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+    (void)pdev;
+    (void)ep_addr;
+    return USBD_OK;
+}
+
+uint8_t USBD_LL_IsStallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+    (void)pdev;
+    return ep_addr == 0x00 && xHostEp0Stall;
+}
+
+USBD_StatusTypeDef USBD_LL_SetUSBAddress(USBD_HandleTypeDef *pdev, uint8_t dev_addr) {
+    (void)pdev;
+    return dev_addr == HOST_ADDRESS ? USBD_OK : USBD_FAIL;
+}
+
+USBD_StatusTypeDef USBD_LL_Transmit(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *pbuf, uint32_t size) {
+    (void)pdev;
+    xHostIn[ep_addr & 0x7F] = (HostEp_t){ pbuf, size, true, 0 };
+    return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_PrepareReceive(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *pbuf, uint32_t size) {
+    (void)pdev;
+    xHostOut[ep_addr & 0x7F] = (HostEp_t){ pbuf, size, size != 0, 0 };
+    ulHostRxCount[ep_addr & 0x7F] = 0;
+    return USBD_OK;
+}
+
+uint32_t USBD_LL_GetRxDataSize(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+    (void)pdev;
+    return ulHostRxCount[ep_addr & 0x7F];
+}
+
+void USBD_LL_Delay(uint32_t Delay) {
+    HAL_Delay(Delay);
+}
@@ -0,0 +1,111 @@
+#include "usbd_core.h"
+#include "usbd_desc.h"
+
+/* Descriptors, VID / PID of ST's virtual COM port so stock CDC-ACM drivers bind.
+ * A composite device (usbd_composite.c): the class codes say the functions are
+ * described by the IAD and the interfaces, the CDC function and the DfuSe one.
+ **/
+
+#define USBD_VID                0x0483
+#define USBD_PID                0x5740
+#define USBD_LANGID             0x0409
+#define USBD_MANUFACTURER       "STMicroelectronics"
+#define USBD_PRODUCT            "Bootloader DFU (SPL over CDC, DfuSe)"
+#define USBD_CONFIGURATION      "CDC Config"
+#define USBD_INTERFACE          "CDC Interface"
+
+#define USBD_UID_WORDS          3
+#define USBD_SERIAL_SIZE        (2 + USBD_UID_WORDS * 8 * 2)
+
+__ALIGN_BEGIN static uint8_t ucUsbdDeviceDesc[USB_LEN_DEV_DESC] __ALIGN_END = {
+    USB_LEN_DEV_DESC,
+    USB_DESC_TYPE_DEVICE,
+    0x00, 0x02,                         // bcdUSB 2.00
+    0xEF,                               // bDeviceClass miscellaneous
+    0x02,                               // bDeviceSubClass common
+    0x01,                               // bDeviceProtocol IAD
+    USB_MAX_EP0_SIZE,
+    LOBYTE(USBD_VID), HIBYTE(USBD_VID),
+    LOBYTE(USBD_PID), HIBYTE(USBD_PID),
+    0x00, 0x02,                         // bcdDevice 2.00
+    USBD_IDX_MFC_STR,
+    USBD_IDX_PRODUCT_STR,
+    USBD_IDX_SERIAL_STR,
+    USBD_MAX_NUM_CONFIGURATION,
+};
+
+__ALIGN_BEGIN static uint8_t ucUsbdLangIdDesc[USB_LEN_LANGID_STR_DESC] __ALIGN_END = {
+    USB_LEN_LANGID_STR_DESC,
+    USB_DESC_TYPE_STRING,
+    LOBYTE(USBD_LANGID), HIBYTE(USBD_LANGID),
+};
+
+__ALIGN_BEGIN static uint8_t ucUsbdSerial[USBD_SERIAL_SIZE] __ALIGN_END;
+__ALIGN_BEGIN static uint8_t ucUsbdStrDesc[USBD_MAX_STR_DESC_SIZ] __ALIGN_END;
+
+static uint8_t *prvDeviceDesc(USBD_SpeedTypeDef speed, uint16_t *length) {
+    UNUSED(speed);
+    *length = sizeof(ucUsbdDeviceDesc);
+    return ucUsbdDeviceDesc;
+}
+
+static uint8_t *prvLangIdDesc(USBD_SpeedTypeDef speed, uint16_t *length) {
+    UNUSED(speed);
+    *length = sizeof(ucUsbdLangIdDesc);
+    return ucUsbdLangIdDesc;
+}
+
+static uint8_t *prvString(const char *pcStr, uint16_t *length) {
+    USBD_GetString((uint8_t *)pcStr, ucUsbdStrDesc, length);
+    return ucUsbdStrDesc;
+}
+
+static uint8_t *prvManufacturerDesc(USBD_SpeedTypeDef speed, uint16_t *length) {
+    UNUSED(speed);
+    return prvString(USBD_MANUFACTURER, length);
+}
+
+static uint8_t *prvProductDesc(USBD_SpeedTypeDef speed, uint16_t *length) {
+    UNUSED(speed);
+    return prvString(USBD_PRODUCT, length);
+}
+
+// Unique ID in hex, UTF-16
+static uint8_t *prvSerialDesc(USBD_SpeedTypeDef speed, uint16_t *length) {
+    const uint32_t *uid = (const uint32_t *)UID_BASE;
+    uint8_t *out = &ucUsbdSerial[2];
+    UNUSED(speed);
+
+    ucUsbdSerial[0] = USBD_SERIAL_SIZE;
+    ucUsbdSerial[1] = USB_DESC_TYPE_STRING;
+    for (int w = 0; w < USBD_UID_WORDS; w++) {
+        uint32_t val = uid[w];
+        for (int i = 0; i < 8; i++, val <<= 4) {
+            uint8_t nibble = (uint8_t)(val >> 28);
+            *out++ = nibble < 10 ? '0' + nibble : 'A' + nibble - 10;
+            *out++ = 0;
+        }
+    }
+    *length = USBD_SERIAL_SIZE;
+    return ucUsbdSerial;
+}
+
+static uint8_t *prvConfigDesc(USBD_SpeedTypeDef speed, uint16_t *length) {
+    UNUSED(speed);
+    return prvString(USBD_CONFIGURATION, length);
+}
+
+static uint8_t *prvInterfaceDesc(USBD_SpeedTypeDef speed, uint16_t *length) {
+    UNUSED(speed);
+    return prvString(USBD_INTERFACE, length);
+}
+
+USBD_DescriptorsTypeDef FS_Desc = {
+    prvDeviceDesc,
+    prvLangIdDesc,
+    prvManufacturerDesc,
+    prvProductDesc,
+    prvSerialDesc,
+    prvConfigDesc,
+    prvInterfaceDesc,
+};
@@ -0,0 +1,216 @@
+#include "flash_if.h"
+#include "journal.h"
+#include "slot.h"
+#include "usbd_dfu_if.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+/* DfuSe memory on the internal flash, called from USBD_DFU_Process() (erase, program)
+ * and the OTG irq (read, poll timeout)
+ *
+ * The layout string names the sectors of the memory, dfu-util erases the ones an image
+ * covers. The trailers are not part of the image: the first erase or write of a session
+ * retires the one in use (slot.h), its sector is erased only when no blank trailer is
+ * left, so an old trailer never describes the new image, and writes into them are
+ * refused. The same first access closes an open SPL resume journal, a later SPL
+ * download of that image must not trust the slot.
+ **/
+
+// Typical erase time at x32 (DS11139), one block at 16 us a word, the poll timeouts
+#define DFU_IF_ERASE_64K_MS     550
+#define DFU_IF_ERASE_128K_MS    1000
+#define DFU_IF_PROGRAM_MS       ((USBD_DFU_XFER_SIZE / 4 * 16 + 999) / 1000)
+
+typedef struct {
+    uint32_t ulSector;
+    uint32_t ulBase;
+    uint32_t ulSize;
+    uint32_t ulEraseMs;
+} DfuIfSector_t;
+
+// The slot sectors of the STM32F412xE, the bootloader and the journal are never a memory
+static const DfuIfSector_t xDfuIfSectors[] = {
+    { 4, 0x08010000, 0x00010000, DFU_IF_ERASE_64K_MS },
+    { 5, 0x08020000, 0x00020000, DFU_IF_ERASE_128K_MS },
+    { 6, 0x08040000, 0x00020000, DFU_IF_ERASE_128K_MS },
+    { 7, 0x08060000, 0x00020000, DFU_IF_ERASE_128K_MS },
+};
+
+#define DFU_IF_SECTOR_COUNT     (sizeof(xDfuIfSectors) / sizeof(xDfuIfSectors[0]))
+
+static uint32_t ulDfuIfBase;
+static uint32_t ulDfuIfSize;
+static bool xDfuIfStarted;              // journal closed and trailer retired
+static char cDfuIfLayout[80];
+
+// Sector of the memory holding ulAddr, NULL outside
+static const DfuIfSector_t *prvSector(uint32_t ulAddr) {
+    if (ulAddr < ulDfuIfBase || ulAddr - ulDfuIfBase >= ulDfuIfSize) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < DFU_IF_SECTOR_COUNT; i++) {
+        if (ulAddr - xDfuIfSectors[i].ulBase < xDfuIfSectors[i].ulSize) {
+            return &xDfuIfSectors[i];
+        }
+    }
+    return NULL;
+}
+
+static bool prvIsBlank(uint32_t ulAddr, uint32_t ulSize) {
+    for (uint32_t off = 0; off < ulSize; off += sizeof(uint32_t)) {
+        if (*(volatile uint32_t *)(ulAddr + off) != 0xFFFFFFFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A blank sector is left alone, dfu-util erases what it writes whatever was there
+static uint16_t prvSectorErase(const DfuIfSector_t *pxSector) {
+    if (prvIsBlank(pxSector->ulBase, pxSector->ulSize)) {
+        return DFU_ERROR_NONE;
+    }
+    return xFlashIfErase(pxSector->ulSector) ? DFU_ERROR_NONE : DFU_ERROR_ERASE;
+}
+
+static bool prvProgram(uint32_t ulAddr, const void *pvSrc, uint32_t ulSize) {
+    if (xFlashIfBegin() == false) {
+        return false;
+    }
+    bool ret = xFlashIfWrite(ulAddr, pvSrc, ulSize);
+    return xFlashIfEnd() && ret;
+}
+
+// First erase or write of the session, the slot stops being what the journal says
+static uint16_t prvSessionStart(void) {
+    if (xDfuIfStarted) {
+        return DFU_ERROR_NONE;
+    }
+    xDfuIfStarted = true;
+    if (xJournalClose(prvProgram) == false) {
+        return DFU_ERROR_WRITE;
+    }
+    Slot_t slot = { ulDfuIfBase, ulDfuIfSize };
+    if (xSlotRetire(&slot, prvProgram)) {
+        return DFU_ERROR_NONE;
+    }
+    return xFlashIfErase(prvSector(ulDfuIfBase + ulDfuIfSize - 1)->ulSector) ? DFU_ERROR_NONE : DFU_ERROR_ERASE;
+}
+
+/* USBD_DFU_MediaTypeDef **/
+static uint16_t prvInit(void) {
+    return USBD_OK;
+}
+
+static uint16_t prvDeInit(void) {
+    return USBD_OK;
+}
+
+static uint16_t prvErase(uint32_t Add) {
+    uint16_t status = prvSessionStart();
+    if (status != DFU_ERROR_NONE) {
+        return status;
+    }
+    if (Add != DFU_MASS_ERASE) {
+        const DfuIfSector_t *sector = prvSector(Add);
+        return sector ? prvSectorErase(sector) : DFU_ERROR_ADDRESS;
+    }
+    // mass erase, of the memory only
+    for (uint32_t i = 0; i < DFU_IF_SECTOR_COUNT && status == DFU_ERROR_NONE; i++) {
+        if (prvSector(xDfuIfSectors[i].ulBase)) {
+            status = prvSectorErase(&xDfuIfSectors[i]);
+        }
+    }
+    return status;
+}
+
+static uint16_t prvWrite(uint8_t *src, uint8_t *dest, uint32_t Len) {
+    uint32_t addr = (uint32_t)dest;
+    if (addr < ulDfuIfBase || Len > ulDfuIfSize - IMG_TRAILER_AREA ||
+        addr - ulDfuIfBase > ulDfuIfSize - IMG_TRAILER_AREA - Len) {
+        return DFU_ERROR_ADDRESS;
+    }
+    uint16_t status = prvSessionStart();
+    if (status != DFU_ERROR_NONE) {
+        return status;
+    }
+    if (xFlashIfBegin() == false) {
+        return DFU_ERROR_WRITE;
+    }
+    uint32_t bad;
+    bool programmed = xFlashIfWrite(addr, src, Len);
+    bool verified = programmed && xFlashIfVerify(addr, src, Len, &bad);
+    if (xFlashIfEnd() == false || programmed == false) {
+        return DFU_ERROR_PROG;
+    }
+    return verified ? DFU_ERROR_NONE : DFU_ERROR_VERIFY;
+}
+
+// Memory mapped, the block goes out of the flash itself
+static uint8_t *prvRead(uint8_t *src, uint8_t *dest, uint32_t Len) {
+    uint32_t addr = (uint32_t)src;
+    (void)dest;
+    if (addr < ulDfuIfBase || Len > ulDfuIfSize || addr - ulDfuIfBase > ulDfuIfSize - Len) {
+        return NULL;
+    }
+    return src;
+}
+
+static uint16_t prvGetStatus(uint32_t Add, uint8_t cmd, uint8_t *buff) {
+    uint32_t ms = DFU_IF_PROGRAM_MS;
+    if (cmd == DFU_MEDIA_ERASE) {
+        const DfuIfSector_t *sector = prvSector(Add);
+        ms = sector ? sector->ulEraseMs : 0;
+        for (uint32_t i = 0; Add == DFU_MASS_ERASE && i < DFU_IF_SECTOR_COUNT; i++) {
+            ms += prvSector(xDfuIfSectors[i].ulBase) ? xDfuIfSectors[i].ulEraseMs : 0;
+        }
+        // the first erase of the session takes the trailer sector along once the last trailer is used
+        if (xDfuIfStarted == false && prvIsBlank(ulDfuIfBase + ulDfuIfSize - IMG_TRAILER_SIZE, IMG_TRAILER_SIZE) == false) {
+            ms += prvSector(ulDfuIfBase + ulDfuIfSize - 1)->ulEraseMs;
+        }
+    }
+    buff[1] = (uint8_t)ms;
+    buff[2] = (uint8_t)(ms >> 8);
+    buff[3] = (uint8_t)(ms >> 16);
+    return USBD_OK;
+}
+
+static USBD_DFU_MediaTypeDef xDfuIfMedia = {
+    (const uint8_t *)cDfuIfLayout,
+    prvInit,
+    prvDeInit,
+    prvErase,
+    prvWrite,
+    prvRead,
+    prvGetStatus,
+};
+
+USBD_DFU_MediaTypeDef *pxDfuIfInit(uint32_t ulBase, uint32_t ulSize) {
+    ulDfuIfBase = ulBase;
+    ulDfuIfSize = ulSize;
+    xDfuIfStarted = false;
+    if (ulSize <= IMG_TRAILER_AREA || prvSector(ulBase) == NULL || prvSector(ulBase)->ulBase != ulBase) {
+        return NULL;
+    }
+
+    // "@name/0xaddr/NN*SSSKg,...", a group per run of sectors of one size, g = read, erase, write
+    int len = snprintf(cDfuIfLayout, sizeof(cDfuIfLayout), "@Update slot /0x%08X/", (unsigned)ulBase);
+    uint32_t addr = ulBase;
+    while (addr - ulBase < ulSize) {
+        const DfuIfSector_t *sector = prvSector(addr);
+        if (sector == NULL || sector->ulBase != addr) {
+            return NULL;
+        }
+        uint32_t count = 0;
+        while (prvSector(addr) && prvSector(addr)->ulSize == sector->ulSize) {
+            addr += sector->ulSize;
+            count++;
+        }
+        len += snprintf(&cDfuIfLayout[len], sizeof(cDfuIfLayout) - len, "%s%02u*%03uKg",
+                        sector->ulBase == ulBase ? "" : ",", (unsigned)count, (unsigned)(sector->ulSize / 1024));
+        if (len >= (int)sizeof(cDfuIfLayout)) {
+            return NULL;
+        }
+    }
+    return addr - ulBase == ulSize ? &xDfuIfMedia : NULL;
+}
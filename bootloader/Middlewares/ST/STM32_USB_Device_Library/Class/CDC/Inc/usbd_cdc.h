@@ -66,6 +66,18 @@ extern "C" {
 #define CDC_DATA_FS_OUT_PACKET_SIZE                 CDC_DATA_FS_MAX_PACKET_SIZE
 
 #define CDC_REQ_MAX_DATA_SIZE                       0x7U
+
+/* Buffers are sized for the fastest speed the core runs at, define
+   USBD_CDC_HS_ENABLED 0U in usbd_conf.h on a full speed only core */
+#ifndef USBD_CDC_HS_ENABLED
+#define USBD_CDC_HS_ENABLED                         1U
+#endif /* USBD_CDC_HS_ENABLED */
+
+#if (USBD_CDC_HS_ENABLED == 1U)
+#define CDC_DATA_MAX_PACKET_SIZE                    CDC_DATA_HS_MAX_PACKET_SIZE
+#else
+#define CDC_DATA_MAX_PACKET_SIZE                    CDC_DATA_FS_MAX_PACKET_SIZE
+#endif /* USBD_CDC_HS_ENABLED */
 /*---------------------------------------------------------------------*/
 /*  CDC definitions                                                    */
 /*---------------------------------------------------------------------*/
@@ -111,7 +123,7 @@ typedef struct _USBD_CDC_Itf
 
 typedef struct
 {
-  uint32_t data[CDC_DATA_HS_MAX_PACKET_SIZE / 4U];      /* Force 32bits alignment */
+  uint32_t data[CDC_DATA_MAX_PACKET_SIZE / 4U];         /* Force 32bits alignment */
   uint8_t  CmdOpCode;
   uint8_t  CmdLength;
   uint8_t  *RxBuffer;
@@ -119,10 +131,24 @@ typedef struct
   uint32_t RxLength;
   uint32_t TxLength;
 
+  uint8_t  *RxRing;                                     /* Receive ring, NULL: single RxBuffer */
+  uint32_t RxSlotSize;
+  uint32_t RxSlotCount;
+  uint32_t RxSlotHead;                                  /* Slot the OUT endpoint fills next */
+  __IO uint32_t RxSlotUsed;                             /* Slots signalled, not released yet */
+
+  uint8_t  *TxQueue;                                    /* Transmit queue, NULL: TxBuffer only */
+  uint32_t TxQueueSize;
+  __IO uint32_t TxQueueHead;                            /* Written by USBD_CDC_Queue() */
+  __IO uint32_t TxQueueTail;                            /* Start of the transfer in flight */
+
   __IO uint32_t TxState;
   __IO uint32_t RxState;
 } USBD_CDC_HandleTypeDef;
 
+/* Static storage USBD_CDC_RegisterArena() needs for one CDC instance */
+#define USBD_CDC_ARENA_SIZE                         sizeof(USBD_CDC_HandleTypeDef)
+
 
 
 /** @defgroup USBD_CORE_Exported_Macros
@@ -148,11 +174,21 @@ extern USBD_ClassTypeDef USBD_CDC;
   */
 uint8_t USBD_CDC_RegisterInterface(USBD_HandleTypeDef *pdev,
                                    USBD_CDC_ItfTypeDef *fops);
+uint8_t USBD_CDC_RegisterArena(void *arena, uint32_t size);
 
 uint8_t USBD_CDC_SetTxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff,
                              uint32_t length);
 
 uint8_t USBD_CDC_SetRxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff);
+uint8_t USBD_CDC_SetRxRing(USBD_HandleTypeDef *pdev, uint8_t *pbuff,
+                           uint32_t slot_size, uint32_t slot_count);
+uint8_t USBD_CDC_ReleaseRxSlot(USBD_HandleTypeDef *pdev);
+uint32_t USBD_CDC_GetRxPending(USBD_HandleTypeDef *pdev);
+uint8_t USBD_CDC_SetTxQueue(USBD_HandleTypeDef *pdev, uint8_t *pbuff,
+                            uint32_t size);
+uint32_t USBD_CDC_Queue(USBD_HandleTypeDef *pdev, const uint8_t *pbuff,
+                        uint32_t length);
+uint32_t USBD_CDC_GetTxQueued(USBD_HandleTypeDef *pdev);
 uint8_t USBD_CDC_ReceivePacket(USBD_HandleTypeDef *pdev);
 uint8_t USBD_CDC_TransmitPacket(USBD_HandleTypeDef *pdev);
 /**
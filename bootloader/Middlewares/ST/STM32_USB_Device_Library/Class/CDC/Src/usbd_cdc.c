@@ -105,6 +105,8 @@ static uint8_t USBD_CDC_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *re
 static uint8_t USBD_CDC_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum);
 static uint8_t USBD_CDC_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum);
 static uint8_t USBD_CDC_EP0_RxReady(USBD_HandleTypeDef *pdev);
+static void USBD_CDC_ArmOut(USBD_HandleTypeDef *pdev);
+static void USBD_CDC_SendQueue(USBD_HandleTypeDef *pdev);
 
 static uint8_t *USBD_CDC_GetFSCfgDesc(uint16_t *length);
 static uint8_t *USBD_CDC_GetHSCfgDesc(uint16_t *length);
@@ -135,6 +137,8 @@ __ALIGN_BEGIN static uint8_t USBD_CDC_DeviceQualifierDesc[USB_LEN_DEV_QUALIFIER_
   * @{
   */
 
+/* Class data storage from USBD_CDC_RegisterArena(), USBD_malloc() if none */
+static void *USBD_CDC_Arena = NULL;
 
 /* CDC interface class callbacks structure */
 USBD_ClassTypeDef  USBD_CDC =
@@ -153,6 +157,9 @@ USBD_ClassTypeDef  USBD_CDC =
   USBD_CDC_GetFSCfgDesc,
   USBD_CDC_GetOtherSpeedCfgDesc,
   USBD_CDC_GetDeviceQualifierDescriptor,
+#if (USBD_SUPPORT_USER_STRING_DESC == 1U)
+  NULL,                 /* GetUsrStrDescriptor */
+#endif /* USBD_SUPPORT_USER_STRING_DESC */
 };
 
 /* USB CDC device Configuration Descriptor */
@@ -469,7 +476,23 @@ static uint8_t USBD_CDC_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
   UNUSED(cfgidx);
   USBD_CDC_HandleTypeDef *hcdc;
 
-  hcdc = USBD_malloc(sizeof(USBD_CDC_HandleTypeDef));
+#if (USBD_CDC_HS_ENABLED == 0U)
+  /* Buffers hold full speed packets only */
+  if (pdev->dev_speed == USBD_SPEED_HIGH)
+  {
+    pdev->pClassData = NULL;
+    return (uint8_t)USBD_FAIL;
+  }
+#endif /* USBD_CDC_HS_ENABLED */
+
+  if (USBD_CDC_Arena != NULL)
+  {
+    hcdc = (USBD_CDC_HandleTypeDef *)USBD_CDC_Arena;
+  }
+  else
+  {
+    hcdc = USBD_malloc(sizeof(USBD_CDC_HandleTypeDef));
+  }
 
   if (hcdc == NULL)
   {
@@ -518,6 +541,19 @@ static uint8_t USBD_CDC_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
   (void)USBD_LL_OpenEP(pdev, CDC_CMD_EP, USBD_EP_TYPE_INTR, CDC_CMD_PACKET_SIZE);
   pdev->ep_in[CDC_CMD_EP & 0xFU].is_used = 1U;
 
+  /* Single RxBuffer unless the interface sets up a receive ring */
+  hcdc->RxRing = NULL;
+  hcdc->RxSlotSize = 0U;
+  hcdc->RxSlotCount = 0U;
+  hcdc->RxSlotHead = 0U;
+  hcdc->RxSlotUsed = 0U;
+
+  /* Transmit only through TxBuffer unless the interface sets up a queue */
+  hcdc->TxQueue = NULL;
+  hcdc->TxQueueSize = 0U;
+  hcdc->TxQueueHead = 0U;
+  hcdc->TxQueueTail = 0U;
+
   /* Init  physical Interface components */
   ((USBD_CDC_ItfTypeDef *)pdev->pUserData)->Init();
 
@@ -525,18 +561,8 @@ static uint8_t USBD_CDC_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
   hcdc->TxState = 0U;
   hcdc->RxState = 0U;
 
-  if (pdev->dev_speed == USBD_SPEED_HIGH)
-  {
-    /* Prepare Out endpoint to receive next packet */
-    (void)USBD_LL_PrepareReceive(pdev, CDC_OUT_EP, hcdc->RxBuffer,
-                                 CDC_DATA_HS_OUT_PACKET_SIZE);
-  }
-  else
-  {
-    /* Prepare Out endpoint to receive next packet */
-    (void)USBD_LL_PrepareReceive(pdev, CDC_OUT_EP, hcdc->RxBuffer,
-                                 CDC_DATA_FS_OUT_PACKET_SIZE);
-  }
+  /* Prepare Out endpoint to receive next packet */
+  USBD_CDC_ArmOut(pdev);
 
   return (uint8_t)USBD_OK;
 }
@@ -569,7 +595,10 @@ static uint8_t USBD_CDC_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
   if (pdev->pClassData != NULL)
   {
     ((USBD_CDC_ItfTypeDef *)pdev->pUserData)->DeInit();
-    (void)USBD_free(pdev->pClassData);
+    if (pdev->pClassData != USBD_CDC_Arena)
+    {
+      (void)USBD_free(pdev->pClassData);
+    }
     pdev->pClassData = NULL;
   }
 
@@ -604,20 +633,27 @@ static uint8_t USBD_CDC_Setup(USBD_HandleTypeDef *pdev,
       {
         if ((req->bmRequest & 0x80U) != 0U)
         {
+          /* data holds a packet of the configured speed, no more */
+          len = (uint16_t)MIN(sizeof(hcdc->data), req->wLength);
           ((USBD_CDC_ItfTypeDef *)pdev->pUserData)->Control(req->bRequest,
                                                             (uint8_t *)hcdc->data,
-                                                            req->wLength);
+                                                            len);
 
-          len = MIN(CDC_REQ_MAX_DATA_SIZE, req->wLength);
+          len = MIN(CDC_REQ_MAX_DATA_SIZE, len);
           (void)USBD_CtlSendData(pdev, (uint8_t *)hcdc->data, len);
         }
-        else
+        else if (req->wLength <= sizeof(hcdc->data))
         {
           hcdc->CmdOpCode = req->bRequest;
           hcdc->CmdLength = (uint8_t)req->wLength;
 
           (void)USBD_CtlPrepareRx(pdev, (uint8_t *)hcdc->data, req->wLength);
         }
+        else
+        {
+          USBD_CtlError(pdev, req);
+          ret = USBD_FAIL;
+        }
       }
       else
       {
@@ -699,6 +735,38 @@ static uint8_t USBD_CDC_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum)
 
   hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
 
+  if (hcdc->TxQueue != NULL)
+  {
+    /* The transfer (or its ZLP) is out, the queue goes on from its end */
+    hcdc->TxQueueTail = (hcdc->TxQueueTail + hcdc->TxLength) % hcdc->TxQueueSize;
+
+    if (hcdc->TxQueueHead != hcdc->TxQueueTail)
+    {
+      /* Chained, whatever was queued meanwhile goes as one transfer */
+      USBD_CDC_SendQueue(pdev);
+    }
+    else if ((hcdc->TxLength > 0U) &&
+             ((hcdc->TxLength % hpcd->IN_ep[epnum].maxpacket) == 0U))
+    {
+      /* Nothing follows a transfer that ended on a full packet, the host only
+      sees the end of it with a ZLP */
+      hcdc->TxLength = 0U;
+      pdev->ep_in[epnum].total_length = 0U;
+      (void)USBD_LL_Transmit(pdev, epnum, NULL, 0U);
+    }
+    else
+    {
+      hcdc->TxState = 0U;
+
+      if (((USBD_CDC_ItfTypeDef *)pdev->pUserData)->TransmitCplt != NULL)
+      {
+        ((USBD_CDC_ItfTypeDef *)pdev->pUserData)->TransmitCplt(hcdc->TxBuffer, &hcdc->TxLength, epnum);
+      }
+    }
+
+    return (uint8_t)USBD_OK;
+  }
+
   if ((pdev->ep_in[epnum].total_length > 0U) &&
       ((pdev->ep_in[epnum].total_length % hpcd->IN_ep[epnum].maxpacket) == 0U))
   {
@@ -740,6 +808,37 @@ static uint8_t USBD_CDC_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum)
   /* Get the received data length */
   hcdc->RxLength = USBD_LL_GetRxDataSize(pdev, epnum);
 
+  if (hcdc->RxRing != NULL)
+  {
+    uint8_t *slot = hcdc->RxRing + (hcdc->RxSlotHead * hcdc->RxSlotSize);
+
+    /* A ZLP ends nothing new, receive into the same slot again */
+    if (hcdc->RxLength == 0U)
+    {
+      USBD_CDC_ArmOut(pdev);
+      return (uint8_t)USBD_OK;
+    }
+
+    /* Slot full or ended by a short packet, hand it over and move on. The slot
+    stays the interface's until USBD_CDC_ReleaseRxSlot() */
+    hcdc->RxSlotHead = (hcdc->RxSlotHead + 1U) % hcdc->RxSlotCount;
+    hcdc->RxSlotUsed++;
+
+    ((USBD_CDC_ItfTypeDef *)pdev->pUserData)->Receive(slot, &hcdc->RxLength);
+
+    /* No free slot, the endpoint NAKs until one is released */
+    if (hcdc->RxSlotUsed < hcdc->RxSlotCount)
+    {
+      USBD_CDC_ArmOut(pdev);
+    }
+    else
+    {
+      hcdc->RxState = 1U;
+    }
+
+    return (uint8_t)USBD_OK;
+  }
+
   /* USB data will be immediately processed, this allow next USB traffic being
   NAKed till the end of the application Xfer */
 
@@ -848,6 +947,27 @@ uint8_t USBD_CDC_RegisterInterface(USBD_HandleTypeDef *pdev,
   return (uint8_t)USBD_OK;
 }
 
+/**
+  * @brief  USBD_CDC_RegisterArena
+  *         Static storage for the class data, taken at every Init() instead
+  *         of USBD_malloc(). Register it before USBD_Start()
+  * @param  arena: USBD_CDC_ARENA_SIZE bytes at least, 32bits aligned
+  * @param  size: arena size
+  * @retval status
+  */
+uint8_t USBD_CDC_RegisterArena(void *arena, uint32_t size)
+{
+  if ((arena == NULL) || (size < USBD_CDC_ARENA_SIZE) ||
+      (((uint32_t)arena & 0x3U) != 0U))
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  USBD_CDC_Arena = arena;
+
+  return (uint8_t)USBD_OK;
+}
+
 /**
   * @brief  USBD_CDC_SetTxBuffer
   * @param  pdev: device instance
@@ -890,6 +1010,186 @@ uint8_t USBD_CDC_SetRxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff)
   return (uint8_t)USBD_OK;
 }
 
+/**
+  * @brief  USBD_CDC_SetRxRing
+  *         Receive into a ring of slot_count buffers of slot_size bytes instead
+  *         of RxBuffer. The OUT endpoint is armed for a whole slot and Receive()
+  *         is called once per slot, when it is full or a short packet ends it,
+  *         with the slot itself: no copy, no per packet callback. Call it from
+  *         the interface Init(), slots are handed out in ring order and each
+  *         one is given back with USBD_CDC_ReleaseRxSlot()
+  * @param  pdev: device instance
+  * @param  pbuff: slot_count * slot_size bytes
+  * @param  slot_size: a multiple of the OUT endpoint max packet size
+  * @param  slot_count: number of slots
+  * @retval status
+  */
+uint8_t USBD_CDC_SetRxRing(USBD_HandleTypeDef *pdev, uint8_t *pbuff,
+                           uint32_t slot_size, uint32_t slot_count)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
+  uint32_t mps;
+
+  if (hcdc == NULL)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  mps = (pdev->dev_speed == USBD_SPEED_HIGH) ? CDC_DATA_HS_OUT_PACKET_SIZE
+                                             : CDC_DATA_FS_OUT_PACKET_SIZE;
+
+  /* A slot that ends inside a packet would be ended by the hardware as overrun */
+  if ((pbuff == NULL) || (slot_count == 0U) || (slot_size == 0U) ||
+      ((slot_size % mps) != 0U))
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  hcdc->RxRing = pbuff;
+  hcdc->RxSlotSize = slot_size;
+  hcdc->RxSlotCount = slot_count;
+  hcdc->RxSlotHead = 0U;
+  hcdc->RxSlotUsed = 0U;
+  hcdc->RxBuffer = pbuff;
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_CDC_ReleaseRxSlot
+  *         Give back the oldest slot passed to Receive(), re-arms the OUT
+  *         endpoint if it was stopped on a full ring
+  * @param  pdev: device instance
+  * @retval status
+  */
+uint8_t USBD_CDC_ReleaseRxSlot(USBD_HandleTypeDef *pdev)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
+
+  if ((hcdc == NULL) || (hcdc->RxRing == NULL) || (hcdc->RxSlotUsed == 0U))
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  hcdc->RxSlotUsed--;
+
+  if (hcdc->RxState != 0U)
+  {
+    hcdc->RxState = 0U;
+    USBD_CDC_ArmOut(pdev);
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_CDC_GetRxPending
+  *         Bytes already stored in the slot the OUT endpoint is filling, the
+  *         tail of a transfer the host ended on a full packet without a ZLP
+  *         sits there until more data comes
+  * @param  pdev: device instance
+  * @retval byte count
+  */
+uint32_t USBD_CDC_GetRxPending(USBD_HandleTypeDef *pdev)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
+
+  if ((hcdc == NULL) || (hcdc->RxRing == NULL) || (hcdc->RxState != 0U))
+  {
+    return 0U;
+  }
+
+  return USBD_LL_GetRxDataSize(pdev, CDC_OUT_EP);
+}
+
+/**
+  * @brief  USBD_CDC_SetTxQueue
+  *         Transmit through a byte queue of size bytes. USBD_CDC_Queue() only
+  *         copies into it, a transfer starts when the IN endpoint is idle and
+  *         the next one is chained from DataIn() with everything queued in
+  *         the meantime, so small writes go out together. A transfer that
+  *         ends on a full packet gets its ZLP when nothing follows. Call it
+  *         from the interface Init(), TransmitPacket() is not used with a queue
+  * @param  pdev: device instance
+  * @param  pbuff: queue buffer, holds size - 1 bytes
+  * @param  size: queue size
+  * @retval status
+  */
+uint8_t USBD_CDC_SetTxQueue(USBD_HandleTypeDef *pdev, uint8_t *pbuff,
+                            uint32_t size)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
+
+  if ((hcdc == NULL) || (pbuff == NULL) || (size < 2U))
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  hcdc->TxQueue = pbuff;
+  hcdc->TxQueueSize = size;
+  hcdc->TxQueueHead = 0U;
+  hcdc->TxQueueTail = 0U;
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_CDC_Queue
+  *         Queue data for the IN endpoint, starts a transfer if none is in
+  *         flight. Same calling rules as USBD_CDC_TransmitPacket()
+  * @param  pdev: device instance
+  * @param  pbuff: data
+  * @param  length: data length
+  * @retval bytes queued, less than length when the queue is full
+  */
+uint32_t USBD_CDC_Queue(USBD_HandleTypeDef *pdev, const uint8_t *pbuff,
+                        uint32_t length)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
+  uint32_t head;
+  uint32_t count = 0U;
+
+  if ((hcdc == NULL) || (hcdc->TxQueue == NULL))
+  {
+    return 0U;
+  }
+
+  head = hcdc->TxQueueHead;
+  while ((count < length) && (((head + 1U) % hcdc->TxQueueSize) != hcdc->TxQueueTail))
+  {
+    hcdc->TxQueue[head] = pbuff[count];
+    head = (head + 1U) % hcdc->TxQueueSize;
+    count++;
+  }
+  hcdc->TxQueueHead = head;
+
+  if ((count > 0U) && (hcdc->TxState == 0U))
+  {
+    hcdc->TxState = 1U;
+    USBD_CDC_SendQueue(pdev);
+  }
+
+  return count;
+}
+
+/**
+  * @brief  USBD_CDC_GetTxQueued
+  *         Bytes queued and not sent yet, including the transfer in flight
+  * @param  pdev: device instance
+  * @retval byte count
+  */
+uint32_t USBD_CDC_GetTxQueued(USBD_HandleTypeDef *pdev)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
+
+  if ((hcdc == NULL) || (hcdc->TxQueue == NULL))
+  {
+    return 0U;
+  }
+
+  return (hcdc->TxQueueHead + hcdc->TxQueueSize - hcdc->TxQueueTail) % hcdc->TxQueueSize;
+}
+
 /**
   * @brief  USBD_CDC_TransmitPacket
   *         Transmit packet on IN endpoint
@@ -931,27 +1231,66 @@ uint8_t USBD_CDC_TransmitPacket(USBD_HandleTypeDef *pdev)
   */
 uint8_t USBD_CDC_ReceivePacket(USBD_HandleTypeDef *pdev)
 {
-  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
-
   if (pdev->pClassData == NULL)
   {
     return (uint8_t)USBD_FAIL;
   }
 
-  if (pdev->dev_speed == USBD_SPEED_HIGH)
+  /* Prepare Out endpoint to receive next packet */
+  USBD_CDC_ArmOut(pdev);
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_CDC_SendQueue
+  *         Transmit the queued data from the tail, up to the queue end when it
+  *         wraps, TxState is already set
+  * @param  pdev: device instance
+  * @retval None
+  */
+static void USBD_CDC_SendQueue(USBD_HandleTypeDef *pdev)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
+  uint32_t head = hcdc->TxQueueHead;
+  uint32_t tail = hcdc->TxQueueTail;
+
+  hcdc->TxBuffer = hcdc->TxQueue + tail;
+  hcdc->TxLength = (head > tail) ? (head - tail) : (hcdc->TxQueueSize - tail);
+
+  /* Update the packet total length */
+  pdev->ep_in[CDC_IN_EP & 0xFU].total_length = hcdc->TxLength;
+
+  (void)USBD_LL_Transmit(pdev, CDC_IN_EP, hcdc->TxBuffer, hcdc->TxLength);
+}
+
+/**
+  * @brief  USBD_CDC_ArmOut
+  *         Prepare the OUT endpoint, a packet into RxBuffer or a whole slot of
+  *         the receive ring
+  * @param  pdev: device instance
+  * @retval None
+  */
+static void USBD_CDC_ArmOut(USBD_HandleTypeDef *pdev)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
+
+  if (hcdc->RxRing != NULL)
+  {
+    (void)USBD_LL_PrepareReceive(pdev, CDC_OUT_EP,
+                                 hcdc->RxRing + (hcdc->RxSlotHead * hcdc->RxSlotSize),
+                                 hcdc->RxSlotSize);
+  }
+  else if (pdev->dev_speed == USBD_SPEED_HIGH)
   {
-    /* Prepare Out endpoint to receive next packet */
     (void)USBD_LL_PrepareReceive(pdev, CDC_OUT_EP, hcdc->RxBuffer,
                                  CDC_DATA_HS_OUT_PACKET_SIZE);
   }
   else
   {
-    /* Prepare Out endpoint to receive next packet */
     (void)USBD_LL_PrepareReceive(pdev, CDC_OUT_EP, hcdc->RxBuffer,
                                  CDC_DATA_FS_OUT_PACKET_SIZE);
   }
-
-  return (uint8_t)USBD_OK;
 }
 /**
   * @}
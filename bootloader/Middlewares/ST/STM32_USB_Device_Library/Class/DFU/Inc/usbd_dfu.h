@@ -0,0 +1,233 @@
+/**
+  ******************************************************************************
+  * @file    usbd_dfu.h
+  * @author  MCD Application Team
+  * @brief   Header file for the usbd_dfu.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright (c) 2015 STMicroelectronics.
+  * All rights reserved.</center></h2>
+  *
+  * This software component is licensed by ST under Ultimate Liberty license
+  * SLA0044, the "License"; You may not use this file except in compliance with
+  * the License. You may obtain a copy of the License at:
+  *                      www.st.com/SLA0044
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USB_DFU_H
+#define __USB_DFU_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include  "usbd_ioreq.h"
+
+/** @addtogroup STM32_USB_DEVICE_LIBRARY
+  * @{
+  */
+
+/** @defgroup usbd_dfu
+  * @brief This file is the Header file for usbd_dfu.c
+  * @{
+  */
+
+
+/** @defgroup usbd_dfu_Exported_Defines
+  * @{
+  */
+
+/* Bytes of a DNLOAD / UPLOAD block (wTransferSize), a multiple of the EP0 packet size */
+#ifndef USBD_DFU_XFER_SIZE
+#define USBD_DFU_XFER_SIZE                          1024U
+#endif /* USBD_DFU_XFER_SIZE */
+
+/* DNLOAD blocks the class holds: one is programmed by USBD_DFU_Process() while
+   the host sends the next one */
+#ifndef USBD_DFU_BLOCK_COUNT
+#define USBD_DFU_BLOCK_COUNT                        2U
+#endif /* USBD_DFU_BLOCK_COUNT */
+
+/* Interface number of DFU in the configuration, 0 unless it is part of a composite */
+#ifndef USBD_DFU_INTERFACE
+#define USBD_DFU_INTERFACE                          0U
+#endif /* USBD_DFU_INTERFACE */
+
+/* String index of the alternate setting, the DfuSe memory layout */
+#ifndef USBD_DFU_STR_INDEX
+#define USBD_DFU_STR_INDEX                          (USBD_IDX_INTERFACE_STR + 1U)
+#endif /* USBD_DFU_STR_INDEX */
+
+#define DFU_DESCRIPTOR_TYPE                         0x21U
+#define USB_DFU_DESC_SIZ                            9U
+#define USB_DFU_ITF_DESC_SIZ                        (USB_LEN_IF_DESC + USB_DFU_DESC_SIZ)
+#define USB_DFU_CONFIG_DESC_SIZ                     (USB_LEN_CFG_DESC + USB_DFU_ITF_DESC_SIZ)
+
+/* Functional descriptor: download, upload, not manifestation tolerant, DfuSe 1.1a */
+#define USBD_DFU_ATTRIBUTES                         0x03U
+#define USBD_DFU_DETACH_TIMEOUT                     0x00FFU
+#define USBD_DFU_BCD_VERSION                        0x011AU
+
+/* Class requests */
+#define DFU_DETACH                                  0x00U
+#define DFU_DNLOAD                                  0x01U
+#define DFU_UPLOAD                                  0x02U
+#define DFU_GETSTATUS                               0x03U
+#define DFU_CLRSTATUS                               0x04U
+#define DFU_GETSTATE                                0x05U
+#define DFU_ABORT                                   0x06U
+
+/* DFU states */
+#define DFU_STATE_IDLE                              0x02U
+#define DFU_STATE_DNLOAD_SYNC                       0x03U
+#define DFU_STATE_DNLOAD_BUSY                       0x04U
+#define DFU_STATE_DNLOAD_IDLE                       0x05U
+#define DFU_STATE_MANIFEST_SYNC                     0x06U
+#define DFU_STATE_MANIFEST                          0x07U
+#define DFU_STATE_MANIFEST_WAIT_RESET               0x08U
+#define DFU_STATE_UPLOAD_IDLE                       0x09U
+#define DFU_STATE_ERROR                             0x0AU
+
+/* DFU status */
+#define DFU_ERROR_NONE                              0x00U
+#define DFU_ERROR_TARGET                            0x01U
+#define DFU_ERROR_FILE                              0x02U
+#define DFU_ERROR_WRITE                             0x03U
+#define DFU_ERROR_ERASE                             0x04U
+#define DFU_ERROR_CHECK_ERASED                      0x05U
+#define DFU_ERROR_PROG                              0x06U
+#define DFU_ERROR_VERIFY                            0x07U
+#define DFU_ERROR_ADDRESS                           0x08U
+#define DFU_ERROR_NOTDONE                           0x09U
+#define DFU_ERROR_FIRMWARE                          0x0AU
+#define DFU_ERROR_VENDOR                            0x0BU
+#define DFU_ERROR_USB                               0x0CU
+#define DFU_ERROR_POR                               0x0DU
+#define DFU_ERROR_UNKNOWN                           0x0EU
+#define DFU_ERROR_STALLEDPKT                        0x0FU
+
+/* DfuSe commands, DNLOAD block 0 */
+#define DFU_CMD_GETCOMMANDS                         0x00U
+#define DFU_CMD_SETADDRESSPOINTER                   0x21U
+#define DFU_CMD_ERASE                               0x41U
+#define DFU_CMD_READUNPROTECT                       0x92U
+
+/* Erase() address of a mass erase (DfuSe erase command without address) */
+#define DFU_MASS_ERASE                              0xFFFFFFFFU
+
+/* Media operation GetStatus() gives the poll timeout for */
+#define DFU_MEDIA_ERASE                             0x00U
+#define DFU_MEDIA_PROGRAM                           0x01U
+
+/**
+  * @}
+  */
+
+
+/** @defgroup USBD_CORE_Exported_TypesDefinitions
+  * @{
+  */
+
+/**
+  * @}
+  */
+typedef struct
+{
+  uint32_t Addr;                                        /* Flash address, erase or first byte */
+  uint16_t BlockNum;                                    /* 0: erase command, >= 2: data */
+  uint16_t Length;
+  uint32_t Epoch;                                       /* Session it was received in */
+} USBD_DFU_BlockTypeDef;
+
+typedef struct
+{
+  uint32_t buffer[USBD_DFU_BLOCK_COUNT][USBD_DFU_XFER_SIZE / 4U];  /* Force 32bits alignment */
+  USBD_DFU_BlockTypeDef block[USBD_DFU_BLOCK_COUNT];
+
+  __IO uint32_t BlockHead;                              /* Blocks received, EP0 irq */
+  __IO uint32_t BlockTail;                              /* Blocks done, USBD_DFU_Process() */
+  __IO uint32_t Epoch;                                  /* Bumped when pending blocks are dropped */
+  __IO uint32_t Error;                                  /* USBD_DFU_Process(): Epoch << 8 | status */
+  __IO uint32_t Requests;                               /* Class requests seen */
+
+  uint32_t AddrPtr;                                     /* DfuSe address pointer */
+  uint32_t LastAddr;                                    /* Of the last block, for the poll timeout */
+  uint16_t wblock_num;                                  /* DNLOAD in its data stage */
+  uint16_t wlength;
+  uint8_t  LastCmd;                                     /* DFU_MEDIA_xxx of the last block */
+  uint8_t  CmdFresh;                                    /* Command not reported busy yet */
+  uint8_t  alt_setting;
+  uint8_t  dev_state;
+  uint8_t  dev_status[6];
+} USBD_DFU_HandleTypeDef;
+
+/* Static storage USBD_DFU_RegisterArena() needs for one DFU instance */
+#define USBD_DFU_ARENA_SIZE                         sizeof(USBD_DFU_HandleTypeDef)
+
+/* Flash access, Erase() and Write() run in USBD_DFU_Process(), return a DFU_ERROR_xxx
+   status. Read() returns where the bytes are (src itself for memory mapped flash) or
+   NULL outside the memory. GetStatus() puts the poll timeout of the operation in
+   buff[1..3] */
+typedef struct _USBD_DFU_MediaTypeDef
+{
+  const uint8_t *pStrDesc;
+  uint16_t (* Init)(void);
+  uint16_t (* DeInit)(void);
+  uint16_t (* Erase)(uint32_t Add);
+  uint16_t (* Write)(uint8_t *src, uint8_t *dest, uint32_t Len);
+  uint8_t *(* Read)(uint8_t *src, uint8_t *dest, uint32_t Len);
+  uint16_t (* GetStatus)(uint32_t Add, uint8_t cmd, uint8_t *buff);
+} USBD_DFU_MediaTypeDef;
+
+
+/** @defgroup USBD_CORE_Exported_Macros
+  * @{
+  */
+
+/**
+  * @}
+  */
+
+/** @defgroup USBD_CORE_Exported_Variables
+  * @{
+  */
+
+extern USBD_ClassTypeDef USBD_DFU;
+#define USBD_DFU_CLASS &USBD_DFU
+/**
+  * @}
+  */
+
+/** @defgroup USB_CORE_Exported_Functions
+  * @{
+  */
+uint8_t USBD_DFU_RegisterMedia(USBD_HandleTypeDef *pdev,
+                               USBD_DFU_MediaTypeDef *fops);
+uint8_t USBD_DFU_RegisterArena(void *arena, uint32_t size);
+void USBD_DFU_Process(USBD_HandleTypeDef *pdev);
+uint8_t USBD_DFU_GetState(USBD_HandleTypeDef *pdev);
+uint8_t USBD_DFU_IsManifested(USBD_HandleTypeDef *pdev);
+uint32_t USBD_DFU_GetRequestCount(USBD_HandleTypeDef *pdev);
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* __USB_DFU_H */
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,1099 @@
+/**
+  ******************************************************************************
+  * @file    usbd_dfu.c
+  * @author  MCD Application Team
+  * @brief   This file provides the DFU core functions.
+  *
+  * @verbatim
+  *
+  *          ===================================================================
+  *                                DFU Class Driver Description
+  *          ===================================================================
+  *           This driver manages the DFU class V1.1 following the "Device Class Specification for
+  *           Device Firmware Upgrade Version 1.1 Aug 5, 2004" and the DfuSe extension of
+  *           ST (AN3156, bcdDFU 1.1a), so stock dfu-util drives it.
+  *           This driver implements the following aspects of the specification:
+  *             - Device descriptor management
+  *             - Configuration descriptor management
+  *             - Enumeration as DFU device (in DFU mode only)
+  *             - Requests management (supporting ST DFU sub-protocol)
+  *             - Memory operations management (Download/Upload/Erase/SetAddressPointer)
+  *             - DFU state machine implementation.
+  *
+  *           DNLOAD blocks are received straight into one of USBD_DFU_BLOCK_COUNT
+  *           buffers, Erase() and Write() of the media run from USBD_DFU_Process()
+  *           in the application thread, never in the USB irq. While a block is
+  *           programmed GETSTATUS answers dfuDNLOAD-IDLE as long as a buffer is free,
+  *           so the host sends the next block during the programming of the last one.
+  *           The class data does not use pClassData / pUserData, the class can be
+  *           part of a composite device with a class that does.
+  *
+  *           This driver doesn't implement the following aspects of the specification
+  *           (but it is possible to manage these features with some modifications on this driver):
+  *             - Manifestation Tolerant mode
+  *             - Run-time mode (DETACH only acknowledged)
+  *             - Read unprotect
+  *
+  *  @endverbatim
+  *
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright (c) 2015 STMicroelectronics.
+  * All rights reserved.</center></h2>
+  *
+  * This software component is licensed by ST under Ultimate Liberty license
+  * SLA0044, the "License"; You may not use this file except in compliance with
+  * the License. You may obtain a copy of the License at:
+  *                      www.st.com/SLA0044
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_dfu.h"
+#include "usbd_ctlreq.h"
+
+
+/** @addtogroup STM32_USB_DEVICE_LIBRARY
+  * @{
+  */
+
+
+/** @defgroup USBD_DFU
+  * @brief usbd core module
+  * @{
+  */
+
+/** @defgroup USBD_DFU_Private_TypesDefinitions
+  * @{
+  */
+/**
+  * @}
+  */
+
+
+/** @defgroup USBD_DFU_Private_Defines
+  * @{
+  */
+/**
+  * @}
+  */
+
+
+/** @defgroup USBD_DFU_Private_Macros
+  * @{
+  */
+
+/**
+  * @}
+  */
+
+
+/** @defgroup USBD_DFU_Private_FunctionPrototypes
+  * @{
+  */
+
+static uint8_t USBD_DFU_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx);
+static uint8_t USBD_DFU_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx);
+static uint8_t USBD_DFU_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req);
+static uint8_t USBD_DFU_EP0_RxReady(USBD_HandleTypeDef *pdev);
+static uint8_t *USBD_DFU_GetCfgDesc(uint16_t *length);
+static uint8_t *USBD_DFU_GetDeviceQualifierDesc(uint16_t *length);
+#if (USBD_SUPPORT_USER_STRING_DESC == 1U)
+static uint8_t *USBD_DFU_GetUsrStringDesc(USBD_HandleTypeDef *pdev,
+                                          uint8_t index, uint16_t *length);
+#endif /* USBD_SUPPORT_USER_STRING_DESC */
+
+static uint8_t DFU_Download(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req);
+static uint8_t DFU_Upload(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req);
+static void DFU_GetStatus(USBD_HandleTypeDef *pdev);
+static uint8_t DFU_ClearStatus(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req);
+static void DFU_GetState(USBD_HandleTypeDef *pdev);
+static uint8_t DFU_Abort(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req);
+static uint8_t DFU_Stall(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req,
+                         uint8_t status);
+static uint8_t DFU_ProcessError(USBD_DFU_HandleTypeDef *hdfu);
+static void DFU_QueueBlock(USBD_DFU_HandleTypeDef *hdfu, uint32_t addr,
+                           uint8_t cmd);
+
+/**
+  * @}
+  */
+
+/** @defgroup USBD_DFU_Private_Variables
+  * @{
+  */
+
+/* Class data storage from USBD_DFU_RegisterArena(), USBD_malloc() if none */
+static void *USBD_DFU_Arena = NULL;
+static USBD_DFU_HandleTypeDef *USBD_DFU_Handle = NULL;
+static USBD_DFU_MediaTypeDef *USBD_DFU_Media = NULL;
+
+/* DFU interface class callbacks structure */
+USBD_ClassTypeDef  USBD_DFU =
+{
+  USBD_DFU_Init,
+  USBD_DFU_DeInit,
+  USBD_DFU_Setup,
+  NULL,                 /* EP0_TxSent, */
+  USBD_DFU_EP0_RxReady,
+  NULL,                 /* DataIn, */
+  NULL,                 /* DataOut, */
+  NULL,                 /* SOF */
+  NULL,
+  NULL,
+  USBD_DFU_GetCfgDesc,
+  USBD_DFU_GetCfgDesc,
+  USBD_DFU_GetCfgDesc,
+  USBD_DFU_GetDeviceQualifierDesc,
+#if (USBD_SUPPORT_USER_STRING_DESC == 1U)
+  USBD_DFU_GetUsrStringDesc,
+#endif /* USBD_SUPPORT_USER_STRING_DESC */
+};
+
+/* USB DFU device Configuration Descriptor */
+__ALIGN_BEGIN static uint8_t USBD_DFU_CfgDesc[USB_DFU_CONFIG_DESC_SIZ] __ALIGN_END =
+{
+  0x09,                                       /* bLength: Configuration Descriptor size */
+  USB_DESC_TYPE_CONFIGURATION,                /* bDescriptorType: Configuration */
+  USB_DFU_CONFIG_DESC_SIZ,                    /* wTotalLength: Bytes returned */
+  0x00,
+  0x01,                                       /* bNumInterfaces: 1 interface */
+  0x01,                                       /* bConfigurationValue: Configuration value */
+  0x02,                                       /* iConfiguration: Index of string descriptor describing the configuration */
+#if (USBD_SELF_POWERED == 1U)
+  0xC0,                                       /* bmAttributes: Bus Powered according to user configuration */
+#else
+  0x80,                                       /* bmAttributes: Bus Powered according to user configuration */
+#endif
+  USBD_MAX_POWER,                             /* MaxPower 100 mA */
+
+  /**********  Descriptor of DFU interface 0 Alternate setting 0 **************/
+  0x09,                                       /* bLength: Interface Descriptor size */
+  USB_DESC_TYPE_INTERFACE,                    /* bDescriptorType: */
+  USBD_DFU_INTERFACE,                         /* bInterfaceNumber: Number of Interface */
+  0x00,                                       /* bAlternateSetting: Alternate setting */
+  0x00,                                       /* bNumEndpoints*/
+  0xFE,                                       /* bInterfaceClass: Application Specific Class Code */
+  0x01,                                       /* bInterfaceSubClass : Device Firmware Upgrade Code */
+  0x02,                                       /* nInterfaceProtocol: DFU mode protocol */
+  USBD_DFU_STR_INDEX,                         /* iInterface: Index of string descriptor */
+
+  /******************** DFU Functional Descriptor ********************/
+  0x09,                                       /* blength = 9 Bytes */
+  DFU_DESCRIPTOR_TYPE,                        /* DFU Functional Descriptor */
+  USBD_DFU_ATTRIBUTES,                        /* bmAttribute */
+  LOBYTE(USBD_DFU_DETACH_TIMEOUT),            /* wDetachTimeOut */
+  HIBYTE(USBD_DFU_DETACH_TIMEOUT),
+  LOBYTE(USBD_DFU_XFER_SIZE),                 /* wTransferSize */
+  HIBYTE(USBD_DFU_XFER_SIZE),
+  LOBYTE(USBD_DFU_BCD_VERSION),               /* bcdDFUVersion */
+  HIBYTE(USBD_DFU_BCD_VERSION),
+};
+
+/* USB Standard Device Descriptor */
+__ALIGN_BEGIN static uint8_t USBD_DFU_DeviceQualifierDesc[USB_LEN_DEV_QUALIFIER_DESC] __ALIGN_END =
+{
+  USB_LEN_DEV_QUALIFIER_DESC,
+  USB_DESC_TYPE_DEVICE_QUALIFIER,
+  0x00,
+  0x02,
+  0x00,
+  0x00,
+  0x00,
+  0x40,
+  0x01,
+  0x00,
+};
+
+/* Commands answered to UPLOAD of block 0, Get Commands first */
+__ALIGN_BEGIN static uint8_t USBD_DFU_Commands[3] __ALIGN_END =
+{
+  DFU_CMD_GETCOMMANDS,
+  DFU_CMD_SETADDRESSPOINTER,
+  DFU_CMD_ERASE,
+};
+
+#if (USBD_SUPPORT_USER_STRING_DESC == 1U)
+__ALIGN_BEGIN static uint8_t USBD_DFU_StrDesc[USBD_MAX_STR_DESC_SIZ] __ALIGN_END;
+#endif /* USBD_SUPPORT_USER_STRING_DESC */
+
+/**
+  * @}
+  */
+
+/** @defgroup USBD_DFU_Private_Functions
+  * @{
+  */
+
+/**
+  * @brief  USBD_DFU_Init
+  *         Initialize the DFU interface
+  * @param  pdev: device instance
+  * @param  cfgidx: Configuration index
+  * @retval status
+  */
+static uint8_t USBD_DFU_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+  UNUSED(pdev);
+  UNUSED(cfgidx);
+  USBD_DFU_HandleTypeDef *hdfu = USBD_DFU_Handle;
+
+  if (hdfu == NULL)
+  {
+    if (USBD_DFU_Arena != NULL)
+    {
+      hdfu = (USBD_DFU_HandleTypeDef *)USBD_DFU_Arena;
+    }
+    else
+    {
+      hdfu = USBD_malloc(sizeof(USBD_DFU_HandleTypeDef));
+    }
+
+    if (hdfu == NULL)
+    {
+      return (uint8_t)USBD_EMEM;
+    }
+
+    /* Queue is empty the first time only, blocks acknowledged to the host
+       before a bus reset are still programmed */
+    hdfu->BlockHead = 0U;
+    hdfu->BlockTail = 0U;
+    hdfu->Epoch = 0U;
+    hdfu->Error = 0U;
+    hdfu->Requests = 0U;
+    hdfu->AddrPtr = 0U;
+    USBD_DFU_Handle = hdfu;
+  }
+
+  /* A failed block of the last session is not reported to the new one */
+  if (DFU_ProcessError(hdfu) != DFU_ERROR_NONE)
+  {
+    hdfu->Epoch++;
+  }
+
+  hdfu->wblock_num = 0U;
+  hdfu->wlength = 0U;
+  hdfu->LastAddr = 0U;
+  hdfu->LastCmd = DFU_MEDIA_PROGRAM;
+  hdfu->CmdFresh = 0U;
+  hdfu->alt_setting = 0U;
+
+  hdfu->dev_state = DFU_STATE_IDLE;
+  hdfu->dev_status[0] = DFU_ERROR_NONE;
+  hdfu->dev_status[1] = 0U;
+  hdfu->dev_status[2] = 0U;
+  hdfu->dev_status[3] = 0U;
+  hdfu->dev_status[4] = DFU_STATE_IDLE;
+  hdfu->dev_status[5] = 0U;
+
+  /* Initialize Hardware layer */
+  if ((USBD_DFU_Media != NULL) && (USBD_DFU_Media->Init() != USBD_OK))
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_DFU_DeInit
+  *         De-Initialize the DFU layer
+  * @param  pdev: device instance
+  * @param  cfgidx: Configuration index
+  * @retval status
+  */
+static uint8_t USBD_DFU_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+  UNUSED(pdev);
+  UNUSED(cfgidx);
+
+  if (USBD_DFU_Handle == NULL)
+  {
+    return (uint8_t)USBD_OK;
+  }
+
+  USBD_DFU_Handle->wblock_num = 0U;
+  USBD_DFU_Handle->wlength = 0U;
+  USBD_DFU_Handle->dev_state = DFU_STATE_IDLE;
+  USBD_DFU_Handle->dev_status[0] = DFU_ERROR_NONE;
+  USBD_DFU_Handle->dev_status[4] = DFU_STATE_IDLE;
+
+  /* DeInit physical Interface components, USBD_DFU_Process() may still
+     drain the queue, the class data stays */
+  if (USBD_DFU_Media != NULL)
+  {
+    (void)USBD_DFU_Media->DeInit();
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_DFU_Setup
+  *         Handle the DFU specific requests
+  * @param  pdev: instance
+  * @param  req: usb requests
+  * @retval status
+  */
+static uint8_t USBD_DFU_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+  USBD_DFU_HandleTypeDef *hdfu = USBD_DFU_Handle;
+  USBD_StatusTypeDef ret = USBD_OK;
+  uint8_t *pbuf;
+  uint16_t len;
+  uint16_t status_info = 0U;
+
+  if (hdfu == NULL)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  switch (req->bmRequest & USB_REQ_TYPE_MASK)
+  {
+    case USB_REQ_TYPE_CLASS:
+      hdfu->Requests++;
+
+      /* No media, the interface is offline */
+      if (USBD_DFU_Media == NULL)
+      {
+        USBD_CtlError(pdev, req);
+        return (uint8_t)USBD_FAIL;
+      }
+
+      switch (req->bRequest)
+      {
+        case DFU_DNLOAD:
+          ret = (USBD_StatusTypeDef)DFU_Download(pdev, req);
+          break;
+
+        case DFU_UPLOAD:
+          ret = (USBD_StatusTypeDef)DFU_Upload(pdev, req);
+          break;
+
+        case DFU_GETSTATUS:
+          DFU_GetStatus(pdev);
+          break;
+
+        case DFU_CLRSTATUS:
+          ret = (USBD_StatusTypeDef)DFU_ClearStatus(pdev, req);
+          break;
+
+        case DFU_GETSTATE:
+          DFU_GetState(pdev);
+          break;
+
+        case DFU_ABORT:
+          ret = (USBD_StatusTypeDef)DFU_Abort(pdev, req);
+          break;
+
+        case DFU_DETACH:
+          /* Already in DFU mode, the host resets the device */
+          break;
+
+        default:
+          ret = (USBD_StatusTypeDef)DFU_Stall(pdev, req, DFU_ERROR_STALLEDPKT);
+          break;
+      }
+      break;
+
+    case USB_REQ_TYPE_STANDARD:
+      switch (req->bRequest)
+      {
+        case USB_REQ_GET_STATUS:
+          if (pdev->dev_state == USBD_STATE_CONFIGURED)
+          {
+            (void)USBD_CtlSendData(pdev, (uint8_t *)&status_info, 2U);
+          }
+          else
+          {
+            USBD_CtlError(pdev, req);
+            ret = USBD_FAIL;
+          }
+          break;
+
+        case USB_REQ_GET_DESCRIPTOR:
+          if ((req->wValue >> 8) == DFU_DESCRIPTOR_TYPE)
+          {
+            pbuf = USBD_DFU_CfgDesc + USB_LEN_CFG_DESC + USB_LEN_IF_DESC;
+            len = MIN(USB_DFU_DESC_SIZ, req->wLength);
+            (void)USBD_CtlSendData(pdev, pbuf, len);
+          }
+          else
+          {
+            USBD_CtlError(pdev, req);
+            ret = USBD_FAIL;
+          }
+          break;
+
+        case USB_REQ_GET_INTERFACE:
+          if (pdev->dev_state == USBD_STATE_CONFIGURED)
+          {
+            (void)USBD_CtlSendData(pdev, &hdfu->alt_setting, 1U);
+          }
+          else
+          {
+            USBD_CtlError(pdev, req);
+            ret = USBD_FAIL;
+          }
+          break;
+
+        case USB_REQ_SET_INTERFACE:
+          /* One alternate setting, the one memory of the media */
+          if ((pdev->dev_state == USBD_STATE_CONFIGURED) && (LOBYTE(req->wValue) == 0U))
+          {
+            hdfu->alt_setting = 0U;
+          }
+          else
+          {
+            USBD_CtlError(pdev, req);
+            ret = USBD_FAIL;
+          }
+          break;
+
+        case USB_REQ_CLEAR_FEATURE:
+          break;
+
+        default:
+          USBD_CtlError(pdev, req);
+          ret = USBD_FAIL;
+          break;
+      }
+      break;
+
+    default:
+      USBD_CtlError(pdev, req);
+      ret = USBD_FAIL;
+      break;
+  }
+
+  return (uint8_t)ret;
+}
+
+/**
+  * @brief  USBD_DFU_EP0_RxReady
+  *         Data stage of DNLOAD received, queue the block
+  * @param  pdev: device instance
+  * @retval status
+  */
+static uint8_t USBD_DFU_EP0_RxReady(USBD_HandleTypeDef *pdev)
+{
+  UNUSED(pdev);
+  USBD_DFU_HandleTypeDef *hdfu = USBD_DFU_Handle;
+  uint8_t *pbuf;
+  uint32_t addr;
+
+  if ((hdfu == NULL) || (hdfu->dev_state != DFU_STATE_DNLOAD_SYNC))
+  {
+    return (uint8_t)USBD_OK;
+  }
+
+  pbuf = (uint8_t *)hdfu->buffer[hdfu->BlockHead % USBD_DFU_BLOCK_COUNT];
+
+  if (hdfu->wblock_num == 0U)
+  {
+    addr = (uint32_t)pbuf[1] | ((uint32_t)pbuf[2] << 8) |
+           ((uint32_t)pbuf[3] << 16) | ((uint32_t)pbuf[4] << 24);
+
+    if ((pbuf[0] == DFU_CMD_SETADDRESSPOINTER) && (hdfu->wlength == 5U))
+    {
+      /* Data blocks take their address when queued, no need to wait */
+      hdfu->AddrPtr = addr;
+      hdfu->CmdFresh = 1U;
+    }
+    else if ((pbuf[0] == DFU_CMD_ERASE) && (hdfu->wlength == 5U))
+    {
+      DFU_QueueBlock(hdfu, addr, DFU_MEDIA_ERASE);
+      hdfu->CmdFresh = 1U;
+    }
+    else if ((pbuf[0] == DFU_CMD_ERASE) && (hdfu->wlength == 1U))
+    {
+      DFU_QueueBlock(hdfu, DFU_MASS_ERASE, DFU_MEDIA_ERASE);
+      hdfu->CmdFresh = 1U;
+    }
+    else
+    {
+      /* Read unprotect and unknown commands */
+      hdfu->dev_state = DFU_STATE_ERROR;
+      hdfu->dev_status[0] = DFU_ERROR_STALLEDPKT;
+    }
+  }
+  else if (hdfu->wblock_num >= 2U)
+  {
+    /* DfuSe: address = ((wBlockNum - 2) * wTransferSize) + address pointer */
+    addr = ((uint32_t)(hdfu->wblock_num - 2U) * USBD_DFU_XFER_SIZE) + hdfu->AddrPtr;
+    DFU_QueueBlock(hdfu, addr, DFU_MEDIA_PROGRAM);
+  }
+  else
+  {
+    hdfu->dev_state = DFU_STATE_ERROR;
+    hdfu->dev_status[0] = DFU_ERROR_STALLEDPKT;
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_DFU_GetCfgDesc
+  *         return configuration descriptor
+  * @param  length : pointer data length
+  * @retval pointer to descriptor buffer
+  */
+static uint8_t *USBD_DFU_GetCfgDesc(uint16_t *length)
+{
+  *length = (uint16_t)sizeof(USBD_DFU_CfgDesc);
+
+  return USBD_DFU_CfgDesc;
+}
+
+/**
+  * @brief  DeviceQualifierDescriptor
+  *         return Device Qualifier descriptor
+  * @param  length : pointer data length
+  * @retval pointer to descriptor buffer
+  */
+static uint8_t *USBD_DFU_GetDeviceQualifierDesc(uint16_t *length)
+{
+  *length = (uint16_t)sizeof(USBD_DFU_DeviceQualifierDesc);
+
+  return USBD_DFU_DeviceQualifierDesc;
+}
+
+#if (USBD_SUPPORT_USER_STRING_DESC == 1U)
+/**
+  * @brief  USBD_DFU_GetUsrStringDesc
+  *         Manages the transfer of memory interfaces string descriptors.
+  * @param  pdev: device instance
+  * @param  index: descriptor index
+  * @param  length : pointer data length
+  * @retval pointer to the descriptor table or NULL if the descriptor is not supported.
+  */
+static uint8_t *USBD_DFU_GetUsrStringDesc(USBD_HandleTypeDef *pdev,
+                                          uint8_t index, uint16_t *length)
+{
+  UNUSED(pdev);
+
+  /* Check if the requested string interface is supported */
+  if ((index == USBD_DFU_STR_INDEX) && (USBD_DFU_Media != NULL))
+  {
+    USBD_GetString((uint8_t *)USBD_DFU_Media->pStrDesc, USBD_DFU_StrDesc, length);
+    return USBD_DFU_StrDesc;
+  }
+
+  /* Not supported Interface Descriptor index */
+  *length = 0U;
+  return NULL;
+}
+#endif /* USBD_SUPPORT_USER_STRING_DESC */
+
+/**
+  * @brief  USBD_DFU_RegisterMedia
+  * @param  pdev: device instance
+  * @param  fops: storage callback, NULL takes the memory away from the host
+  * @retval status
+  */
+uint8_t USBD_DFU_RegisterMedia(USBD_HandleTypeDef *pdev,
+                               USBD_DFU_MediaTypeDef *fops)
+{
+  UNUSED(pdev);
+
+  USBD_DFU_Media = fops;
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_DFU_RegisterArena
+  *         Static storage for the class data, taken at the first Init()
+  *         instead of USBD_malloc(). Register it before USBD_Start()
+  * @param  arena: USBD_DFU_ARENA_SIZE bytes at least, 32bits aligned
+  * @param  size: arena size
+  * @retval status
+  */
+uint8_t USBD_DFU_RegisterArena(void *arena, uint32_t size)
+{
+  if ((arena == NULL) || (size < USBD_DFU_ARENA_SIZE) ||
+      (((uint32_t)arena & 0x3U) != 0U))
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  USBD_DFU_Arena = arena;
+  USBD_DFU_Handle = NULL;
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_DFU_Process
+  *         Erase and program the queued blocks in order, call it from the
+  *         application loop, not from the USB irq
+  * @param  pdev: device instance
+  * @retval None
+  */
+void USBD_DFU_Process(USBD_HandleTypeDef *pdev)
+{
+  UNUSED(pdev);
+  USBD_DFU_HandleTypeDef *hdfu = USBD_DFU_Handle;
+  USBD_DFU_BlockTypeDef *blk;
+  uint32_t idx;
+  uint16_t status;
+
+  if ((hdfu == NULL) || (USBD_DFU_Media == NULL))
+  {
+    return;
+  }
+
+  while (hdfu->BlockTail != hdfu->BlockHead)
+  {
+    idx = hdfu->BlockTail % USBD_DFU_BLOCK_COUNT;
+    blk = &hdfu->block[idx];
+
+    /* Blocks of a cleared session, or behind a failed one, are dropped */
+    if ((blk->Epoch == hdfu->Epoch) && (DFU_ProcessError(hdfu) == DFU_ERROR_NONE))
+    {
+      if (blk->BlockNum == 0U)
+      {
+        status = USBD_DFU_Media->Erase(blk->Addr);
+      }
+      else
+      {
+        status = USBD_DFU_Media->Write((uint8_t *)hdfu->buffer[idx],
+                                       (uint8_t *)blk->Addr, blk->Length);
+      }
+
+      if (status != DFU_ERROR_NONE)
+      {
+        hdfu->Error = ((blk->Epoch & 0x00FFFFFFU) << 8) | (status & 0xFFU);
+      }
+    }
+
+    hdfu->BlockTail++;
+  }
+}
+
+/**
+  * @brief  USBD_DFU_GetState
+  * @param  pdev: device instance
+  * @retval DFU state, DFU_STATE_IDLE before the first Init()
+  */
+uint8_t USBD_DFU_GetState(USBD_HandleTypeDef *pdev)
+{
+  UNUSED(pdev);
+
+  if (USBD_DFU_Handle == NULL)
+  {
+    return DFU_STATE_IDLE;
+  }
+
+  return USBD_DFU_Handle->dev_state;
+}
+
+/**
+  * @brief  USBD_DFU_IsManifested
+  *         The host ended the download (zero length DNLOAD) and every block
+  *         is in the memory
+  * @param  pdev: device instance
+  * @retval 1 if the download is complete
+  */
+uint8_t USBD_DFU_IsManifested(USBD_HandleTypeDef *pdev)
+{
+  UNUSED(pdev);
+  USBD_DFU_HandleTypeDef *hdfu = USBD_DFU_Handle;
+  uint8_t state;
+
+  if (hdfu == NULL)
+  {
+    return 0U;
+  }
+
+  state = hdfu->dev_state;
+  if ((state != DFU_STATE_MANIFEST_SYNC) && (state != DFU_STATE_MANIFEST) &&
+      (state != DFU_STATE_MANIFEST_WAIT_RESET))
+  {
+    return 0U;
+  }
+
+  return ((hdfu->BlockTail == hdfu->BlockHead) &&
+          (DFU_ProcessError(hdfu) == DFU_ERROR_NONE)) ? 1U : 0U;
+}
+
+/**
+  * @brief  USBD_DFU_GetRequestCount
+  *         Class requests seen, tells an application waiting for the host
+  *         that it is still there
+  * @param  pdev: device instance
+  * @retval count
+  */
+uint32_t USBD_DFU_GetRequestCount(USBD_HandleTypeDef *pdev)
+{
+  UNUSED(pdev);
+
+  if (USBD_DFU_Handle == NULL)
+  {
+    return 0U;
+  }
+
+  return USBD_DFU_Handle->Requests;
+}
+
+/******************************************************************************
+     DFU Class requests management
+******************************************************************************/
+
+/**
+  * @brief  DFU_Download
+  *         Handles the DFU DNLOAD request.
+  * @param  pdev: device instance
+  * @param  req: pointer to the request structure
+  * @retval status
+  */
+static uint8_t DFU_Download(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+  USBD_DFU_HandleTypeDef *hdfu = USBD_DFU_Handle;
+
+  /* Data setup request */
+  if (req->wLength > 0U)
+  {
+    /* GETSTATUS reported busy while no buffer was free, the host waits */
+    if (((hdfu->dev_state == DFU_STATE_IDLE) || (hdfu->dev_state == DFU_STATE_DNLOAD_IDLE)) &&
+        (req->wLength <= USBD_DFU_XFER_SIZE) &&
+        ((hdfu->BlockHead - hdfu->BlockTail) < USBD_DFU_BLOCK_COUNT))
+    {
+      /* Update the global length and block number */
+      hdfu->wblock_num = req->wValue;
+      hdfu->wlength = req->wLength;
+
+      /* Update the state machine */
+      hdfu->dev_state = DFU_STATE_DNLOAD_SYNC;
+      hdfu->dev_status[4] = hdfu->dev_state;
+
+      /* Prepare the reception of the buffer over EP0, straight into the free block */
+      (void)USBD_CtlPrepareRx(pdev,
+                              (uint8_t *)hdfu->buffer[hdfu->BlockHead % USBD_DFU_BLOCK_COUNT],
+                              hdfu->wlength);
+    }
+    else
+    {
+      return DFU_Stall(pdev, req, DFU_ERROR_STALLEDPKT);
+    }
+  }
+  /* 0 Data DNLOAD request */
+  else
+  {
+    /* End of DNLOAD operation, manifestation once the queue is drained */
+    if (hdfu->dev_state == DFU_STATE_DNLOAD_IDLE)
+    {
+      hdfu->dev_state = DFU_STATE_MANIFEST_SYNC;
+      hdfu->dev_status[4] = hdfu->dev_state;
+    }
+    else
+    {
+      return DFU_Stall(pdev, req, DFU_ERROR_STALLEDPKT);
+    }
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  DFU_Upload
+  *         Handles the DFU UPLOAD request.
+  * @param  pdev: instance
+  * @param  req: pointer to the request structure
+  * @retval status
+  */
+static uint8_t DFU_Upload(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+  USBD_DFU_HandleTypeDef *hdfu = USBD_DFU_Handle;
+  uint8_t *pbuf;
+  uint32_t addr;
+
+  /* Data setup request */
+  if (req->wLength > 0U)
+  {
+    if ((hdfu->dev_state != DFU_STATE_IDLE) && (hdfu->dev_state != DFU_STATE_UPLOAD_IDLE))
+    {
+      return DFU_Stall(pdev, req, DFU_ERROR_STALLEDPKT);
+    }
+
+    /* Update the global length and block number */
+    hdfu->wblock_num = req->wValue;
+    hdfu->wlength = req->wLength;
+
+    /* DFU Get Command */
+    if (hdfu->wblock_num == 0U)
+    {
+      /* Update the state machine */
+      hdfu->dev_state = (hdfu->wlength > sizeof(USBD_DFU_Commands)) ? DFU_STATE_IDLE : DFU_STATE_UPLOAD_IDLE;
+      hdfu->dev_status[4] = hdfu->dev_state;
+
+      /* Send the status data over EP0 */
+      (void)USBD_CtlSendData(pdev, USBD_DFU_Commands,
+                             MIN(sizeof(USBD_DFU_Commands), hdfu->wlength));
+    }
+    else if ((hdfu->wblock_num > 1U) && (hdfu->wlength <= USBD_DFU_XFER_SIZE) &&
+             (hdfu->BlockHead == hdfu->BlockTail))
+    {
+      /* DfuSe: address = ((wBlockNum - 2) * wTransferSize) + address pointer,
+         read into a block buffer, all free with the queue empty */
+      addr = ((uint32_t)(hdfu->wblock_num - 2U) * USBD_DFU_XFER_SIZE) + hdfu->AddrPtr;
+      pbuf = USBD_DFU_Media->Read((uint8_t *)addr, (uint8_t *)hdfu->buffer[0], hdfu->wlength);
+
+      if (pbuf == NULL)
+      {
+        return DFU_Stall(pdev, req, DFU_ERROR_ADDRESS);
+      }
+
+      /* Update the state machine */
+      hdfu->dev_state = DFU_STATE_UPLOAD_IDLE;
+      hdfu->dev_status[4] = hdfu->dev_state;
+
+      /* Send the status data over EP0 */
+      (void)USBD_CtlSendData(pdev, pbuf, hdfu->wlength);
+    }
+    else
+    {
+      /* Block 1, too long or blocks not programmed yet: the host clears the
+         status and asks again */
+      return DFU_Stall(pdev, req, DFU_ERROR_STALLEDPKT);
+    }
+  }
+  /* No Data setup request */
+  else
+  {
+    hdfu->dev_state = DFU_STATE_IDLE;
+    hdfu->dev_status[4] = hdfu->dev_state;
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  DFU_GetStatus
+  *         Handles the DFU GETSTATUS request.
+  * @param  pdev: instance
+  * @retval None
+  */
+static void DFU_GetStatus(USBD_HandleTypeDef *pdev)
+{
+  USBD_DFU_HandleTypeDef *hdfu = USBD_DFU_Handle;
+  uint32_t pending = hdfu->BlockHead - hdfu->BlockTail;
+  uint8_t error = DFU_ProcessError(hdfu);
+  uint8_t busy;
+
+  hdfu->dev_status[1] = 0U;
+  hdfu->dev_status[2] = 0U;
+  hdfu->dev_status[3] = 0U;
+
+  /* A block failed in USBD_DFU_Process() */
+  if ((error != DFU_ERROR_NONE) && (hdfu->dev_state != DFU_STATE_ERROR))
+  {
+    hdfu->dev_state = DFU_STATE_ERROR;
+    hdfu->dev_status[0] = error;
+  }
+
+  switch (hdfu->dev_state)
+  {
+    case DFU_STATE_DNLOAD_SYNC:
+    case DFU_STATE_DNLOAD_BUSY:
+      /* A command is busy at least once (dfu-util checks it), an erase until
+         it is done, data as long as no buffer is free for the next block */
+      busy = (hdfu->CmdFresh != 0U) ||
+             ((pending != 0U) && (hdfu->LastCmd == DFU_MEDIA_ERASE)) ||
+             (pending >= USBD_DFU_BLOCK_COUNT);
+      hdfu->CmdFresh = 0U;
+
+      if (busy != 0U)
+      {
+        if (pending != 0U)
+        {
+          (void)USBD_DFU_Media->GetStatus(hdfu->LastAddr, hdfu->LastCmd, hdfu->dev_status);
+        }
+        hdfu->dev_state = DFU_STATE_DNLOAD_BUSY;
+      }
+      else
+      {
+        hdfu->dev_state = DFU_STATE_DNLOAD_IDLE;
+      }
+      hdfu->dev_status[0] = DFU_ERROR_NONE;
+      hdfu->dev_status[4] = hdfu->dev_state;
+      break;
+
+    case DFU_STATE_MANIFEST_SYNC:
+      /* Manifesting while blocks are programmed, not tolerant: wait for the reset once done */
+      if (pending != 0U)
+      {
+        (void)USBD_DFU_Media->GetStatus(hdfu->LastAddr, hdfu->LastCmd, hdfu->dev_status);
+      }
+      else
+      {
+        hdfu->dev_state = DFU_STATE_MANIFEST_WAIT_RESET;
+      }
+      hdfu->dev_status[0] = DFU_ERROR_NONE;
+      hdfu->dev_status[4] = DFU_STATE_MANIFEST;
+      break;
+
+    default:
+      hdfu->dev_status[4] = hdfu->dev_state;
+      break;
+  }
+
+  /* Send the status data over EP0 */
+  (void)USBD_CtlSendData(pdev, hdfu->dev_status, 6U);
+}
+
+/**
+  * @brief  DFU_ClearStatus
+  *         Handles the DFU CLRSTATUS request.
+  * @param  pdev: device instance
+  * @param  req: pointer to the request structure
+  * @retval status
+  */
+static uint8_t DFU_ClearStatus(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+  USBD_DFU_HandleTypeDef *hdfu = USBD_DFU_Handle;
+
+  if (hdfu->dev_state == DFU_STATE_ERROR)
+  {
+    /* Blocks behind a failed one are dropped, a stalled request keeps them */
+    if (DFU_ProcessError(hdfu) != DFU_ERROR_NONE)
+    {
+      hdfu->Epoch++;
+    }
+    hdfu->dev_state = DFU_STATE_IDLE;
+    hdfu->dev_status[0] = DFU_ERROR_NONE;
+    hdfu->dev_status[4] = hdfu->dev_state;
+  }
+  else
+  {
+    return DFU_Stall(pdev, req, DFU_ERROR_UNKNOWN);
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  DFU_GetState
+  *         Handles the DFU GETSTATE request.
+  * @param  pdev: device instance
+  * @retval None
+  */
+static void DFU_GetState(USBD_HandleTypeDef *pdev)
+{
+  USBD_DFU_HandleTypeDef *hdfu = USBD_DFU_Handle;
+
+  /* Return the current state of the DFU interface */
+  (void)USBD_CtlSendData(pdev, &hdfu->dev_state, 1U);
+}
+
+/**
+  * @brief  DFU_Abort
+  *         Handles the DFU ABORT request, blocks acknowledged are still programmed
+  * @param  pdev: device instance
+  * @param  req: pointer to the request structure
+  * @retval status
+  */
+static uint8_t DFU_Abort(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+  USBD_DFU_HandleTypeDef *hdfu = USBD_DFU_Handle;
+
+  if ((hdfu->dev_state == DFU_STATE_IDLE) || (hdfu->dev_state == DFU_STATE_DNLOAD_SYNC) ||
+      (hdfu->dev_state == DFU_STATE_DNLOAD_IDLE) || (hdfu->dev_state == DFU_STATE_MANIFEST_SYNC) ||
+      (hdfu->dev_state == DFU_STATE_UPLOAD_IDLE))
+  {
+    hdfu->dev_state = DFU_STATE_IDLE;
+    hdfu->dev_status[0] = DFU_ERROR_NONE;
+    hdfu->dev_status[4] = hdfu->dev_state;
+    hdfu->wblock_num = 0U;
+    hdfu->wlength = 0U;
+  }
+  else
+  {
+    return DFU_Stall(pdev, req, DFU_ERROR_STALLEDPKT);
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  DFU_Stall
+  *         Stall a request the state does not allow, the interface goes to dfuERROR
+  * @param  pdev: device instance
+  * @param  req: pointer to the request structure
+  * @param  status: DFU status reported by the next GETSTATUS
+  * @retval status
+  */
+static uint8_t DFU_Stall(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req,
+                         uint8_t status)
+{
+  USBD_DFU_HandleTypeDef *hdfu = USBD_DFU_Handle;
+
+  hdfu->dev_state = DFU_STATE_ERROR;
+  hdfu->dev_status[0] = status;
+  hdfu->dev_status[4] = hdfu->dev_state;
+
+  USBD_CtlError(pdev, req);
+
+  return (uint8_t)USBD_FAIL;
+}
+
+/**
+  * @brief  DFU_ProcessError
+  *         Status of a block that failed in USBD_DFU_Process() this session
+  * @param  hdfu: class data
+  * @retval DFU_ERROR_NONE if none
+  */
+static uint8_t DFU_ProcessError(USBD_DFU_HandleTypeDef *hdfu)
+{
+  uint32_t error = hdfu->Error;
+
+  if ((error >> 8) != (hdfu->Epoch & 0x00FFFFFFU))
+  {
+    return DFU_ERROR_NONE;
+  }
+
+  return (uint8_t)(error & 0xFFU);
+}
+
+/**
+  * @brief  DFU_QueueBlock
+  *         Hand the block received to USBD_DFU_Process()
+  * @param  hdfu: class data
+  * @param  addr: erase or program address
+  * @param  cmd: DFU_MEDIA_ERASE or DFU_MEDIA_PROGRAM
+  * @retval None
+  */
+static void DFU_QueueBlock(USBD_DFU_HandleTypeDef *hdfu, uint32_t addr,
+                           uint8_t cmd)
+{
+  USBD_DFU_BlockTypeDef *blk = &hdfu->block[hdfu->BlockHead % USBD_DFU_BLOCK_COUNT];
+
+  blk->Addr = addr;
+  blk->BlockNum = (cmd == DFU_MEDIA_ERASE) ? 0U : hdfu->wblock_num;
+  blk->Length = hdfu->wlength;
+  blk->Epoch = hdfu->Epoch;
+
+  hdfu->LastAddr = addr;
+  hdfu->LastCmd = cmd;
+
+  /* Visible to USBD_DFU_Process() once complete */
+  hdfu->BlockHead++;
+}
+
+/**
+  * @}
+  */
+
+
+/**
+  * @}
+  */
+
+
+/**
+  * @}
+  */
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
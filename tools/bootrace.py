@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Decode the boot trace (trace.h) into a per-phase latency breakdown.
+
+usage: bootrace.py <dump.bin> [--csv]
+
+dump.bin is the raw TRACE_SIZE bytes at TRACE_BASE (0x2001FE00), exported by the
+application or saved from a debugger. Every boot still in the ring is listed with
+the time each phase took (since the mark before it), followed by the mean per
+phase over the complete boots. --csv prints one line per phase mean, to keep
+with a release and diff against the next one.
+"""
+
+import struct
+import sys
+
+TRACE_MAGIC = 0x43525442
+TRACE_ENTRIES = 60
+HDR_FMT = '<IIII'
+ENTRY_FMT = '<IBBH'
+
+PHASES = {
+    1: 'reset',
+    2: 'hal_init',
+    3: 'clock_config',
+    4: 'gpio_init',
+    5: 'clock_fast',
+    6: 'chksum_init',
+    7: 'slot_select',
+    8: 'dfu_start',
+    9: 'dfu_erase',
+    10: 'dfu_download',
+    11: 'dfu_commit',
+    12: 'dfu_done',
+    13: 'boot_attempt',
+    14: 'clock_reset',
+    15: 'jump',
+}
+TRACE_RESET = 1
+TRACE_JUMP = 15
+
+
+def entries(dump):
+    magic, boot, head, _ = struct.unpack_from(HDR_FMT, dump)
+    if magic != TRACE_MAGIC:
+        raise ValueError('no trace (magic %#010x)' % magic)
+    base = struct.calcsize(HDR_FMT)
+    size = struct.calcsize(ENTRY_FMT)
+    count = min(head, TRACE_ENTRIES)
+    out = []
+    for n in range(head - count, head):
+        out.append(struct.unpack_from(ENTRY_FMT, dump, base + (n % TRACE_ENTRIES) * size))
+    return out
+
+
+def boots(marks):
+    # split at reset marks, a boot cut by the ring has no reset mark and is dropped
+    out = []
+    for mark in marks:
+        if mark[1] == TRACE_RESET:
+            out.append([mark])
+        elif out:
+            out[-1].append(mark)
+    return out
+
+
+def phases(boot):
+    # (name, arg, cycles, us), a phase ran at the clock of the mark before it
+    out = []
+    for prev, mark in zip(boot, boot[1:]):
+        cycles = (mark[0] - prev[0]) & 0xFFFFFFFF
+        out.append((PHASES.get(mark[1], 'phase_%d' % mark[1]), mark[3], cycles, cycles / max(prev[2], 1)))
+    return out
+
+
+def main(argv):
+    args = [a for a in argv if not a.startswith('--')]
+    if not args:
+        print(__doc__)
+        return 1
+    try:
+        runs = boots(entries(open(args[0], 'rb').read()))
+    except (ValueError, struct.error) as e:
+        print('%s: %s' % (args[0], e))
+        return 1
+    total = {}
+    complete = 0
+    for boot in runs:
+        steps = phases(boot)
+        if '--csv' not in argv:
+            print('boot %d' % boot[0][3])
+            for name, arg, cycles, us in steps:
+                print('  %-14s %10d cycles %10.1f us  arg %d' % (name, cycles, us, arg))
+            print('  %-14s %10s        %10.1f us' % ('total', '', sum(s[3] for s in steps)))
+        if boot[-1][1] != TRACE_JUMP:
+            continue
+        complete += 1
+        for name, _, _, us in steps:
+            total.setdefault(name, []).append(us)
+    if not complete:
+        return 0
+    if '--csv' in argv:
+        print('phase,boots,mean_us')
+        for name, us in total.items():
+            print('%s,%d,%.1f' % (name, len(us), sum(us) / len(us)))
+    else:
+        print('mean over %d boots to the application' % complete)
+        for name, us in total.items():
+            print('  %-14s %10.1f us' % (name, sum(us) / len(us)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
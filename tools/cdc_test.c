@@ -0,0 +1,302 @@
+/* CDC transmit queue of usbd_cdc.c against stub LL calls (Linux host)
+ *
+ *   M=../bootloader/Middlewares/ST/STM32_USB_Device_Library
+ *   gcc -O2 -Wall -D_GNU_SOURCE -DUSBD_POSIX -Wno-pointer-to-int-cast -I../bootloader/Core/Inc \
+ *       -I$M/Core/Inc -I$M/Class/CDC/Inc cdc_test.c $M/Class/CDC/Src/usbd_cdc.c -o cdc_test
+ *   ./cdc_test
+ *
+ * The class runs as on the target, USBD_LL_Transmit() only notes the transfer it is
+ * handed and the test completes it by calling DataIn(), as the IN interrupt does:
+ *   - short     a transfer that ends on a short packet completes without a ZLP
+ *   - full      a transfer of 64 * n bytes is followed by a ZLP, then completes
+ *   - chained   bytes queued while a transfer is in flight go as one transfer from
+ *               its DataIn(), also when that DataIn() is the one of a ZLP
+ *   - wrap      a transfer stops at TxQueueSize, the rest goes from the queue start,
+ *               a full queue takes TxQueueSize - 1 bytes
+ * Every transfer must start where the last one ended, and the bytes sent must be the
+ * bytes queued in order. Exit code 0 when all passed.
+ **/
+#include "usbd_cdc.h"
+#include "usbd_ctlreq.h"
+#include "usbd_ioreq.h"
+#include <stdio.h>
+#include <string.h>
+
+#define QUEUE_SIZE          256
+#define PACKET_SIZE         CDC_DATA_FS_IN_PACKET_SIZE
+#define SENT_MAX            4096
+
+typedef struct {
+    uint8_t *pucBuf;
+    uint32_t ulLen;
+    uint32_t ulCount;                   // USBD_LL_Transmit calls on the IN endpoint
+} Transfer_t;
+
+static USBD_HandleTypeDef xDev;
+static PCD_HandleTypeDef xPcd;
+static uint32_t ulArena[(USBD_CDC_ARENA_SIZE + 3) / 4];
+static uint8_t ucQueue[QUEUE_SIZE];
+static uint8_t ucRx[CDC_DATA_FS_OUT_PACKET_SIZE];
+static Transfer_t xLast;
+static uint32_t ulCplt;
+static uint8_t ucSent[SENT_MAX];
+static uint32_t ulSentLen;
+static uint8_t ucQueued[SENT_MAX];
+static uint32_t ulQueuedLen;
+static uint32_t ulFailed;
+
+USBD_StatusTypeDef USBD_LL_Transmit(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *pbuf, uint32_t size) {
+    (void)pdev;
+    if ((ep_addr & 0x0FU) == (CDC_IN_EP & 0x0FU)) {
+        xLast.pucBuf = pbuf;
+        xLast.ulLen = size;
+        xLast.ulCount++;
+    }
+    return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_OpenEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t ep_type, uint16_t ep_mps) {
+    (void)pdev;
+    (void)ep_type;
+    if (ep_addr & 0x80U) {
+        xPcd.IN_ep[ep_addr & 0x0FU].maxpacket = ep_mps;
+    }
+    return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_CloseEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+    (void)pdev;
+    (void)ep_addr;
+    return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_PrepareReceive(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *pbuf, uint32_t size) {
+    (void)pdev;
+    (void)ep_addr;
+    (void)pbuf;
+    (void)size;
+    return USBD_OK;
+}
+
+uint32_t USBD_LL_GetRxDataSize(USBD_HandleTypeDef *pdev, uint8_t ep_addr) {
+    (void)pdev;
+    (void)ep_addr;
+    return 0;
+}
+
+USBD_StatusTypeDef USBD_CtlSendData(USBD_HandleTypeDef *pdev, uint8_t *pbuf, uint32_t len) {
+    (void)pdev;
+    (void)pbuf;
+    (void)len;
+    return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_CtlPrepareRx(USBD_HandleTypeDef *pdev, uint8_t *pbuf, uint32_t len) {
+    (void)pdev;
+    (void)pbuf;
+    (void)len;
+    return USBD_OK;
+}
+
+void USBD_CtlError(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req) {
+    (void)pdev;
+    (void)req;
+}
+
+static int8_t prvItfInit(void) {
+    USBD_CDC_SetTxQueue(&xDev, ucQueue, sizeof(ucQueue));
+    USBD_CDC_SetRxBuffer(&xDev, ucRx);
+    return USBD_OK;
+}
+
+static int8_t prvItfNone(void) {
+    return USBD_OK;
+}
+
+static int8_t prvItfControl(uint8_t cmd, uint8_t *pbuf, uint16_t length) {
+    (void)cmd;
+    (void)pbuf;
+    (void)length;
+    return USBD_OK;
+}
+
+static int8_t prvItfReceive(uint8_t *Buf, uint32_t *Len) {
+    (void)Buf;
+    (void)Len;
+    return USBD_OK;
+}
+
+static int8_t prvItfTransmitCplt(uint8_t *Buf, uint32_t *Len, uint8_t epnum) {
+    (void)Buf;
+    (void)Len;
+    (void)epnum;
+    ulCplt++;
+    return USBD_OK;
+}
+
+static USBD_CDC_ItfTypeDef xItf = { prvItfInit, prvItfNone, prvItfControl, prvItfReceive, prvItfTransmitCplt };
+
+static void prvExpect(const char *pcCase, const char *pcWhat, uint32_t ulGot, uint32_t ulWant) {
+    if (ulGot != ulWant) {
+        if (ulFailed++ < 20) {
+            printf("FAIL %s, %s: %u, expected %u\n", pcCase, pcWhat, ulGot, ulWant);
+        }
+    }
+}
+
+static USBD_CDC_HandleTypeDef *prvCdc(void) {
+    return (USBD_CDC_HandleTypeDef *)xDev.pClassData;
+}
+
+// Fresh class instance, the queue empty at offset ulStart
+static void prvReset(uint32_t ulStart) {
+    memset(&xDev, 0, sizeof(xDev));
+    memset(&xPcd, 0, sizeof(xPcd));
+    xDev.dev_speed = USBD_SPEED_FULL;
+    xDev.pData = &xPcd;
+    xDev.pUserData = &xItf;
+    USBD_CDC.Init(&xDev, 0);
+    prvCdc()->TxQueueHead = ulStart;
+    prvCdc()->TxQueueTail = ulStart;
+    memset(&xLast, 0, sizeof(xLast));
+    ulCplt = 0;
+    ulSentLen = 0;
+    ulQueuedLen = 0;
+}
+
+static uint32_t prvQueue(uint32_t ulLen) {
+    uint8_t data[QUEUE_SIZE];
+    for (uint32_t i = 0; i < ulLen && i < sizeof(data); i++) {
+        data[i] = (uint8_t)(ulQueuedLen + i + 1);
+    }
+    uint32_t count = USBD_CDC_Queue(&xDev, data, ulLen < sizeof(data) ? ulLen : sizeof(data));
+    memcpy(&ucQueued[ulQueuedLen], data, count);
+    ulQueuedLen += count;
+    return count;
+}
+
+// The transfer in flight is done, its bytes go to the host, the IN interrupt runs
+static void prvComplete(const char *pcCase) {
+    USBD_CDC_HandleTypeDef *hcdc = prvCdc();
+    prvExpect(pcCase, "transfer length", xLast.ulLen, hcdc->TxLength);
+    if (xLast.ulLen > 0) {
+        prvExpect(pcCase, "transfer at the queue tail", (uint32_t)(xLast.pucBuf - ucQueue), hcdc->TxQueueTail);
+        prvExpect(pcCase, "transfer inside the queue", hcdc->TxQueueTail + xLast.ulLen <= QUEUE_SIZE, 1);
+        memcpy(&ucSent[ulSentLen], xLast.pucBuf, xLast.ulLen);
+        ulSentLen += xLast.ulLen;
+    }
+    USBD_CDC.DataIn(&xDev, CDC_IN_EP & 0x0FU);
+}
+
+static void prvExpectSent(const char *pcCase) {
+    prvExpect(pcCase, "bytes sent", ulSentLen, ulQueuedLen);
+    prvExpect(pcCase, "bytes sent as queued", memcmp(ucSent, ucQueued, ulQueuedLen) == 0, 1);
+    prvExpect(pcCase, "idle at the end", prvCdc()->TxState, 0);
+    prvExpect(pcCase, "queue empty at the end", USBD_CDC_GetTxQueued(&xDev), 0);
+}
+
+static void prvTestShort(void) {
+    prvReset(0);
+    prvQueue(10);
+    prvExpect("short", "transfers", xLast.ulCount, 1);
+    prvExpect("short", "length", xLast.ulLen, 10);
+    prvComplete("short");
+    prvExpect("short", "transfers after DataIn, no ZLP", xLast.ulCount, 1);
+    prvExpect("short", "TransmitCplt", ulCplt, 1);
+    prvExpectSent("short");
+}
+
+static void prvTestFull(void) {
+    for (uint32_t n = 1; n <= 3; n++) {
+        prvReset(0);
+        prvQueue(n * PACKET_SIZE);
+        prvExpect("full", "length", xLast.ulLen, n * PACKET_SIZE);
+        prvComplete("full");
+        prvExpect("full", "ZLP", xLast.ulCount == 2 && xLast.ulLen == 0, 1);
+        prvExpect("full", "TransmitCplt before the ZLP is out", ulCplt, 0);
+        prvComplete("full");
+        prvExpect("full", "transfers after the ZLP", xLast.ulCount, 2);
+        prvExpect("full", "TransmitCplt", ulCplt, 1);
+        prvExpectSent("full");
+    }
+}
+
+static void prvTestChained(void) {
+    // behind a short transfer
+    prvReset(0);
+    prvQueue(10);
+    prvQueue(20);
+    prvQueue(30);
+    prvExpect("chained", "transfers while one is in flight", xLast.ulCount, 1);
+    prvComplete("chained");
+    prvExpect("chained", "one transfer of what was queued", xLast.ulCount == 2 && xLast.ulLen == 50, 1);
+    prvComplete("chained");
+    prvExpect("chained", "transfers", xLast.ulCount, 2);
+    prvExpectSent("chained");
+
+    // behind a ZLP
+    prvReset(0);
+    prvQueue(PACKET_SIZE);
+    prvComplete("chained ZLP");
+    prvExpect("chained ZLP", "ZLP", xLast.ulLen, 0);
+    prvQueue(5);
+    prvExpect("chained ZLP", "transfers while the ZLP is in flight", xLast.ulCount, 2);
+    prvComplete("chained ZLP");
+    prvExpect("chained ZLP", "transfer after the ZLP", xLast.ulCount == 3 && xLast.ulLen == 5, 1);
+    prvComplete("chained ZLP");
+    prvExpect("chained ZLP", "TransmitCplt", ulCplt, 1);
+    prvExpectSent("chained ZLP");
+}
+
+static void prvTestWrap(void) {
+    // 100 bytes from 200 on, 56 up to the queue end then 44 from its start
+    prvReset(200);
+    prvQueue(100);
+    prvExpect("wrap", "transfer up to the queue end", xLast.ulLen, QUEUE_SIZE - 200);
+    prvComplete("wrap");
+    prvExpect("wrap", "rest from the queue start", xLast.ulCount == 2 && xLast.ulLen == 100 - (QUEUE_SIZE - 200), 1);
+    prvComplete("wrap");
+    prvExpectSent("wrap");
+
+    // a transfer of 64 * n up to the queue end is followed by the rest, not a ZLP
+    prvReset(QUEUE_SIZE - PACKET_SIZE);
+    prvQueue(PACKET_SIZE + 7);
+    prvExpect("wrap full", "transfer up to the queue end", xLast.ulLen, PACKET_SIZE);
+    prvComplete("wrap full");
+    prvExpect("wrap full", "rest, no ZLP", xLast.ulCount == 2 && xLast.ulLen == 7, 1);
+    prvComplete("wrap full");
+    prvExpectSent("wrap full");
+
+    // the queue holds TxQueueSize - 1 bytes, and more once the transfer is out
+    prvReset(100);
+    prvExpect("wrap fill", "bytes taken", prvQueue(QUEUE_SIZE), QUEUE_SIZE - 1);
+    prvExpect("wrap fill", "bytes taken when full", prvQueue(1), 0);
+    prvComplete("wrap fill");
+    prvExpect("wrap fill", "bytes taken after a transfer", prvQueue(QUEUE_SIZE), QUEUE_SIZE - 100);
+    for (int i = 0; i < 8 && prvCdc()->TxState != 0; i++) {
+        prvComplete("wrap fill");
+    }
+    prvExpectSent("wrap fill");
+}
+
+int main(void) {
+    if (USBD_CDC_RegisterArena(ulArena, sizeof(ulArena)) != USBD_OK) {
+        printf("FAIL arena\n");
+        return 1;
+    }
+    struct {
+        const char *pcName;
+        void (*pxTest)(void);
+    } tests[] = {
+        { "short", prvTestShort },
+        { "full", prvTestFull },
+        { "chained", prvTestChained },
+        { "wrap", prvTestWrap },
+    };
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        uint32_t failed = ulFailed;
+        tests[i].pxTest();
+        printf("%-8s %s\n", tests[i].pcName, ulFailed != failed ? "FAIL" : "ok");
+    }
+    return ulFailed ? 1 : 0;
+}
@@ -0,0 +1,246 @@
+/* Stream decoders against the host packers (Linux host)
+ *
+ *   gcc -O2 -Wall -I../bootloader/Core/Inc codec_test.c ../bootloader/Core/Src/lz4_stream.c \
+ *       ../bootloader/Core/Src/delta.c ../bootloader/Core/Src/crc16.c -o codec_test
+ *   python3 lz4pack.py d2.bin /tmp/d2.lz4 && ./codec_test lz4 d2.bin /tmp/d2.lz4
+ *   python3 delta.py d2.bin d3.bin /tmp/d3.delta && ./codec_test delta d2.bin d3.bin /tmp/d3.delta
+ *   ./codec_test edit d3.bin /tmp/d4.bin
+ *   python3 delta.py d3.bin /tmp/d4.bin /tmp/d4.delta && ./codec_test delta d3.bin /tmp/d4.bin /tmp/d4.delta
+ *
+ * The packed stream is fed to the bootloader decoder in pieces of 1, 3, 64, 1000 bytes
+ * and in one piece, back references read what was already put out, the way the
+ * bootloader reads back programmed flash, a delta patch reads its source from the old
+ * image, which stands for the running slot. The output must match the image byte for
+ * byte and the decoder must be at a point where the stream may end. Exit code 0
+ * when every split passed.
+ *
+ * d2 -> d3 changes 2 bytes in place, edit makes a new image the way a rebuild moves
+ * code: 300 bytes inserted after the first quarter, every 64th byte of the second
+ * quarter changed, 256 bytes removed in the middle so the tail shifts, and 512 bytes
+ * of the head repeated at the end. The patch of that pair has INSERT, DIFF, forward
+ * and backward SEEK and multi-byte lengths, the delta test lists the ops it found.
+ **/
+#include "crc16.h"
+#include "delta.h"
+#include "lz4_stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint8_t *pucBuf;
+    uint32_t ulSize;
+    uint32_t ulLen;
+    const uint8_t *pucSrc;              // delta source, the old image
+} Output_t;
+
+static const uint32_t ulChunks[] = { 1, 3, 64, 1000, 0 };   // 0: all at once
+
+#define EDIT_INSERT         300
+#define EDIT_REMOVE         256
+#define EDIT_REPEAT         512
+#define EDIT_REPEAT_FROM    64
+#define EDIT_SIZE_MIN       (4 * (EDIT_REMOVE + EDIT_REPEAT_FROM + EDIT_REPEAT))
+
+static uint8_t *prvLoad(const char *pcPath, uint32_t *pulSize) {
+    FILE *f = fopen(pcPath, "rb");
+    if (f == NULL) {
+        perror(pcPath);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(size > 0 ? (size_t)size : 1);
+    if (buf == NULL || fread(buf, 1, (size_t)size, f) != (size_t)size) {
+        fprintf(stderr, "%s: read failed\n", pcPath);
+        fclose(f);
+        free(buf);
+        return NULL;
+    }
+    fclose(f);
+    *pulSize = (uint32_t)size;
+    return buf;
+}
+
+static bool prvPut(uint8_t ucByte, void *pvCtx) {
+    Output_t *out = pvCtx;
+    if (out->ulLen == out->ulSize) {
+        return false;
+    }
+    out->pucBuf[out->ulLen++] = ucByte;
+    return true;
+}
+
+static uint8_t prvGet(uint32_t ulDist, void *pvCtx) {
+    Output_t *out = pvCtx;
+    return ulDist <= out->ulLen ? out->pucBuf[out->ulLen - ulDist] : 0;
+}
+
+static uint8_t prvSrc(uint32_t ulOffset, void *pvCtx) {
+    return ((Output_t *)pvCtx)->pucSrc[ulOffset];
+}
+
+// Byte for byte against the image, first difference reported
+static bool prvCompare(const char *pcName, uint32_t ulChunk, const Output_t *pxOut, const uint8_t *pucImage,
+                       uint32_t ulImageSize, bool xDone) {
+    uint32_t off = 0;
+    while (off < pxOut->ulLen && off < ulImageSize && pxOut->pucBuf[off] == pucImage[off]) {
+        off++;
+    }
+    bool ok = xDone && off == ulImageSize && pxOut->ulLen == ulImageSize;
+    printf("%-6s chunk %5u: %s", pcName, ulChunk, ok ? "ok" : "FAIL");
+    if (ok == false) {
+        printf(", %u of %u bytes out, first difference at %u%s", pxOut->ulLen, ulImageSize, off,
+               xDone ? "" : ", not done");
+    }
+    printf("\n");
+    return ok;
+}
+
+static bool prvTestLz4(const uint8_t *pucImage, uint32_t ulImageSize, const uint8_t *pucStream, uint32_t ulStreamSize) {
+    Output_t out = { malloc(ulImageSize + 1), ulImageSize, 0, NULL };
+    bool pass = true;
+    for (size_t i = 0; i < sizeof(ulChunks) / sizeof(ulChunks[0]); i++) {
+        uint32_t chunk = ulChunks[i] ? ulChunks[i] : ulStreamSize;
+        Lz4Stream_t stream;
+        vLz4StreamInit(&stream, prvPut, prvGet, &out);
+        out.ulLen = 0;
+        bool fed = true;
+        for (uint32_t off = 0; off < ulStreamSize && fed; off += chunk) {
+            uint32_t len = ulStreamSize - off < chunk ? ulStreamSize - off : chunk;
+            fed = xLz4StreamFeed(&stream, &pucStream[off], len);
+        }
+        pass = prvCompare("lz4", chunk, &out, pucImage, ulImageSize, fed && xLz4StreamIsDone(&stream)) && pass;
+    }
+    free(out.pucBuf);
+    return pass;
+}
+
+static bool prvTestDelta(const uint8_t *pucOld, uint32_t ulOldSize, const uint8_t *pucImage, uint32_t ulImageSize,
+                         const uint8_t *pucPatch, uint32_t ulPatchSize) {
+    Output_t out = { malloc(ulImageSize + 1), ulImageSize, 0, pucOld };
+    // the chksum the trailer of the running slot holds
+    uint32_t old_chksum = CRC16((unsigned char *)pucOld, ulOldSize);
+    bool pass = true;
+    for (size_t i = 0; i < sizeof(ulChunks) / sizeof(ulChunks[0]); i++) {
+        uint32_t chunk = ulChunks[i] ? ulChunks[i] : ulPatchSize;
+        Delta_t delta;
+        vDeltaInit(&delta, ulOldSize, old_chksum, prvPut, prvSrc, &out);
+        out.ulLen = 0;
+        bool fed = true;
+        for (uint32_t off = 0; off < ulPatchSize && fed; off += chunk) {
+            uint32_t len = ulPatchSize - off < chunk ? ulPatchSize - off : chunk;
+            fed = xDeltaFeed(&delta, &pucPatch[off], len);
+        }
+        pass = prvCompare("delta", chunk, &out, pucImage, ulImageSize, fed && xDeltaIsDone(&delta)) && pass;
+    }
+    free(out.pucBuf);
+    return pass;
+}
+
+// Ops of the patch by type, and how many took more than one varint byte
+static void prvDeltaOps(const uint8_t *pucPatch, uint32_t ulPatchSize) {
+    static const char *const pcOp[] = { "?", "copy", "diff", "insert", "seek" };
+    uint32_t count[5] = { 0 };
+    uint32_t back = 0;
+    uint32_t wide = 0;
+    uint32_t off = DELTA_HDR_SIZE;
+    while (off < ulPatchSize) {
+        uint8_t op = pucPatch[off++];
+        uint32_t arg = 0;
+        uint32_t len = 0;
+        for (uint32_t shift = 0; off < ulPatchSize; shift += 7) {
+            uint8_t b = pucPatch[off++];
+            arg |= (uint32_t)(b & 0x7F) << shift;
+            len++;
+            if ((b & 0x80) == 0) {
+                break;
+            }
+        }
+        count[op <= DELTA_OP_SEEK ? op : 0]++;
+        wide += len > 1;
+        back += op == DELTA_OP_SEEK && (arg & 1);
+        off += op == DELTA_OP_DIFF || op == DELTA_OP_INSERT ? arg : 0;
+    }
+    printf("delta  ops:");
+    for (int i = 1; i <= DELTA_OP_SEEK; i++) {
+        printf(" %s %u%s", pcOp[i], count[i], i == DELTA_OP_SEEK ? "" : ",");
+    }
+    printf(" (%u back), multi-byte args %u%s\n", back, wide, count[0] ? ", unknown ops" : "");
+}
+
+static uint32_t prvRand(uint32_t *pulSeed) {
+    *pulSeed = *pulSeed * 1103515245 + 12345;
+    return *pulSeed >> 16;
+}
+
+// A rebuilt image as delta.py sees it, see the top of the file
+static bool prvEdit(const uint8_t *pucOld, uint32_t ulOldSize, const char *pcPath) {
+    if (ulOldSize < EDIT_SIZE_MIN) {
+        fprintf(stderr, "edit needs an image of %u bytes at least\n", EDIT_SIZE_MIN);
+        return false;
+    }
+    uint32_t quarter = ulOldSize / 4;
+    uint32_t half = ulOldSize / 2;
+    uint8_t *out = malloc(ulOldSize + EDIT_INSERT + EDIT_REPEAT);
+    uint32_t len = 0;
+    uint32_t seed = 1;
+    memcpy(&out[len], pucOld, quarter);
+    len += quarter;
+    for (uint32_t i = 0; i < EDIT_INSERT; i++) {
+        out[len++] = (uint8_t)prvRand(&seed);
+    }
+    for (uint32_t i = quarter; i < half; i++) {
+        out[len++] = (uint8_t)(pucOld[i] + ((i - quarter) % 64 == 63));
+    }
+    memcpy(&out[len], &pucOld[half + EDIT_REMOVE], ulOldSize - half - EDIT_REMOVE);
+    len += ulOldSize - half - EDIT_REMOVE;
+    memcpy(&out[len], &pucOld[EDIT_REPEAT_FROM], EDIT_REPEAT);
+    len += EDIT_REPEAT;
+
+    FILE *f = fopen(pcPath, "wb");
+    bool ok = f != NULL && fwrite(out, 1, len, f) == len;
+    if (f == NULL || fclose(f) != 0 || ok == false) {
+        perror(pcPath);
+        ok = false;
+    }
+    free(out);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    bool lz4 = argc == 4 && strcmp(argv[1], "lz4") == 0;
+    bool delta = argc == 5 && strcmp(argv[1], "delta") == 0;
+    bool edit = argc == 4 && strcmp(argv[1], "edit") == 0;
+    if (lz4 == false && delta == false && edit == false) {
+        fprintf(stderr, "usage: %s lz4 image.bin image.lz4\n"
+                "       %s delta old.bin new.bin patch.bin\n"
+                "       %s edit old.bin new.bin\n", argv[0], argv[0], argv[0]);
+        return 1;
+    }
+    if (edit) {
+        uint32_t size;
+        uint8_t *old = prvLoad(argv[2], &size);
+        bool ok = old != NULL && prvEdit(old, size, argv[3]);
+        free(old);
+        return ok ? 0 : 1;
+    }
+    uint32_t sizes[3];
+    uint8_t *files[3] = { NULL, NULL, NULL };
+    bool pass = true;
+    for (int i = 0; i < argc - 2 && pass; i++) {
+        files[i] = prvLoad(argv[i + 2], &sizes[i]);
+        pass = files[i] != NULL;
+    }
+    if (pass && lz4) {
+        pass = prvTestLz4(files[0], sizes[0], files[1], sizes[1]);
+    } else if (pass) {
+        prvDeltaOps(files[2], sizes[2]);
+        pass = prvTestDelta(files[0], sizes[0], files[1], sizes[1], files[2], sizes[2]);
+    }
+    for (int i = 0; i < 3; i++) {
+        free(files[i]);
+    }
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+/* CRC16 kernel benchmark (Linux host)
+ *
+ *   gcc -O2 -I../bootloader/Core/Inc crc16_bench.c ../bootloader/Core/Src/crc16.c -o crc16_bench
+ *   ./crc16_bench d2.bin d3.bin
+ *
+ * add -DCRC16_SLICE=8 (or 1) to try the other table sets. Every file is first checked
+ * bit for bit against the byte kernel at all head alignments and lengths, then both
+ * kernels are timed.
+ **/
+#include "crc16.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_BYTES     (64UL << 20)    // per kernel and file
+
+extern const unsigned char CRCHi[];
+extern const unsigned char CRCLo[];
+
+// the byte kernel as it was before slicing
+static unsigned int prvCRC16Ref(unsigned int usCRC, const unsigned char *pucFrame, unsigned int usLen) {
+    unsigned char ucCRCHi = (unsigned char)(usCRC >> 8);
+    unsigned char ucCRCLo = (unsigned char)usCRC;
+    unsigned int iIndex;
+    while (usLen--) {
+        iIndex = ucCRCLo ^ *(pucFrame++);
+        ucCRCLo = ucCRCHi ^ CRCHi[iIndex];
+        ucCRCHi = CRCLo[iIndex];
+    }
+    return (unsigned int)(ucCRCHi << 8 | ucCRCLo);
+}
+
+static double prvNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int prvCheck(const unsigned char *pucBuf, unsigned int ulLen) {
+    for (unsigned int off = 0; off < 8 && off < ulLen; off++) {
+        for (unsigned int len = 0; off + len <= ulLen; len += (len < 64) ? 1 : 61) {
+            if (CRC16_Update(0xFFFF, (unsigned char *)pucBuf + off, len) != prvCRC16Ref(0xFFFF, pucBuf + off, len)) {
+                printf("  mismatch at offset %u length %u\n", off, len);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <file> ...\n", argv[0]);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (f == NULL) {
+            perror(argv[i]);
+            return 1;
+        }
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        unsigned char *buf = malloc(size + 4);
+        if (buf == NULL || fread(buf, 1, size, f) != (size_t)size) {
+            fclose(f);
+            return 1;
+        }
+        fclose(f);
+
+        printf("%s: %ld bytes, crc 0x%04X\n", argv[i], size, CRC16(buf, size));
+        if (prvCheck(buf, size) != 0) {
+            return 1;
+        }
+        unsigned long loops = BENCH_BYTES / (size ? size : 1) + 1;
+        volatile unsigned int sink = 0;
+
+        double t0 = prvNow();
+        for (unsigned long n = 0; n < loops; n++) {
+            sink ^= prvCRC16Ref(0xFFFF, buf, size);
+        }
+        double t1 = prvNow();
+        for (unsigned long n = 0; n < loops; n++) {
+            sink ^= CRC16(buf, size);
+        }
+        double t2 = prvNow();
+
+        double mb = (double)loops * size / 1e6;
+        printf("  byte   : %8.1f MB/s\n", mb / (t1 - t0));
+        printf("  slice  : %8.1f MB/s\n", mb / (t2 - t1));
+        free(buf);
+    }
+    return 0;
+}
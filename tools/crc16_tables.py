@@ -0,0 +1,42 @@
+#!/usr/bin/env python3
+"""Print the slice-by-N tables of the Modbus CRC16 for bootloader/Core/Src/crc16.c
+
+usage: crc16_tables.py [N]      N = 4 (default) or 8
+
+Table k gives the CRC contribution of a byte followed by k zero bytes,
+CRC16Slice[0] is the plain byte table (CRCLo << 8 | CRCHi).
+"""
+
+import sys
+
+
+def tables(n):
+    t = [[0] * 256 for _ in range(n)]
+    for b in range(256):
+        crc = b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+        t[0][b] = crc
+    for k in range(1, n):
+        for b in range(256):
+            prev = t[k - 1][b]
+            t[k][b] = (prev >> 8) ^ t[0][prev & 0xFF]
+    return t
+
+
+def main(argv):
+    n = int(argv[0]) if argv else 4
+    for k, row in enumerate(tables(n)):
+        if k == 4:
+            print('#if CRC16_SLICE == 8')
+        print('{')
+        for i in range(0, 256, 8):
+            print('    ' + ', '.join('0x%04X' % v for v in row[i:i + 8]) + ',')
+        print('},')
+    if n == 8:
+        print('#endif')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
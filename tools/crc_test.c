@@ -0,0 +1,142 @@
+/* Incremental and combined checksums against one-shot ones (Linux host)
+ *
+ *   gcc -O2 -Wall -I../bootloader/Core/Inc crc_test.c ../bootloader/Core/Src/checksum.c \
+ *       ../bootloader/Core/Src/crc16.c -o crc_test
+ *   ./crc_test [file ...]
+ *
+ * For every length up to 300 bytes of a pseudo random buffer, then for each file (d2.bin,
+ * d3.bin), the buffer is split at every point (the points a CRC32 update allows, word
+ * multiples, for the CRC32) and must give the one-shot checksum:
+ *   - CRC16_Init / CRC16_Update / CRC16_Final and ulChkSumUpdate over the two parts
+ *   - CRC16_Combine and ulChkSumCombine of the checksums of the two parts
+ * The one-shot checksums are themselves checked against bitwise references, and the
+ * CRC16 against its check value (0x4B37 for "123456789"). Exit code 0 when all passed.
+ **/
+#include "checksum.h"
+#include "crc16.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RANDOM_LEN_MAX      300
+
+static uint32_t ulFailed;
+
+// Modbus CRC16, bit by bit
+static uint32_t prvCrc16Ref(const uint8_t *pucData, uint32_t ulLen) {
+    uint32_t crc = 0xFFFF;
+    for (uint32_t i = 0; i < ulLen; i++) {
+        crc ^= pucData[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+// STM32 CRC unit, little endian words MSB first, tail zero padded
+static uint32_t prvCrc32Ref(const uint8_t *pucData, uint32_t ulLen) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < ulLen; i += 4) {
+        uint32_t word = 0;
+        for (uint32_t k = 0; k < 4 && i + k < ulLen; k++) {
+            word |= (uint32_t)pucData[i + k] << (8 * k);
+        }
+        crc ^= word;
+        for (int b = 0; b < 32; b++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static void prvExpect(const char *pcWhat, uint32_t ulLen, uint32_t ulSplit, uint32_t ulGot, uint32_t ulWant) {
+    if (ulGot != ulWant) {
+        if (ulFailed++ < 20) {
+            printf("FAIL %s, length %u split %u: 0x%08X, expected 0x%08X\n", pcWhat, ulLen, ulSplit, ulGot, ulWant);
+        }
+    }
+}
+
+static void prvTestCrc16(const uint8_t *pucData, uint32_t ulLen) {
+    uint8_t *data = (uint8_t *)pucData;
+    uint32_t whole = CRC16(data, ulLen);
+    prvExpect("CRC16 vs reference", ulLen, ulLen, whole, prvCrc16Ref(pucData, ulLen));
+    prvExpect("ulChkSumCalc CRC16", ulLen, ulLen, ulChkSumCalc(CHK_ALG_CRC16, pucData, ulLen), whole);
+    for (uint32_t split = 0; split <= ulLen; split++) {
+        uint32_t crc = CRC16_Update(CRC16_Init(), data, split);
+        prvExpect("CRC16_Update", ulLen, split, CRC16_Final(CRC16_Update(crc, &data[split], ulLen - split)), whole);
+        crc = ulChkSumUpdate(CHK_ALG_CRC16, ulChkSumInit(CHK_ALG_CRC16), pucData, split);
+        crc = ulChkSumUpdate(CHK_ALG_CRC16, crc, &pucData[split], ulLen - split);
+        prvExpect("ulChkSumUpdate CRC16", ulLen, split, ulChkSumFinal(CHK_ALG_CRC16, crc), whole);
+        uint32_t crc1 = CRC16(data, split);
+        uint32_t crc2 = CRC16(&data[split], ulLen - split);
+        prvExpect("CRC16_Combine", ulLen, split, CRC16_Combine(crc1, crc2, ulLen - split), whole);
+        prvExpect("ulChkSumCombine CRC16", ulLen, split, ulChkSumCombine(CHK_ALG_CRC16, crc1, crc2, ulLen - split), whole);
+    }
+}
+
+static void prvTestCrc32(const uint8_t *pucData, uint32_t ulLen) {
+    uint32_t whole = ulChkSumCalc(CHK_ALG_CRC32, pucData, ulLen);
+    prvExpect("CRC32 vs reference", ulLen, ulLen, whole, prvCrc32Ref(pucData, ulLen));
+    // the first part in words, the tail may be the last update only
+    for (uint32_t split = 0; split <= ulLen; split += 4) {
+        uint32_t crc = ulChkSumUpdate(CHK_ALG_CRC32, ulChkSumInit(CHK_ALG_CRC32), pucData, split);
+        crc = ulChkSumUpdate(CHK_ALG_CRC32, crc, &pucData[split], ulLen - split);
+        prvExpect("ulChkSumUpdate CRC32", ulLen, split, ulChkSumFinal(CHK_ALG_CRC32, crc), whole);
+        uint32_t crc1 = ulChkSumCalc(CHK_ALG_CRC32, pucData, split);
+        uint32_t crc2 = ulChkSumCalc(CHK_ALG_CRC32, &pucData[split], ulLen - split);
+        prvExpect("ulChkSumCombine CRC32", ulLen, split, ulChkSumCombine(CHK_ALG_CRC32, crc1, crc2, ulLen - split), whole);
+    }
+}
+
+static uint8_t *prvLoad(const char *pcPath, uint32_t *pulLen) {
+    FILE *f = fopen(pcPath, "rb");
+    if (f == NULL) {
+        perror(pcPath);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(len > 0 ? (size_t)len : 1);
+    if (buf == NULL || fread(buf, 1, (size_t)len, f) != (size_t)len) {
+        fprintf(stderr, "%s: read failed\n", pcPath);
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *pulLen = (uint32_t)len;
+    return buf;
+}
+
+int main(int argc, char **argv) {
+    uint8_t check[] = "123456789";
+    prvExpect("CRC16 check value", 9, 9, CRC16(check, 9), 0x4B37);
+
+    uint8_t random[RANDOM_LEN_MAX];
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < sizeof(random); i++) {
+        seed = seed * 1103515245 + 12345;
+        random[i] = (uint8_t)(seed >> 16);
+    }
+    for (uint32_t len = 0; len <= RANDOM_LEN_MAX; len++) {
+        prvTestCrc16(random, len);
+        prvTestCrc32(random, len);
+    }
+    printf("random 0..%u bytes: %s\n", RANDOM_LEN_MAX, ulFailed ? "FAIL" : "ok");
+
+    for (int i = 1; i < argc; i++) {
+        uint32_t len;
+        uint8_t *data = prvLoad(argv[i], &len);
+        if (data == NULL) {
+            return 1;
+        }
+        uint32_t failed = ulFailed;
+        prvTestCrc16(data, len);
+        prvTestCrc32(data, len);
+        printf("%s, %u bytes: %s\n", argv[i], len, ulFailed != failed ? "FAIL" : "ok");
+        free(data);
+    }
+    return ulFailed ? 1 : 0;
+}
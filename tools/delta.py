@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""Build a delta patch from the running image to a new one.
+
+usage: delta.py <old.bin> <new.bin> [patch.bin] [--verify] [--crc32]
+
+The old image must be byte for byte what the device booted (trailer length and
+chksum are checked against the patch header), --crc32 if its trailer holds the
+CRC32 of the STM32 CRC unit instead of the CRC16. The host announces the patch in
+the dfu image size response as [new size 4] [patch size 4] [format 2 = delta],
+the image chksum is the one of new.bin.
+
+--verify applies the patch to a simulated flash, the same way the bootloader
+does (old image read only, new image written front to back), and compares it
+with new.bin.
+"""
+
+import struct
+import sys
+
+OP_COPY = 0x01
+OP_DIFF = 0x02
+OP_INSERT = 0x03
+OP_SEEK = 0x04
+
+BLOCK = 8           # exact match needed to start an aligned region
+MAX_MISS = 8        # consecutive mismatches that end an aligned region
+MIN_COPY = 4        # shorter equal runs are folded into DIFF
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def crc32_stm32(data):
+    # little endian words, MSB first, tail zero padded, no final xor
+    crc = 0xFFFFFFFF
+    data = bytes(data) + b'\0' * (-len(data) % 4)
+    for i in range(0, len(data), 4):
+        crc ^= struct.unpack_from('<I', data, i)[0]
+        for _ in range(32):
+            crc = ((crc << 1) ^ 0x04C11DB7) & 0xFFFFFFFF if crc & 0x80000000 else (crc << 1) & 0xFFFFFFFF
+    return crc
+
+
+def _varint(n):
+    out = bytearray()
+    while True:
+        b = n & 0x7F
+        n >>= 7
+        if n:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return out
+
+
+def _zigzag(n):
+    return (n << 1) if n >= 0 else ((-n << 1) - 1)
+
+
+class Patch:
+    def __init__(self, old, chksum):
+        self.out = bytearray(struct.pack('<II', len(old), chksum(old)))
+        self.pos = 0
+
+    def op(self, code, arg, data=b''):
+        self.out.append(code)
+        self.out += _varint(arg)
+        self.out += data
+
+    def seek(self, pos):
+        if pos != self.pos:
+            self.op(OP_SEEK, _zigzag(pos - self.pos))
+            self.pos = pos
+
+    def region(self, old, new, opos, npos, length):
+        # split an aligned region into exact runs and diff runs
+        self.seek(opos)
+        i = 0
+        while i < length:
+            j = i
+            while j < length and old[opos + j] == new[npos + j]:
+                j += 1
+            if j - i >= MIN_COPY or j == length:
+                if j > i:
+                    self.op(OP_COPY, j - i)
+                i = j
+                continue
+            # diff run, until the next equal run worth a COPY
+            j = i
+            while j < length:
+                k = j
+                while k < length and old[opos + k] == new[npos + k]:
+                    k += 1
+                if k - j >= MIN_COPY:
+                    break
+                j = k + 1 if k == j else k
+            j = min(j, length)
+            data = bytes((new[npos + k] - old[opos + k]) & 0xFF for k in range(i, j))
+            self.op(OP_DIFF, j - i, data)
+            i = j
+        self.pos = opos + length
+
+
+def diff(old, new, chksum=crc16):
+    index = {}
+    for i in range(len(old) - BLOCK + 1):
+        index.setdefault(old[i:i + BLOCK], i)
+    patch = Patch(old, chksum)
+    literal = bytearray()
+    npos = 0
+    while npos < len(new):
+        key = new[npos:npos + BLOCK]
+        # prefer staying aligned, no seek needed
+        if len(key) == BLOCK and old[patch.pos:patch.pos + BLOCK] == key:
+            cand = patch.pos
+        else:
+            cand = index.get(key) if len(key) == BLOCK else None
+        if cand is None:
+            literal.append(new[npos])
+            npos += 1
+            continue
+        if literal:
+            patch.op(OP_INSERT, len(literal), bytes(literal))
+            literal = bytearray()
+        # extend, tolerating short mismatch runs
+        length = 0
+        good = 0
+        while npos + length < len(new) and cand + length < len(old):
+            if old[cand + length] == new[npos + length]:
+                good = length + 1
+            elif length - good >= MAX_MISS:
+                break
+            length += 1
+        patch.region(old, new, cand, npos, good)
+        npos += good
+    if literal:
+        patch.op(OP_INSERT, len(literal), bytes(literal))
+    return bytes(patch.out)
+
+
+def apply(old, patch, chksum=crc16):
+    size, src_chksum = struct.unpack_from('<II', patch)
+    if size != len(old) or src_chksum != chksum(old):
+        raise ValueError('patch is not for this image')
+    flash = bytearray()
+    i = 8
+    pos = 0
+    while i < len(patch):
+        code = patch[i]
+        i += 1
+        arg = 0
+        shift = 0
+        while True:
+            b = patch[i]
+            i += 1
+            arg |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                break
+        if code == OP_COPY:
+            flash += old[pos:pos + arg]
+            pos += arg
+        elif code == OP_DIFF:
+            flash += bytes((old[pos + k] + patch[i + k]) & 0xFF for k in range(arg))
+            pos += arg
+            i += arg
+        elif code == OP_INSERT:
+            flash += patch[i:i + arg]
+            i += arg
+        elif code == OP_SEEK:
+            pos += (arg >> 1) ^ -(arg & 1)
+        else:
+            raise ValueError('bad op %#x' % code)
+        if pos < 0 or pos > len(old):
+            raise ValueError('source out of range')
+    return bytes(flash)
+
+
+def main(argv):
+    args = [a for a in argv if not a.startswith('--')]
+    if len(args) < 2:
+        print(__doc__)
+        return 1
+    old = open(args[0], 'rb').read()
+    new = open(args[1], 'rb').read()
+    chksum = crc32_stm32 if '--crc32' in argv else crc16
+    patch = diff(old, new, chksum)
+    if '--verify' in argv and apply(old, patch, chksum) != new:
+        print('verify failed')
+        return 1
+    path = args[2] if len(args) > 2 else args[1] + '.delta'
+    open(path, 'wb').write(patch)
+    print('%s: %d -> %d bytes (%.1f%%)' % (path, len(new), len(patch), 100.0 * len(patch) / max(len(new), 1)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
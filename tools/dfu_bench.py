@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Benchmark the pipelined DFU download on the host build.
+
+usage: dfu_bench.py <boot_host> [--runs=N] [--size=KB] [--baud=N[,N...]] [--flash-max]
+
+Every run downloads a random image of --size KB (default 128) with tools/dfu_sim.py
+into slot B of a flash file where the slot holds an old image, so the sectors the
+image spans need erasing. Per baud rate (default 115200,921600) the medians of
+--runs runs (default 5) are printed:
+
+  wall          the host run, dfu_sim.py to DFU_CPLT_REQ
+  erase, program, verify, link
+                flash timing model of platform_posix.c, target time in ms
+  serial        erase + link + program + verify, one after the other
+  pipelined     what the model predicts with the double buffer of bootloader.c,
+                erase then the slower of link and programming
+  KB/s          image size over the pipelined time
+
+--flash-max models the maximum datasheet figures instead of the typical ones.
+"""
+
+import os
+import random
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+
+import dfu_test
+
+FLASH_SIZE = dfu_test.FLASH_SIZE
+SLOT_B = dfu_test.SLOTS[1]
+
+MODEL = re.compile(r'model \w+ x\d+: erase ([\d.]+) ms, program ([\d.]+) ms .*verify ([\d.]+) ms')
+LINK = re.compile(r'link \d+ baud: rx \d+ bytes ([\d.]+) ms, tx \d+ bytes ([\d.]+) ms')
+PREDICTED = re.compile(r'predicted ([\d.]+) ms')
+WALL = re.compile(r'([\d.]+) s, [\d.]+ KB/s')
+
+
+def run(boot_host, workdir, img, baud, flash_max):
+    flash = os.path.join(workdir, 'flash.bin')
+    path = os.path.join(workdir, 'image.bin')
+    # old image in slot B, the rest erased
+    data = bytearray(b'\xff' * FLASH_SIZE)
+    off = SLOT_B - dfu_test.FLASH_BASE
+    data[off:] = b'\x00' * (FLASH_SIZE - off)
+    with open(flash, 'wb') as f:
+        f.write(data)
+    with open(path, 'wb') as f:
+        f.write(img)
+    args = [sys.executable, os.path.join(dfu_test.TOOLS, 'dfu_sim.py'), boot_host, flash, path,
+            '--version=1', '--baud=%d' % baud] + (['--flash-max'] if flash_max else [])
+    out = subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    stdout, stderr = out.stdout.decode(), out.stderr.decode()
+    if out.returncode != 0:
+        raise RuntimeError('download failed: ' + stdout.strip())
+    # the boot that ran the download is the first one reported
+    erase, program, verify = map(float, MODEL.search(stderr).groups())
+    link = max(map(float, LINK.search(stderr).groups()))
+    return {
+        'wall': float(WALL.search(stdout).group(1)) * 1000,
+        'erase': erase,
+        'program': program,
+        'verify': verify,
+        'link': link,
+        'serial': erase + link + program + verify,
+        'pipelined': float(PREDICTED.search(stderr).group(1)),
+    }
+
+
+def _option(argv, name, default):
+    for a in argv:
+        if a.startswith(name + '='):
+            return a.split('=', 1)[1]
+    return default
+
+
+def main(argv):
+    args = [a for a in argv if not a.startswith('--')]
+    if not args:
+        print(__doc__)
+        return 1
+    boot_host = os.path.abspath(args[0])
+    runs = int(_option(argv, '--runs', '5'), 0)
+    size = int(_option(argv, '--size', '128'), 0) * 1024
+    bauds = [int(b, 0) for b in _option(argv, '--baud', '115200,921600').split(',')]
+    flash_max = '--flash-max' in argv
+    dfu_test.IMG_SIZE = size
+    img = dfu_test.image(SLOT_B, 1, random.Random(size))
+
+    keys = ('wall', 'erase', 'program', 'verify', 'link', 'serial', 'pipelined')
+    print('%d KB image, %d runs, %s flash figures, medians in ms' % (size // 1024, runs, 'max' if flash_max else 'typ'))
+    print('%8s ' % 'baud' + ' '.join('%9s' % k for k in keys) + ' %8s' % 'KB/s')
+    for baud in bauds:
+        results = []
+        with tempfile.TemporaryDirectory() as workdir:
+            for _ in range(runs):
+                try:
+                    results.append(run(boot_host, workdir, img, baud, flash_max))
+                except (RuntimeError, AttributeError) as e:
+                    print('%8d %s' % (baud, e))
+                    return 1
+        med = {k: statistics.median(r[k] for r in results) for k in keys}
+        print('%8d ' % baud + ' '.join('%9.1f' % med[k] for k in keys) +
+              ' %8.1f' % (size / 1024 / (med['pipelined'] / 1000)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,245 @@
+#!/usr/bin/env python3
+"""Drive the host build of the bootloader through a DFU download.
+
+usage: dfu_sim.py <boot_host> <flash.bin> <image.bin> [--stream=<file> --format=lz4|delta]
+                  [--crc32] [--version=N] [--loss=P] [--corrupt=P] [--cut=N] [--seed=N]
+                  [--flash-max] [--baud=N] [--cut-erase=N] [--cut-write=N]
+
+boot_host is platform_posix.c linked with the core (build: see that file), it is
+started on flash.bin in DFU mode with the SPL link on its stdin / stdout, this
+script plays the PC side: answers the requests, streams the segments on the
+window the device grants, resends what it NAKs. image.bin is what must end up in
+the slot, --stream sends a tools/lz4pack.py or tools/delta.py output for it instead.
+Without --version the version request goes unanswered, as from an older host, the
+device waits out its retries.
+
+Fuzzing: every frame to the device is dropped with probability --loss, or gets
+one byte flipped with probability --corrupt. --cut=N kills the device after N
+segments, as a power cut, run again with the same image to resume from the
+journal. Prints the result of the download and the time it took.
+
+--flash-max and --baud go to the device, its flash timing model then predicts the
+update time on the target with the maximum datasheet figures, or another baud rate.
+--cut-erase and --cut-write go to the device as well, it loses power in its N-th
+sector erase or before its N-th flash write.
+"""
+
+import os
+import random
+import select
+import struct
+import subprocess
+import sys
+import time
+
+from delta import crc16, crc32_stm32
+
+SPL_PREAMBLE = 0xA55A
+SPL_CMD_ACK = 0x00A0
+SPL_CMD_NAK = 0x00A1
+
+DFU_START_REQ = 0x5555
+DFU_SIZE_REQ = 0x0001
+DFU_CHKSUM_REQ = 0x0002
+DFU_SEG_DATA_REQ = 0x0003
+DFU_VERSION_REQ = 0x0006
+DFU_ABORD_REQ = 0x00EE
+DFU_CPLT_REQ = 0x00FF
+
+DFU_FORMAT = {'raw': 0, 'lz4': 1, 'delta': 2}
+IMG_HDR_OFFSET = 0x200
+IMG_HDR_MAGIC = 0x48474D49
+CHK_ALG_CRC32 = 0x01
+
+TIMEOUT = 10.0          # s without a frame from the device
+
+
+def frame(cmd, seq, data=b''):
+    body = struct.pack('<HHH', 4 + len(data), cmd, seq) + data
+    return struct.pack('<H', SPL_PREAMBLE) + body + struct.pack('<H', crc16(body))
+
+
+class Parser:
+    def __init__(self):
+        self.buf = b''
+
+    def feed(self, data):
+        # same resync rule as spl.c: a bad frame is skipped up to the next preamble
+        self.buf += data
+        out = []
+        pre = struct.pack('<H', SPL_PREAMBLE)
+        while True:
+            at = self.buf.find(pre)
+            if at < 0:
+                self.buf = self.buf[-1:]
+                return out
+            self.buf = self.buf[at:]
+            if len(self.buf) < 4:
+                return out
+            size = struct.unpack_from('<H', self.buf, 2)[0]
+            if len(self.buf) < 4 + size + 2:
+                return out
+            body = self.buf[2:4 + size]
+            if size >= 4 and crc16(body) == struct.unpack_from('<H', self.buf, 4 + size)[0]:
+                cmd, seq = struct.unpack_from('<HH', body, 2)
+                out.append((cmd, seq, body[6:]))
+                self.buf = self.buf[4 + size + 2:]
+            else:
+                self.buf = self.buf[1:]
+
+
+class Host:
+    def __init__(self, proc, image, stream, fmt, crc32, version, loss, corrupt, cut, rng):
+        self.proc = proc
+        self.image = image
+        self.stream = stream
+        self.fmt = fmt
+        self.crc32 = crc32
+        self.version = version
+        self.loss = loss
+        self.corrupt = corrupt
+        self.cut = cut
+        self.rng = rng
+        self.seg_size = 0
+        self.window = 0
+        self.base = 0
+        self.next = 0
+        self.sent = 0
+        self.resent = 0
+
+    def send(self, cmd, seq, data=b''):
+        out = bytearray(frame(cmd, seq, data))
+        if self.rng.random() < self.loss:
+            return
+        if self.rng.random() < self.corrupt:
+            out[self.rng.randrange(len(out))] ^= 1 << self.rng.randrange(8)
+        try:
+            self.proc.stdin.write(out)
+            self.proc.stdin.flush()
+        except BrokenPipeError:
+            pass
+
+    def segments(self):
+        return (len(self.stream) + self.seg_size - 1) // self.seg_size
+
+    def send_seg(self, seq):
+        if self.cut is not None and self.sent >= self.cut:
+            self.proc.kill()
+            return
+        self.sent += 1
+        self.send(DFU_SEG_DATA_REQ, seq, self.stream[seq * self.seg_size:(seq + 1) * self.seg_size])
+
+    def fill(self):
+        # in flight [base, base + window - 1), one slot stays with the device
+        self.next = max(self.next, self.base)
+        while self.next < min(self.base + self.window - 1, self.segments()):
+            self.send_seg(self.next)
+            self.next += 1
+
+    def handle(self, cmd, seq, data):
+        if cmd == DFU_START_REQ:
+            seg_size, window, base = struct.unpack_from('<HBI', data)
+            load = load_addr(self.image)
+            if load is not None and load != base:
+                self.proc.kill()
+                return 'image linked for %#010x, the device updates %#010x' % (load, base)
+            self.seg_size, self.window = seg_size, window
+            self.send(cmd, 0, struct.pack('<HB', seg_size, window))
+        elif cmd == DFU_SIZE_REQ:
+            if self.fmt:
+                self.send(cmd, 0, struct.pack('<IIB', len(self.image), len(self.stream), self.fmt))
+            else:
+                self.send(cmd, 0, struct.pack('<I', len(self.image)))
+        elif cmd == DFU_CHKSUM_REQ:
+            if self.crc32:
+                self.send(cmd, 0, struct.pack('<IB', crc32_stm32(self.image), CHK_ALG_CRC32))
+            else:
+                self.send(cmd, 0, struct.pack('<H', crc16(self.image)))
+        elif cmd == DFU_VERSION_REQ and self.version is not None:
+            self.send(cmd, 0, struct.pack('<I', self.version))
+        elif cmd == SPL_CMD_ACK:
+            self.window = data[0]
+            if seq < self.base:
+                return None
+            self.base = seq
+            self.fill()
+        elif cmd == SPL_CMD_NAK:
+            self.resent += 1
+            self.send_seg(seq)
+        elif cmd == DFU_CPLT_REQ:
+            return 'complete'
+        elif cmd == DFU_ABORD_REQ:
+            if data and data[0] == 2:
+                return 'abort, flash bad at %#010x' % struct.unpack_from('<I', data, 1)[0]
+            return 'abort'
+        return None
+
+
+def load_addr(image):
+    # slot the image header (tools/imgpack.py) names, None without a header
+    if len(image) < IMG_HDR_OFFSET + 16:
+        return None
+    magic = struct.unpack_from('<I', image, IMG_HDR_OFFSET)[0]
+    return struct.unpack_from('<I', image, IMG_HDR_OFFSET + 12)[0] if magic == IMG_HDR_MAGIC else None
+
+
+def _option(argv, name, default=None):
+    for arg in argv:
+        if arg.startswith(name + '='):
+            return arg.split('=', 1)[1]
+    return default
+
+
+def main(argv):
+    args = [a for a in argv if not a.startswith('--')]
+    if len(args) < 3:
+        print(__doc__)
+        return 1
+    image = open(args[2], 'rb').read()
+    stream = image
+    fmt = DFU_FORMAT[_option(argv, '--format', 'raw')]
+    if _option(argv, '--stream'):
+        stream = open(_option(argv, '--stream'), 'rb').read()
+    version = _option(argv, '--version')
+    cut = _option(argv, '--cut')
+    rng = random.Random(int(_option(argv, '--seed', '1'), 0))
+
+    device = [args[0], args[1], '--dfu', '--link'] + [a for a in argv if a.startswith(('--baud=', '--flash-max', '--cut-erase=', '--cut-write='))]
+    proc = subprocess.Popen(device, stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+    host = Host(proc, image, stream, fmt, '--crc32' in argv, int(version, 0) if version else None,
+                float(_option(argv, '--loss', '0')), float(_option(argv, '--corrupt', '0')),
+                int(cut) if cut else None, rng)
+    parser = Parser()
+    result = None
+    start = time.monotonic()
+    last = start
+    fd = proc.stdout.fileno()
+    # until the result or EOF, the frames the device wrote before it exited still count
+    while result is None:
+        ready, _, _ = select.select([fd], [], [], 0.1)
+        if not ready:
+            if time.monotonic() - last > TIMEOUT:
+                result = 'no answer from the device'
+            continue
+        data = os.read(fd, 65536)
+        if not data:
+            break
+        last = time.monotonic()
+        for cmd, seq, body in parser.feed(data):
+            result = host.handle(cmd, seq, body) or result
+    elapsed = time.monotonic() - start
+    try:
+        proc.stdin.close()
+    except BrokenPipeError:
+        # device gone with frames still buffered
+        pass
+    code = proc.wait()
+    if result is None:
+        result = 'device gone (exit %d)' % code
+    print('%s: %d segments sent, %d resent, %.3f s, %.1f KB/s' % (
+        result, host.sent, host.resent, elapsed, len(stream) / 1024 / max(elapsed, 1e-6)))
+    return 0 if result == 'complete' and code == 0 else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,328 @@
+#!/usr/bin/env python3
+"""Loopback test of the DFU download on the host build.
+
+usage: dfu_test.py <boot_host> [--seeds=N]
+
+boot_host is the UART build of platform_posix.c (build: see that file). Every case
+starts it on a simulated flash file in a temporary directory, tools/dfu_sim.py plays
+the PC side over its stdin / stdout, then the slot is compared byte for byte with
+the image and the device must jump to it after the download. The boot cases run
+boot_host without a host and check the slot it jumps to, the application confirms
+an image by clearing the confirmed byte of its trailer in the flash file:
+
+  clean         erased flash, one download into the update slot
+  lossy         --seeds downloads (default 8) alternating the slots, frames to the
+                device dropped or corrupted at 5 % each
+  resume        power cut after 20 segments, the next download resumes from the journal
+  cut-erase     power cut in the 1st, 2nd ... sector erase of a download over an old
+                image, the sector left half erased, then the download again
+  cut-write     power cut before the 1st, 2nd ... flash write (journal session, first
+                buffers, first records), then the download again
+  rollback      an image nobody confirms boots 3 times, then the confirmed one again
+  confirm       a confirmed image keeps booting
+  newest        of two confirmed images the newer version boots
+  legacy        images without a trailer: one linked for the other slot never boots,
+                a committed image wins even at version 0, of two slot B wins
+  corrupt       a byte of one block of the newer image flipped after a few boots, the
+                partial checks catch it and slot B boots within block count + 1 boots
+
+Exit code 0 when every case passed.
+"""
+
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+
+import imgpack
+
+FLASH_BASE = 0x08000000
+FLASH_SIZE = 0x00080000
+SLOTS = (0x08010000, 0x08040000)
+SLOT_SIZES = (0x00030000, 0x00040000)
+TRAILER_SIZE = 0x100
+TRAILER_COUNT = 8
+TRAILER_CONFIRMED = 0x13
+BOOT_ATTEMPTS = 3
+IMG_SIGNATURE_OFFSET = 0x20
+IMG_SIGNATURE_VALUE = 0xF1517A66
+IMG_SIZE = 48 * 1024
+IMG_SIZE_CUT = 160 * 1024       # spans the trailer sector of either slot
+SEG_SIZE = 1024                 # SPL_DATA_MAX_SIZE
+
+TOOLS = os.path.dirname(os.path.abspath(__file__))
+
+
+def image(load, version, rng, size=None):
+    # random body, initial SP, reset handler and signature where the bootloader looks
+    img = bytearray(rng.getrandbits(8) for _ in range(size or IMG_SIZE))
+    struct.pack_into('<II', img, 0, 0x20020000, load + 0x101)
+    struct.pack_into('<I', img, IMG_SIGNATURE_OFFSET, IMG_SIGNATURE_VALUE)
+    img[imgpack.IMG_HDR_OFFSET:imgpack.IMG_HDR_OFFSET + imgpack.IMG_HDR_SIZE] = bytes(imgpack.IMG_HDR_SIZE)
+    return imgpack.stamp(img, load, version)
+
+
+def legacy(load, rng):
+    # what the copy-to-app bootloader installed, no header and no trailer
+    img = bytearray(rng.getrandbits(8) for _ in range(IMG_SIZE))
+    struct.pack_into('<II', img, 0, 0x20020000, load + 0x101)
+    struct.pack_into('<I', img, IMG_SIGNATURE_OFFSET, IMG_SIGNATURE_VALUE)
+    return bytes(img)
+
+
+class Device:
+    # the device updates the slot it does not boot, slot B on an erased flash
+    def __init__(self, boot_host, workdir):
+        self.boot_host = boot_host
+        self.flash = os.path.join(workdir, 'flash.bin')
+        self.image = os.path.join(workdir, 'image.bin')
+        with open(self.flash, 'wb') as f:
+            f.write(b'\xff' * FLASH_SIZE)
+
+    def download(self, img, *options):
+        # result line of dfu_sim.py, and the slot the device jumped to after its reset
+        with open(self.image, 'wb') as f:
+            f.write(img)
+        run = subprocess.run([sys.executable, os.path.join(TOOLS, 'dfu_sim.py'), self.boot_host,
+                              self.flash, self.image] + list(options),
+                             stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        jump = None
+        log = run.stderr.decode().splitlines()
+        for line in log:
+            if ': jump 0x' in line:
+                jump = int(line.split(': jump ')[1].split(',')[0], 16)
+        # no result line, dfu_sim.py itself failed
+        out = run.stdout.decode().strip() or (log[-1] if log else 'exit %d' % run.returncode)
+        return run.returncode == 0, out, jump
+
+    def boot(self):
+        # slot the device jumps to on a reset without DFU, None if it does not
+        run = subprocess.run([self.boot_host, self.flash], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        for line in run.stderr.decode().splitlines():
+            if ': jump 0x' in line:
+                return int(line.split(': jump ')[1].split(',')[0], 16)
+        return None
+
+    def slot(self, base, size):
+        with open(self.flash, 'rb') as f:
+            f.seek(base - FLASH_BASE)
+            return f.read(size)
+
+    def write(self, addr, data):
+        with open(self.flash, 'r+b') as f:
+            f.seek(addr - FLASH_BASE)
+            f.write(data)
+
+    def confirm(self, base):
+        # what the application does, in the trailer in use, the first one not retired
+        end = base + SLOT_SIZES[SLOTS.index(base)]
+        for i in range(TRAILER_COUNT):
+            trailer = end - (TRAILER_COUNT - i) * TRAILER_SIZE
+            if struct.unpack('<I', self.slot(trailer, 4))[0] != 0:
+                break
+        self.write(trailer + TRAILER_CONFIRMED, b'\x00')
+
+
+def _name(base):
+    return 'nothing' if base is None else '%#010x' % base
+
+
+def check(dev, img, base, ok, out, booted):
+    if ok is False:
+        return 'download failed: ' + out
+    if dev.slot(base, len(img)) != img:
+        return 'slot %#010x differs from the image' % base
+    if booted != base:
+        return 'boots %s instead of %#010x' % (_name(booted), base)
+    return None
+
+
+def case_clean(boot_host, workdir, rng):
+    dev = Device(boot_host, workdir)
+    base = SLOTS[1]
+    img = image(base, 1, rng)
+    return check(dev, img, base, *dev.download(img, '--version=1'))
+
+
+def case_lossy(boot_host, workdir, rng, seeds):
+    dev = Device(boot_host, workdir)
+    for seed in range(1, seeds + 1):
+        # each download goes to the slot the last one did not
+        base = SLOTS[seed % 2]
+        img = image(base, seed, rng)
+        err = check(dev, img, base, *dev.download(img, '--version=%d' % seed, '--loss=0.05',
+                                                   '--corrupt=0.05', '--seed=%d' % seed))
+        if err:
+            return 'seed %d: %s' % (seed, err)
+    return None
+
+
+def _segments(out):
+    return int(out.split(': ')[1].split(' segments')[0])
+
+
+def case_resume(boot_host, workdir, rng):
+    dev = Device(boot_host, workdir)
+    base = SLOTS[1]
+    img = image(base, 1, rng)
+    ok, out, _ = dev.download(img, '--version=1', '--cut=20')
+    if ok:
+        return 'the cut download completed'
+    ok, out, booted = dev.download(img, '--version=1')
+    err = check(dev, img, base, ok, out, booted)
+    if err is None and _segments(out) >= (len(img) + SEG_SIZE - 1) // SEG_SIZE:
+        err = 'not resumed: ' + out
+    return err
+
+
+def case_cut(boot_host, workdir, rng, cut, cuts):
+    # both slots hold an image, so every download erases an old one
+    dev = Device(boot_host, workdir)
+    version = 0
+    for n in range(1, cuts + 1):
+        version += 1
+        base = SLOTS[version % 2]
+        img = image(base, version, rng, IMG_SIZE_CUT)
+        if n > 2:
+            ok, out, _ = dev.download(img, '--version=%d' % version, '%s=%d' % (cut, n - 2))
+            if ok:
+                return None if n > 3 else '%s=%d: no cut' % (cut, n - 2)
+        err = check(dev, img, base, *dev.download(img, '--version=%d' % version))
+        if err:
+            return '%s=%d: %s' % (cut, n - 2, err)
+    return None
+
+
+def _boots(dev, count):
+    return ' '.join(_name(dev.boot()) for _ in range(count))
+
+
+def _installed(boot_host, workdir, rng, versions):
+    # version n downloaded and confirmed, each into the slot the one before did not boot
+    dev = Device(boot_host, workdir)
+    for n, version in enumerate(versions):
+        base = SLOTS[(n + 1) % 2]
+        img = image(base, version, rng)
+        err = check(dev, img, base, *dev.download(img, '--version=%d' % version))
+        if err:
+            return dev, 'version %d: %s' % (version, err)
+        dev.confirm(base)
+    return dev, None
+
+
+def case_rollback(boot_host, workdir, rng):
+    dev, err = _installed(boot_host, workdir, rng, [1])
+    if err:
+        return err
+    # the boot after the download counts as the first attempt
+    img = image(SLOTS[0], 2, rng)
+    err = check(dev, img, SLOTS[0], *dev.download(img, '--version=2'))
+    if err:
+        return 'version 2: ' + err
+    boots = _boots(dev, BOOT_ATTEMPTS + 1)
+    want = ' '.join([_name(SLOTS[0])] * (BOOT_ATTEMPTS - 1) + [_name(SLOTS[1])] * 2)
+    return None if boots == want else 'boots %s, expected %s' % (boots, want)
+
+
+def case_confirm(boot_host, workdir, rng):
+    dev, err = _installed(boot_host, workdir, rng, [1, 2])
+    if err:
+        return err
+    boots = _boots(dev, BOOT_ATTEMPTS + 2)
+    want = ' '.join([_name(SLOTS[0])] * (BOOT_ATTEMPTS + 2))
+    return None if boots == want else 'boots %s, expected %s' % (boots, want)
+
+
+def case_newest(boot_host, workdir, rng):
+    for versions in ([1, 2], [2, 7], [1, 2, 3]):
+        dev, err = _installed(boot_host, workdir, rng, versions)
+        if err:
+            return err
+        want = SLOTS[len(versions) % 2]
+        booted = dev.boot()
+        if booted != want:
+            return 'versions %s: boots %s instead of %#010x' % (versions, _name(booted), want)
+    return None
+
+
+def case_legacy(boot_host, workdir, rng):
+    # the DFU copy the old bootloader left in slot A is linked for slot B
+    dev = Device(boot_host, workdir)
+    dev.write(SLOTS[0], legacy(SLOTS[1], rng))
+    dev.write(SLOTS[1], legacy(SLOTS[1], rng))
+    booted = dev.boot()
+    if booted != SLOTS[1]:
+        return 'old DFU copy in A: boots %s' % (_name(booted))
+    # no trailer on either side, slot B was the application slot
+    dev.write(SLOTS[0], legacy(SLOTS[0], rng))
+    booted = dev.boot()
+    if booted != SLOTS[1]:
+        return 'two images without a trailer: boots %s' % (_name(booted))
+    # a committed image wins whatever its version
+    dev = Device(boot_host, workdir)
+    img = image(SLOTS[1], 0, rng)
+    err = check(dev, img, SLOTS[1], *dev.download(img, '--version=0'))
+    if err:
+        return 'version 0: ' + err
+    dev.confirm(SLOTS[1])
+    dev.write(SLOTS[0], legacy(SLOTS[0], rng))
+    booted = dev.boot()
+    if booted != SLOTS[1]:
+        return 'committed version 0 against no trailer: boots %s' % (_name(booted))
+    return None
+
+
+def case_corrupt(boot_host, workdir, rng):
+    for block, before in ((0, 0), (7, 3), (imgpack.IMG_HDR_BLOCKS - 1, 9)):
+        dev, err = _installed(boot_host, workdir, rng, [1, 2])
+        if err:
+            return err
+        # a few partial checks first, so the corrupted block is due at another boot
+        _boots(dev, before)
+        hdr = imgpack.HDR_FMT
+        fields = struct.unpack(hdr, dev.slot(SLOTS[0] + imgpack.IMG_HDR_OFFSET, struct.calcsize(hdr)))
+        (hdr_size, count, size) = (fields[2], fields[10], fields[11])
+        addr = SLOTS[0] + imgpack.IMG_HDR_OFFSET + hdr_size + block * size + 1
+        dev.write(addr, bytes([dev.slot(addr, 1)[0] ^ 0x5A]))
+        boots = [dev.boot() for _ in range(count + 2)]
+        caught = boots.index(SLOTS[1]) + 1 if SLOTS[1] in boots else None
+        if caught is None or caught > count + 1 or set(boots[caught - 1:]) != {SLOTS[1]}:
+            return 'block %d of %d after %d boots: boots %s' % (block, count, before, ' '.join(map(_name, boots)))
+    return None
+
+
+def main(argv):
+    args = [a for a in argv if not a.startswith('--')]
+    if not args:
+        print(__doc__)
+        return 1
+    boot_host = os.path.abspath(args[0])
+    seeds = 8
+    for a in argv:
+        if a.startswith('--seeds='):
+            seeds = int(a.split('=', 1)[1], 0)
+    cases = [
+        ('clean', lambda d, r: case_clean(boot_host, d, r)),
+        ('lossy', lambda d, r: case_lossy(boot_host, d, r, seeds)),
+        ('resume', lambda d, r: case_resume(boot_host, d, r)),
+        ('cut-erase', lambda d, r: case_cut(boot_host, d, r, '--cut-erase', 16)),
+        ('cut-write', lambda d, r: case_cut(boot_host, d, r, '--cut-write', 24)),
+        ('rollback', lambda d, r: case_rollback(boot_host, d, r)),
+        ('confirm', lambda d, r: case_confirm(boot_host, d, r)),
+        ('newest', lambda d, r: case_newest(boot_host, d, r)),
+        ('legacy', lambda d, r: case_legacy(boot_host, d, r)),
+        ('corrupt', lambda d, r: case_corrupt(boot_host, d, r)),
+    ]
+    failed = 0
+    for name, case in cases:
+        with tempfile.TemporaryDirectory() as workdir:
+            err = case(workdir, random.Random(name))
+        print('%-12s %s' % (name, 'FAIL, ' + err if err else 'ok'))
+        failed += err is not None
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""Stamp the image header (slot.h: AppHeader_t) onto a .bin output.
+
+usage: imgpack.py <image.bin> [output.bin] --load=<slot base> [--version=N]
+                  [--build-id=N] [--crc32] [--no-cache] [--verify]
+
+The application reserves IMG_HDR_SIZE bytes at IMG_HDR_OFFSET, right after the
+vector table, left 0x00 or 0xFF by the linker (an older header is stamped over).
+--load is the slot the image is linked for, 0x08010000 (A) or 0x08040000 (B),
+the bootloader refuses to boot it from the other one. --crc32 if the checksums
+are to be the ones of the STM32 CRC unit instead of the CRC16. The build id
+defaults to the CRC32 (zlib) of the input. --no-cache makes the bootloader do
+the full check on every boot.
+
+The image behind the header is split in up to IMG_HDR_BLOCKS blocks with their
+checksums in the header, a normal boot only checks one of them.
+
+--verify parses the output the way the bootloader does.
+"""
+
+import struct
+import sys
+import zlib
+
+from delta import crc16, crc32_stm32
+
+IMG_HDR_OFFSET = 0x200
+IMG_HDR_MAGIC = 0x48474D49
+IMG_HDR_VERSION = 1
+IMG_HDR_BLOCKS = 16
+IMG_HDR_FLAG_NO_CACHE = 0x01
+
+CHK_ALG_CRC16 = 0xFF
+CHK_ALG_CRC32 = 0x01
+
+# magic, hdr version, hdr size, length, load addr, chksum, version, build id, alg, flags,
+# block count, block size, block chksums
+HDR_FMT = '<IHHIIIIIBBHI%dI' % IMG_HDR_BLOCKS
+IMG_HDR_SIZE = struct.calcsize(HDR_FMT) + 4     # + header chksum
+
+
+def _chksum(alg):
+    return crc32_stm32 if alg == CHK_ALG_CRC32 else crc16
+
+
+def _body(image):
+    return image[:IMG_HDR_OFFSET] + image[IMG_HDR_OFFSET + IMG_HDR_SIZE:]
+
+
+def blocks(body, chksum):
+    # up to IMG_HDR_BLOCKS blocks, word multiples so CRC32 combines, the last one shorter
+    size = (len(body) + IMG_HDR_BLOCKS - 1) // IMG_HDR_BLOCKS
+    size = (size + 3) & ~3
+    table = [chksum(body[i:i + size]) for i in range(0, len(body), size)]
+    return size, table
+
+
+def stamp(image, load, version=0, build_id=None, alg=CHK_ALG_CRC16, flags=0):
+    image = bytearray(image)
+    if len(image) <= IMG_HDR_OFFSET + IMG_HDR_SIZE:
+        raise ValueError('image too small for a header')
+    area = bytes(image[IMG_HDR_OFFSET:IMG_HDR_OFFSET + IMG_HDR_SIZE])
+    if area not in (b'\0' * IMG_HDR_SIZE, b'\xff' * IMG_HDR_SIZE) and struct.unpack_from('<I', area)[0] != IMG_HDR_MAGIC:
+        raise ValueError('no room reserved at %#x' % IMG_HDR_OFFSET)
+    reset = struct.unpack_from('<I', image, 4)[0]
+    if reset < load or reset >= load + len(image):
+        raise ValueError('image is not linked for %#010x' % load)
+    if build_id is None:
+        build_id = zlib.crc32(bytes(image)) & 0xFFFFFFFF
+    chksum = _chksum(alg)
+    size, table = blocks(image[IMG_HDR_OFFSET + IMG_HDR_SIZE:], chksum)
+    count = len(table)
+    table += [0] * (IMG_HDR_BLOCKS - count)
+    hdr = struct.pack(HDR_FMT, IMG_HDR_MAGIC, IMG_HDR_VERSION, IMG_HDR_SIZE, len(image), load,
+                      chksum(_body(image)), version, build_id, alg, flags, count, size, *table)
+    hdr += struct.pack('<I', chksum(hdr))
+    image[IMG_HDR_OFFSET:IMG_HDR_OFFSET + IMG_HDR_SIZE] = hdr
+    return bytes(image)
+
+
+def check(image, load):
+    fields = struct.unpack_from(HDR_FMT, image, IMG_HDR_OFFSET)
+    (magic, hdr_version, hdr_size, length, load_addr, img_chksum, _, _, alg, _, count, size) = fields[:12]
+    if magic != IMG_HDR_MAGIC or hdr_version < IMG_HDR_VERSION or hdr_size < IMG_HDR_SIZE or hdr_size & 3:
+        return False
+    if alg not in (CHK_ALG_CRC16, CHK_ALG_CRC32):
+        return False
+    chksum = _chksum(alg)
+    hdr = image[IMG_HDR_OFFSET:IMG_HDR_OFFSET + IMG_HDR_SIZE - 4]
+    if chksum(hdr) != struct.unpack_from('<I', image, IMG_HDR_OFFSET + IMG_HDR_SIZE - 4)[0]:
+        return False
+    if length != len(image) or load_addr != load:
+        return False
+    body = image[IMG_HDR_OFFSET + hdr_size:length]
+    if (size, list(fields[12:12 + count])) != blocks(body, chksum):
+        return False
+    return chksum(image[:IMG_HDR_OFFSET] + body) == img_chksum
+
+
+def _option(argv, name, default=None):
+    for a in argv:
+        if a.startswith(name + '='):
+            return int(a.split('=', 1)[1], 0)
+    return default
+
+
+def main(argv):
+    args = [a for a in argv if not a.startswith('--')]
+    load = _option(argv, '--load')
+    if not args or load is None:
+        print(__doc__)
+        return 1
+    src = open(args[0], 'rb').read()
+    alg = CHK_ALG_CRC32 if '--crc32' in argv else CHK_ALG_CRC16
+    flags = IMG_HDR_FLAG_NO_CACHE if '--no-cache' in argv else 0
+    try:
+        dst = stamp(src, load, _option(argv, '--version', 0), _option(argv, '--build-id'), alg, flags)
+    except ValueError as e:
+        print('%s: %s' % (args[0], e))
+        return 1
+    if '--verify' in argv and check(dst, load) is False:
+        print('verify failed')
+        return 1
+    path = args[1] if len(args) > 1 else args[0]
+    open(path, 'wb').write(dst)
+    print('%s: %d bytes for %#010x, header at %#x' % (path, len(dst), load, IMG_HDR_OFFSET))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Compress a DFU image into one LZ4 block for the bootloader.
+
+usage: lz4pack.py <image.bin> [output.lz4] [--verify]
+
+The host announces the result in the dfu image size response as
+[image size 4] [stream size 4] [format 1 = LZ4], the image chksum stays the
+CRC16 of the uncompressed image.
+"""
+
+import struct
+import sys
+
+MIN_MATCH = 4
+LAST_LITERALS = 5       # block must end with at least 5 literals
+MFLIMIT = 12            # no match may start in the last 12 bytes
+MAX_OFFSET = 0xFFFF
+HASH_LOG = 16
+
+
+def _length(n):
+    out = bytearray()
+    while n >= 0xFF:
+        out.append(0xFF)
+        n -= 0xFF
+    out.append(n)
+    return out
+
+
+def _sequence(literals, match_len, offset):
+    lit = len(literals)
+    out = bytearray()
+    token = min(lit, 15) << 4
+    if match_len:
+        token |= min(match_len - MIN_MATCH, 15)
+    out.append(token)
+    if lit >= 15:
+        out += _length(lit - 15)
+    out += literals
+    if match_len:
+        out += struct.pack('<H', offset)
+        if match_len - MIN_MATCH >= 15:
+            out += _length(match_len - MIN_MATCH - 15)
+    return out
+
+
+def compress(src):
+    out = bytearray()
+    table = {}
+    anchor = 0
+    pos = 0
+    limit = len(src) - MFLIMIT
+    while pos < limit:
+        key = src[pos:pos + MIN_MATCH]
+        ref = table.get(key)
+        table[key] = pos
+        if ref is None or pos - ref > MAX_OFFSET:
+            pos += 1
+            continue
+        end = len(src) - LAST_LITERALS
+        length = MIN_MATCH
+        while pos + length < end and src[ref + length] == src[pos + length]:
+            length += 1
+        out += _sequence(src[anchor:pos], length, pos - ref)
+        for i in range(pos + 1, min(pos + length, limit)):
+            table[src[i:i + MIN_MATCH]] = i
+        pos += length
+        anchor = pos
+    out += _sequence(src[anchor:], 0, 0)
+    return bytes(out)
+
+
+def decompress(src):
+    out = bytearray()
+    i = 0
+    while i < len(src):
+        token = src[i]
+        i += 1
+        lit = token >> 4
+        if lit == 15:
+            while True:
+                lit += src[i]
+                i += 1
+                if src[i - 1] != 0xFF:
+                    break
+        out += src[i:i + lit]
+        i += lit
+        if i == len(src):
+            break
+        offset = src[i] | (src[i + 1] << 8)
+        i += 2
+        length = token & 0x0F
+        if length == 15:
+            while True:
+                length += src[i]
+                i += 1
+                if src[i - 1] != 0xFF:
+                    break
+        length += MIN_MATCH
+        if offset == 0 or offset > len(out):
+            raise ValueError('bad offset at %d' % i)
+        for _ in range(length):
+            out.append(out[-offset])
+    return bytes(out)
+
+
+def main(argv):
+    args = [a for a in argv if not a.startswith('--')]
+    if not args:
+        print(__doc__)
+        return 1
+    src = open(args[0], 'rb').read()
+    dst = compress(src)
+    if '--verify' in argv and decompress(dst) != src:
+        print('verify failed')
+        return 1
+    path = args[1] if len(args) > 1 else args[0] + '.lz4'
+    open(path, 'wb').write(dst)
+    print('%s: %d -> %d bytes (%.1f%%)' % (path, len(src), len(dst), 100.0 * len(dst) / max(len(src), 1)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,210 @@
+/* Partial boot checks of a verified image (Linux host)
+ *
+ *   gcc -O2 -Wall -D_GNU_SOURCE -Wno-int-to-pointer-cast -Wno-pointer-to-int-cast \
+ *       -I../bootloader/Core/Inc slot_test.c ../bootloader/Core/Src/slot.c \
+ *       ../bootloader/Core/Src/checksum.c ../bootloader/Core/Src/crc16.c -o slot_test
+ *   ./slot_test
+ *
+ * lSlotCheckPlan for 1..IMG_HDR_BLOCKS blocks and every check count from 0 until past a
+ * full log: a full check (-1) when count % (blocks + 1) == 0 and from IMG_CHECK_LOG_SIZE
+ * * 8 checks on, else block count % (blocks + 1) - 1, so every block once per round.
+ *
+ * A slot of SLOT_SIZE at SLOT_BASE (mapped there, slot.c reads flash through 32 bit
+ * addresses) gets an image with a header the way imgpack.py stamps it and a trailer,
+ * programmed with flash semantics (bits only go 1 -> 0):
+ *   - boots until the log is full: a 0 bit per boot, the log fills at IMG_CHECK_LOG_SIZE
+ *     bytes, a full log is left alone and nothing behind the trailer is touched
+ *   - a byte of one block corrupted after a few boots: the image must stop being bootable
+ *     on the first boot the plan checks that block or the whole image, within blocks + 1
+ *     boots, for every block and with a full log on the next boot
+ * Exit code 0 when all passed.
+ **/
+#include "checksum.h"
+#include "slot.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define SLOT_BASE           0x08010000
+#define SLOT_SIZE           0x00004000
+#define IMAGE_SIZE          10000
+#define IMAGE_VERSION       7
+#define LOG_CHECKS          (IMG_CHECK_LOG_SIZE * 8)
+
+static const Slot_t xSlot = { SLOT_BASE, SLOT_SIZE };
+static uint32_t ulFailed;
+
+static void prvExpect(const char *pcWhat, uint32_t ulArg1, uint32_t ulArg2, int lGot, int lWant) {
+    if (lGot != lWant) {
+        if (ulFailed++ < 20) {
+            printf("FAIL %s, %u %u: %d, expected %d\n", pcWhat, ulArg1, ulArg2, lGot, lWant);
+        }
+    }
+}
+
+// F4 flash: programming clears bits only
+static bool prvProgram(uint32_t ulAddr, const void *pvSrc, uint32_t ulSize) {
+    uint8_t *flash = (uint8_t *)ulAddr;
+    for (uint32_t i = 0; i < ulSize; i++) {
+        flash[i] &= ((const uint8_t *)pvSrc)[i];
+    }
+    return true;
+}
+
+static void prvTestPlan(void) {
+    for (uint32_t blocks = 1; blocks <= IMG_HDR_BLOCKS; blocks++) {
+        uint32_t seen[IMG_HDR_BLOCKS] = { 0 };
+        for (uint32_t count = 0; count <= LOG_CHECKS + 2 * (blocks + 1); count++) {
+            int want = -1;
+            if (count < LOG_CHECKS && count % (blocks + 1) != 0) {
+                want = (int)(count % (blocks + 1)) - 1;
+            }
+            int block = lSlotCheckPlan(count, blocks);
+            prvExpect("lSlotCheckPlan", count, blocks, block, want);
+            if (block >= 0 && block < IMG_HDR_BLOCKS) {
+                seen[block]++;
+            }
+        }
+        // whole rounds before the log is full, each block once per round
+        for (uint32_t i = 0; i < blocks; i++) {
+            prvExpect("blocks checked", i, blocks, seen[i], (LOG_CHECKS - (i + 1) + blocks) / (blocks + 1));
+        }
+    }
+    prvExpect("lSlotCheckPlan no blocks", 1, 0, lSlotCheckPlan(1, 0), -1);
+    printf("plan 1..%u blocks, 0..%u checks: %s\n", IMG_HDR_BLOCKS, LOG_CHECKS, ulFailed ? "FAIL" : "ok");
+}
+
+// Image with a header as imgpack.py stamps it, committed the way the bootloader does
+static const AppHeader_t *prvInstall(void) {
+    uint8_t *image = (uint8_t *)SLOT_BASE;
+    AppHeader_t *app = (AppHeader_t *)(SLOT_BASE + IMG_HDR_OFFSET);
+    uint32_t seed = 1;
+
+    memset(image, 0xFF, SLOT_SIZE);
+    for (uint32_t i = 0; i < IMAGE_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        image[i] = (uint8_t)(seed >> 16);
+    }
+    ((uint32_t *)image)[0] = 0x20020000;
+    ((uint32_t *)image)[1] = SLOT_BASE + IMG_HDR_OFFSET + sizeof(AppHeader_t) + 1;
+    *(uint32_t *)(image + IMG_SIGNATURE_OFFSET) = IMG_SIGNATURE_VALUE;
+
+    uint32_t skip = IMG_HDR_OFFSET + sizeof(AppHeader_t);
+    uint32_t body = IMAGE_SIZE - skip;
+    memset(app, 0, sizeof(*app));
+    app->ulMagic = IMG_HDR_MAGIC;
+    app->usHdrVersion = IMG_HDR_VERSION;
+    app->usHdrSize = sizeof(AppHeader_t);
+    app->ulLength = IMAGE_SIZE;
+    app->ulLoadAddr = SLOT_BASE;
+    app->ulVersion = IMAGE_VERSION;
+    app->ucChkAlg = CHK_ALG_CRC16;
+    app->ulBlockSize = ((body + IMG_HDR_BLOCKS - 1) / IMG_HDR_BLOCKS + 3) & ~3u;
+    for (uint32_t off = 0; off < body; off += app->ulBlockSize) {
+        uint32_t len = body - off < app->ulBlockSize ? body - off : app->ulBlockSize;
+        app->ulBlockChkSum[app->usBlockCount++] = ulChkSumCalc(CHK_ALG_CRC16, image + skip + off, len);
+    }
+    uint32_t crc = ulChkSumUpdate(CHK_ALG_CRC16, ulChkSumInit(CHK_ALG_CRC16), image, IMG_HDR_OFFSET);
+    crc = ulChkSumUpdate(CHK_ALG_CRC16, crc, image + skip, body);
+    app->ulChkSum = ulChkSumFinal(CHK_ALG_CRC16, crc);
+    app->ulHdrChkSum = ulChkSumCalc(CHK_ALG_CRC16, app, offsetof(AppHeader_t, ulHdrChkSum));
+
+    xSlotCommit(&xSlot, IMAGE_VERSION, IMAGE_SIZE, ulChkSumCalc(CHK_ALG_CRC16, image, IMAGE_SIZE), CHK_ALG_CRC16, prvProgram);
+    return pxSlotAppHeader(&xSlot);
+}
+
+static int prvLogCount(const ImageHeader_t *pxHdr) {
+    int count = 0;
+    for (int i = 0; i < IMG_CHECK_LOG_SIZE; i++) {
+        for (uint8_t used = ~pxHdr->ucCheckLog[i]; used; used >>= 1) {
+            count += used & 1;
+        }
+    }
+    return count;
+}
+
+static bool prvBoot(void) {
+    uint32_t version = 0;
+    return xSlotIsBootable(&xSlot, &version, prvProgram) && version == IMAGE_VERSION;
+}
+
+static void prvTestLog(void) {
+    uint32_t failed = ulFailed;
+    const AppHeader_t *app = prvInstall();
+    const ImageHeader_t *hdr = pxSlotHeader(&xSlot);
+    prvExpect("image header", 0, 0, app != NULL, 1);
+    if (app == NULL) {
+        return;
+    }
+    uint8_t behind[IMG_TRAILER_SIZE];
+    memcpy(behind, (const uint8_t *)hdr + IMG_TRAILER_SIZE, sizeof(behind));
+
+    for (uint32_t boot = 1; boot <= LOG_CHECKS + 2 * IMG_HDR_BLOCKS; boot++) {
+        prvExpect("boot", boot, 0, prvBoot(), 1);
+        prvExpect("checks logged", boot, 0, prvLogCount(hdr), boot < LOG_CHECKS ? (int)boot : LOG_CHECKS);
+        // the log fills byte by byte, the first byte with a 1 left takes the next check
+        int used = 0;
+        while (used < IMG_CHECK_LOG_SIZE && hdr->ucCheckLog[used] == 0x00) {
+            used++;
+        }
+        prvExpect("log bytes used", boot, 0, used, boot < LOG_CHECKS ? (int)(boot / 8) : IMG_CHECK_LOG_SIZE);
+    }
+    prvExpect("verified tag", 0, 0, hdr->ulVerified == app->ulHdrChkSum, 1);
+    prvExpect("trailer after it", 0, 0, memcmp(behind, (const uint8_t *)hdr + IMG_TRAILER_SIZE, sizeof(behind)), 0);
+    printf("log of %u bytes, %u checks: %s\n", IMG_CHECK_LOG_SIZE, LOG_CHECKS, ulFailed != failed ? "FAIL" : "ok");
+}
+
+// Corrupt a byte of ulBlock after ulBoots boots, the next boot that checks it must fail
+static void prvTestCorrupt(uint32_t ulBlock, uint32_t ulBoots) {
+    const AppHeader_t *app = prvInstall();
+    if (app == NULL) {
+        prvExpect("image header", ulBlock, ulBoots, 0, 1);
+        return;
+    }
+    for (uint32_t boot = 0; boot < ulBoots; boot++) {
+        prvBoot();
+    }
+    uint32_t count = prvLogCount(pxSlotHeader(&xSlot));
+    uint32_t blocks = app->usBlockCount;
+    uint8_t *byte = (uint8_t *)(SLOT_BASE + IMG_HDR_OFFSET + app->usHdrSize + ulBlock * app->ulBlockSize + 1);
+    *byte ^= 0x5A;
+
+    uint32_t boot = 1;
+    while (boot <= blocks + 1 && prvBoot()) {
+        boot++;
+    }
+    // boot n runs check count + n - 1
+    uint32_t want = 1;
+    int plan;
+    while ((plan = lSlotCheckPlan(count + want - 1, blocks)) >= 0 && plan != (int)ulBlock) {
+        want++;
+    }
+    prvExpect("corrupt block caught on boot", ulBlock, ulBoots, boot, want);
+}
+
+int main(void) {
+#ifdef MAP_FIXED_NOREPLACE
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE;
+#else
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+#endif
+    void *map = mmap((void *)(uintptr_t)SLOT_BASE, SLOT_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (map != (void *)(uintptr_t)SLOT_BASE) {
+        fprintf(stderr, "can not map the slot at 0x%08x\n", SLOT_BASE);
+        return 1;
+    }
+
+    prvTestPlan();
+    prvTestLog();
+
+    uint32_t failed = ulFailed;
+    for (uint32_t block = 0; block < IMG_HDR_BLOCKS; block++) {
+        for (uint32_t boots = 1; boots <= IMG_HDR_BLOCKS + 1; boots++) {
+            prvTestCorrupt(block, boots);
+        }
+        prvTestCorrupt(block, LOG_CHECKS);
+    }
+    printf("corrupt block, %u blocks: %s\n", IMG_HDR_BLOCKS, ulFailed != failed ? "FAIL" : "ok");
+    return ulFailed ? 1 : 0;
+}